@@ -0,0 +1,282 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+//Microbenchmark of the generator core phases, outside the editor so it can be run under perf and other profilers.
+//DungeonCoreBenchmark [-runs N] [-seed S] [-sizes 36000,72000] [-tiles 600,300] [-iterations 5,8]
+//Prints min, median and p99 milliseconds of every phase for every combination of the settings.
+
+#include "DungeonCore/DungeonGenerator.h"
+#include "DungeonCore/DungeonRegions.h"
+#include "DungeonCore/DungeonPathGraph.h"
+#include "DungeonCore/DungeonFlowField.h"
+#include "DungeonCore/DungeonVisibility.h"
+#include "DungeonCore/DungeonTorches.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DungeonCore;
+
+enum EPhase
+{
+	PHASE_SPLIT,
+	PHASE_SPLIT_PARALLEL,
+	PHASE_ROOMS,
+	PHASE_FILL,
+	PHASE_MASKS,
+	PHASE_TORCHES,
+	PHASE_TORCH_LIGHTS,
+	PHASE_REGIONS,
+	PHASE_PATH_GRAPH,
+	PHASE_FIND_PATHS,
+	PHASE_SMOOTH_PATHS,
+	PHASE_VISIBILITY,
+	PHASE_FLOW_SEARCH,
+	PHASE_FLOW_REPAIRS,
+	PHASE_REGENERATE_SUBTREE,
+	NUM_PHASES
+};
+
+static const char* PhaseNames[NUM_PHASES] = { "SplitSpaces", "SplitSpacesParallel", "SelectShrinkRooms", "FillTileGrid", "NeighbourMasks", "PlaceTorches", "SelectTorchLights", "RegionIds", "PathGraph", "FindPath x100", "SmoothPath x100", "RegionVisibility", "FlowFieldSearch", "FlowFieldStep x100", "RegenerateSubtree" };
+
+//path queries and flow field target steps per run of their phases
+static const int NumPathQueries = 100;
+static const int NumFlowSteps = 100;
+
+static std::vector<int> ParseList(const char* value)
+{
+	std::vector<int> values;
+	std::string list(value);
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		const size_t end = std::min(list.find(',', start), list.size());
+		if (end > start)
+			values.push_back(std::atoi(list.substr(start, end - start).c_str()));
+		start = end + 1;
+	}
+	return values;
+}
+
+static double GetPercentile(std::vector<double>& samples, double percentile)
+{
+	std::sort(samples.begin(), samples.end());
+	const size_t index = std::min(samples.size() - 1, size_t(percentile * (samples.size() - 1) + 0.5));
+	return samples[index];
+}
+
+static void ThreadedParallelFor(int32_t count, const std::function<void(int32_t)>& body)
+{
+	const int numThreads = int(std::max(1u, std::thread::hardware_concurrency()));
+	if (count < 2 * numThreads)
+	{
+		for (int32_t i = 0; i < count; i++)
+			body(i);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([t, count, numThreads, &body]()
+			{
+				for (int32_t i = t; i < count; i += numThreads)
+					body(i);
+			});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 20;
+	int32_t seed = 1;
+	std::vector<int> dungeonSizes = { 36000, 72000 };
+	std::vector<int> tileSizes = { 600, 300 };
+	std::vector<int> splitIterations = { 5, 8 };
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "-runs") == 0)
+			runs = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "-seed") == 0)
+			seed = std::atoi(argv[i + 1]);
+		else if (std::strcmp(argv[i], "-sizes") == 0)
+			dungeonSizes = ParseList(argv[i + 1]);
+		else if (std::strcmp(argv[i], "-tiles") == 0)
+			tileSizes = ParseList(argv[i + 1]);
+		else if (std::strcmp(argv[i], "-iterations") == 0)
+			splitIterations = ParseList(argv[i + 1]);
+	}
+
+	typedef std::chrono::steady_clock FClock;
+	auto getMs = [](FClock::time_point start) { return std::chrono::duration<double, std::milli>(FClock::now() - start).count(); };
+
+	std::printf("DungeonSize,TileSize,SplitIterations,Rooms,Corridors,Phase,MinMs,MedianMs,P99Ms\n");
+	FLayout layout;
+	FLayout regeneratedLayout;
+	std::vector<uint8_t> tiles;
+	std::vector<uint8_t> padded;
+	std::vector<uint8_t> masks;
+	std::vector<int32_t> regionIds;
+	FPathGraph pathGraph;
+	FPathScratch pathScratch;
+	std::vector<int32_t> path;
+	std::vector<int> walkableTiles;
+	FRegionVisibility visibility;
+	std::vector<FTorch> torches;
+	std::vector<float> torchCosts;
+	std::vector<int32_t> torchLights;
+	FFlowField flowField;
+	for (int dungeonSize : dungeonSizes)
+	{
+		for (int tileSize : tileSizes)
+		{
+			for (int iterations : splitIterations)
+			{
+				FSettings settings;
+				settings.dungeonSize = dungeonSize;
+				settings.tileSize = tileSize;
+				settings.splitIterations = iterations;
+				const int rows = dungeonSize / tileSize;
+
+				std::vector<double> samples[NUM_PHASES];
+				for (int run = 0; run < runs; run++)
+				{
+					//the same seed every run, so every run does the same work
+					layout.Reset();
+					FClock::time_point start = FClock::now();
+					SplitSpaces(settings, seed, layout, ThreadedParallelFor);
+					samples[PHASE_SPLIT_PARALLEL].push_back(getMs(start));
+
+					layout.Reset();
+					start = FClock::now();
+					SplitSpaces(settings, seed, layout);
+					samples[PHASE_SPLIT].push_back(getMs(start));
+
+					start = FClock::now();
+					SelectRooms(settings, layout);
+					ShrinkRooms(settings, seed, layout);
+					samples[PHASE_ROOMS].push_back(getMs(start));
+
+					start = FClock::now();
+					tiles.assign(size_t(rows) * rows, uint8_t(ETileType::EMPTY));
+					FillTileGrid(settings, layout, tiles.data());
+					samples[PHASE_FILL].push_back(getMs(start));
+
+					start = FClock::now();
+					padded.resize(size_t(rows + 2) * (rows + 2));
+					masks.resize(size_t(rows) * rows);
+					ComputeNeighbourMasks(tiles.data(), rows, padded.data(), masks.data());
+					samples[PHASE_MASKS].push_back(getMs(start));
+
+					start = FClock::now();
+					PlaceTorches(tiles.data(), masks.data(), rows, 4, torches);
+					samples[PHASE_TORCHES].push_back(getMs(start));
+
+					//what the light manager does when the player steps to another tile: the distance to every torch and the 8 nearest
+					start = FClock::now();
+					torchCosts.resize(torches.size());
+					for (size_t torch = 0; torch < torches.size(); torch++)
+					{
+						const float dx = float(torches[torch].tile % rows - rows / 2);
+						const float dy = float(torches[torch].tile / rows - rows / 2);
+						torchCosts[torch] = dx * dx + dy * dy;
+					}
+					SelectLowestCosts(torchCosts, 8, torchLights);
+					samples[PHASE_TORCH_LIGHTS].push_back(getMs(start));
+
+					start = FClock::now();
+					regionIds.resize(size_t(rows) * rows);
+					const int numRegions = FillRegionIds(settings, layout, tiles.data(), regionIds.data());
+					samples[PHASE_REGIONS].push_back(getMs(start));
+
+					start = FClock::now();
+					pathGraph.Build(regionIds.data(), rows, numRegions);
+					samples[PHASE_PATH_GRAPH].push_back(getMs(start));
+
+					walkableTiles.clear();
+					for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+					{
+						if (tiles[tileIndex] != uint8_t(ETileType::EMPTY))
+							walkableTiles.push_back(tileIndex);
+					}
+					FRandomStream queryStream(seed);
+					start = FClock::now();
+					for (int query = 0; query < NumPathQueries && !walkableTiles.empty(); query++)
+					{
+						const int startTile = walkableTiles[queryStream.RandRange(0, int(walkableTiles.size()) - 1)];
+						const int goalTile = walkableTiles[queryStream.RandRange(0, int(walkableTiles.size()) - 1)];
+						pathGraph.FindPath(startTile, goalTile, pathScratch, path);
+					}
+					samples[PHASE_FIND_PATHS].push_back(getMs(start));
+
+					//the same queries again, only the smoothing of the found paths is timed
+					queryStream = FRandomStream(seed);
+					double smoothMs = 0.0;
+					for (int query = 0; query < NumPathQueries && !walkableTiles.empty(); query++)
+					{
+						const int startTile = walkableTiles[queryStream.RandRange(0, int(walkableTiles.size()) - 1)];
+						const int goalTile = walkableTiles[queryStream.RandRange(0, int(walkableTiles.size()) - 1)];
+						if (!pathGraph.FindPath(startTile, goalTile, pathScratch, path))
+							continue;
+						start = FClock::now();
+						pathGraph.SmoothPath(path, 0.2f);
+						smoothMs += getMs(start);
+					}
+					samples[PHASE_SMOOTH_PATHS].push_back(smoothMs);
+
+					start = FClock::now();
+					visibility.Build(pathGraph);
+					samples[PHASE_VISIBILITY].push_back(getMs(start));
+
+					if (walkableTiles.empty())
+						continue;
+
+					flowField.Init(tiles.data(), rows);
+					start = FClock::now();
+					flowField.SetTarget(walkableTiles[0]);
+					samples[PHASE_FLOW_SEARCH].push_back(getMs(start));
+
+					//the target walks like a player, one neighbouring tile at a time
+					start = FClock::now();
+					int target = walkableTiles[0];
+					for (int step = 0; step < NumFlowSteps; step++)
+					{
+						const int col = target % rows;
+						const int next = queryStream.RandRange(0, 1) == 0 ? (col + 1 < rows ? target + 1 : -1) : target + rows;
+						if (next >= 0 && next < rows * rows && tiles[next] != uint8_t(ETileType::EMPTY))
+						{
+							target = next;
+							flowField.SetTarget(target);
+						}
+					}
+					samples[PHASE_FLOW_REPAIRS].push_back(getMs(start));
+
+					//a wing below the root: the layout again, the tiles and masks of its space. The printed room counts are the ones before
+					regeneratedLayout = layout;
+					start = FClock::now();
+					FTileRect changedTiles;
+					if (RegenerateSubtree(settings, seed, 2, seed + 1, regeneratedLayout, changedTiles))
+					{
+						FillTileRect(settings, regeneratedLayout, changedTiles, tiles.data());
+						UpdateNeighbourMasks(tiles.data(), rows, changedTiles, padded.data(), masks.data());
+					}
+					samples[PHASE_REGENERATE_SUBTREE].push_back(getMs(start));
+				}
+
+				for (int phase = 0; phase < NUM_PHASES; phase++)
+				{
+					std::printf("%d,%d,%d,%zu,%zu,%s,%.4f,%.4f,%.4f\n", dungeonSize, tileSize, iterations, layout.rooms.size(), layout.corridors.size(), PhaseNames[phase],
+						GetPercentile(samples[phase], 0.0), GetPercentile(samples[phase], 0.5), GetPercentile(samples[phase], 0.99));
+				}
+			}
+		}
+	}
+	return 0;
+}
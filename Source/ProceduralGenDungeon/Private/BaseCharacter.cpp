@@ -4,9 +4,9 @@
 #include "BaseCharacter.h"
 
 #include "DungeonSpace.h"
+#include "DungeonWorldSubsystem.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "Components/CapsuleComponent.h"
-#include "Kismet/GameplayStatics.h"
 #include "Camera/CameraComponent.h"
 
 // Sets default values
@@ -84,33 +84,17 @@ void ABaseCharacter::SpawnMinimap()
 	if (GEngine)
 		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Emerald, TEXT("Show minimap"));
 
-	TArray<AActor*> DungeonSpaces;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ADungeonSpace::StaticClass() , DungeonSpaces);
-
-	if(DungeonSpaces.Num()>0)
+	if (ADungeonSpace* DungeonSpace = GetDungeonSpace())
 	{
-		ADungeonSpace* DungeonSpace = ((ADungeonSpace*)DungeonSpaces[0]);
-		if(IsValid(DungeonSpace))
-		{
-			FTransform playerTransform = GetActorTransform();
-			DungeonSpace->GenerateMinimap(playerTransform);
-		}
+		FTransform playerTransform = GetActorTransform();
+		DungeonSpace->GenerateMinimap(playerTransform);
 	}
 }
 
 void ABaseCharacter::GenerateDungeon()
 {
-	TArray<AActor*> DungeonSpaces;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ADungeonSpace::StaticClass(), DungeonSpaces);
-
-	if (DungeonSpaces.Num() > 0)
-	{
-		ADungeonSpace* DungeonSpace = ((ADungeonSpace*)DungeonSpaces[0]);
-		if (IsValid(DungeonSpace))
-		{
-			DungeonSpace->GenerateDungeon();
-		}
-	}
+	if (ADungeonSpace* DungeonSpace = GetDungeonSpace())
+		DungeonSpace->GenerateDungeon();
 }
 
 void ABaseCharacter::DebugTile()
@@ -118,20 +102,25 @@ void ABaseCharacter::DebugTile()
 	if (GEngine)
 		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Orange, TEXT("Debug tile"));
 
-	TArray<AActor*> DungeonSpaces;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ADungeonSpace::StaticClass(), DungeonSpaces);
-
-	if (DungeonSpaces.Num() > 0)
+	if (ADungeonSpace* DungeonSpace = GetDungeonSpace())
 	{
-		ADungeonSpace* DungeonSpace = ((ADungeonSpace*)DungeonSpaces[0]);
-		if (IsValid(DungeonSpace))
-		{
-			FVector location = GetActorLocation();
-			DungeonSpace->DebugTiles(location);
-		}
+		FVector location = GetActorLocation();
+		DungeonSpace->DebugTiles(location);
 	}
 }
 
+ADungeonSpace* ABaseCharacter::GetDungeonSpace() const
+{
+	const UDungeonWorldSubsystem* DungeonSubsystem = GetWorld()->GetSubsystem<UDungeonWorldSubsystem>();
+	if (DungeonSubsystem == nullptr)
+		return nullptr;
+
+	//the dungeon the player stands in, or the first one when the player is outside of every dungeon
+	int TileIndex;
+	ADungeonSpace* DungeonSpace = DungeonSubsystem->FindTileAtLocation(GetActorLocation(), TileIndex);
+	return DungeonSpace != nullptr ? DungeonSpace : DungeonSubsystem->GetDungeon();
+}
+
 void ABaseCharacter::StartSprinting()
 {
 	GetCharacterMovement()->MaxWalkSpeed = BaseWalkSpeed * 3;
@@ -148,9 +137,6 @@ void ABaseCharacter::BeginPlay()
 	Super::BeginPlay();
 	if (GEngine)
 		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Blue, TEXT("using basecharacter"));
-
-	
-	
 }
 
 // Called every frame
@@ -158,6 +144,9 @@ void ABaseCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	//only writes texels while the texture minimap is shown and the player enters another tile
+	if (ADungeonSpace* DungeonSpace = GetDungeonSpace())
+		DungeonSpace->UpdateMinimapPlayer(GetActorLocation());
 }
 
 // Called to bind functionality to input
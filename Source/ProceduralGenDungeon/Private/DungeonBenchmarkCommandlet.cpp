@@ -0,0 +1,185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonBenchmarkCommandlet.h"
+#include "DungeonSpace.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDungeonBenchmark, Log, All);
+
+enum EBenchmarkPhase
+{
+	PHASE_SPLIT_SPACE,
+	PHASE_SELECT_DUNGEON_ROOMS,
+	PHASE_FILL_TILE_GRID,
+	PHASE_BUILD_INSTANCES,
+	PHASE_CONSTRUCT_DUNGEON_GRID,
+	PHASE_GENERATE_MINIMAP,
+	PHASE_TOTAL,
+	NUM_PHASES
+};
+
+static const TCHAR* PhaseNames[NUM_PHASES] =
+{
+	TEXT("SplitSpace"),
+	TEXT("SelectDungeonRooms"),
+	TEXT("FillTileGrid"),
+	TEXT("BuildInstances"),
+	TEXT("ConstructDungeonGrid"),
+	TEXT("GenerateMinimap"),
+	TEXT("Total"),
+};
+
+//comma separated list of ints after name, the defaults when the parameter is missing
+static TArray<int32> ParseIntList(const FString& params, const TCHAR* name, const TArray<int32>& defaults)
+{
+	FString list;
+	if (!FParse::Value(*params, name, list, false))
+		return defaults;
+
+	TArray<FString> entries;
+	list.ParseIntoArray(entries, TEXT(","));
+	TArray<int32> values;
+	for (const FString& entry : entries)
+	{
+		values.Add(FCString::Atoi(*entry));
+	}
+	return values.Num() > 0 ? values : defaults;
+}
+
+//nearest rank percentile of sorted samples
+static double GetPercentile(const TArray<double>& sortedSamples, double percentile)
+{
+	const int rank = FMath::Clamp(FMath::CeilToInt(percentile * sortedSamples.Num()) - 1, 0, sortedSamples.Num() - 1);
+	return sortedSamples[rank];
+}
+
+UDungeonBenchmarkCommandlet::UDungeonBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UDungeonBenchmarkCommandlet::Main(const FString& Params)
+{
+	const TArray<int32> dungeonSizes = ParseIntList(Params, TEXT("DungeonSizes="), { 36000 });
+	const TArray<int32> tileSizes = ParseIntList(Params, TEXT("TileSizes="), { 600 });
+	const TArray<int32> splitIterations = ParseIntList(Params, TEXT("SplitIterations="), { 5 });
+	const TArray<int32> minTilesPerRoom = ParseIntList(Params, TEXT("MinTilesPerRoom="), { 2 });
+	int32 runs = 20;
+	FParse::Value(*Params, TEXT("Runs="), runs);
+	runs = FMath::Max(1, runs);
+	int32 seed = 1;
+	FParse::Value(*Params, TEXT("Seed="), seed);
+	FString outputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("DungeonBenchmark");
+	FParse::Value(*Params, TEXT("Output="), outputPath);
+
+	//the dungeons are spawned in a world of their own, nothing is rendered
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("DungeonBenchmark"));
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	FString csv = TEXT("DungeonSize,TileSize,SplitIterations,MinTilesPerRoom,Phase,Runs,MinMs,MedianMs,P99Ms,Floors,Walls,Pillars,UsedDeltaMB,ProcessPeakUsedMB\n");
+	TArray<FString> jsonEntries;
+
+	for (int32 dungeonSize : dungeonSizes)
+	{
+		for (int32 tileSize : tileSizes)
+		{
+			for (int32 iterations : splitIterations)
+			{
+				for (int32 minTiles : minTilesPerRoom)
+				{
+					if (tileSize <= 0 || dungeonSize < tileSize)
+						continue;
+
+					ADungeonSpace* dungeon = world->SpawnActor<ADungeonSpace>();
+					dungeon->DungeonSize = dungeonSize;
+					dungeon->TileSize = tileSize;
+					dungeon->SplitIterations = iterations;
+					dungeon->MinTilesPerRoom = minTiles;
+					dungeon->UseAsyncGeneration = false;
+					dungeon->UseTimeSlicedConstruction = false;
+					dungeon->UseChunkStreaming = false;
+					dungeon->RandomizeSeed = false;
+					dungeon->MinimapMode = EMinimapMode::CUBES;
+					dungeon->IsShowingMinimap = true;
+
+					TArray<double> samples[NUM_PHASES];
+					FIntVector instanceCounts = FIntVector::ZeroValue;
+					//growth of the used memory over a run, the most of all runs. It is what the dungeon still holds afterwards, the buffers that only live during the
+					//generation only show in the peak of the process. That peak is never reset, so it includes the configurations before this one
+					int64 maxUsedDelta = 0;
+					uint64 processPeakUsedPhysical = 0;
+					for (int run = 0; run < runs; run++)
+					{
+						//the same seeds for every configuration, so the runs are reproducible
+						dungeon->Seed = seed + run;
+						const uint64 usedBefore = FPlatformMemory::GetStats().UsedPhysical;
+						dungeon->GenerateDungeon();
+						const double minimapStart = FPlatformTime::Seconds();
+						FTransform playerTransform = dungeon->GetActorTransform();
+						dungeon->GenerateMinimap(playerTransform);
+						const double minimapMs = (FPlatformTime::Seconds() - minimapStart) * 1000.0;
+
+						const FDungeonGenerationTimings& timings = dungeon->GetLastTimings();
+						samples[PHASE_SPLIT_SPACE].Add(timings.SplitSpaceMs);
+						samples[PHASE_SELECT_DUNGEON_ROOMS].Add(timings.SelectDungeonRoomsMs);
+						samples[PHASE_FILL_TILE_GRID].Add(timings.FillTileGridMs);
+						samples[PHASE_BUILD_INSTANCES].Add(timings.BuildInstancesMs);
+						samples[PHASE_CONSTRUCT_DUNGEON_GRID].Add(timings.ConstructDungeonGridMs);
+						samples[PHASE_GENERATE_MINIMAP].Add(minimapMs);
+						samples[PHASE_TOTAL].Add(timings.SplitSpaceMs + timings.SelectDungeonRoomsMs + timings.FillTileGridMs + timings.BuildInstancesMs + timings.ConstructDungeonGridMs + minimapMs);
+
+						//sampled while the buffers of the generation are still alive
+						instanceCounts = dungeon->GetInstanceCounts();
+						const FPlatformMemoryStats memoryStats = FPlatformMemory::GetStats();
+						maxUsedDelta = FMath::Max<int64>(maxUsedDelta, int64(memoryStats.UsedPhysical) - int64(usedBefore));
+						processPeakUsedPhysical = FMath::Max<uint64>(processPeakUsedPhysical, memoryStats.PeakUsedPhysical);
+					}
+					dungeon->Destroy();
+
+					const double usedDeltaMB = double(maxUsedDelta) / (1024.0 * 1024.0);
+					const double processPeakUsedMB = double(processPeakUsedPhysical) / (1024.0 * 1024.0);
+					TArray<FString> jsonPhases;
+					for (int phase = 0; phase < NUM_PHASES; phase++)
+					{
+						samples[phase].Sort();
+						const double minMs = samples[phase][0];
+						const double medianMs = GetPercentile(samples[phase], 0.5);
+						const double p99Ms = GetPercentile(samples[phase], 0.99);
+						csv += FString::Printf(TEXT("%d,%d,%d,%d,%s,%d,%.4f,%.4f,%.4f,%d,%d,%d,%.1f,%.1f\n"), dungeonSize, tileSize, iterations, minTiles, PhaseNames[phase], runs, minMs, medianMs, p99Ms,
+							instanceCounts.X, instanceCounts.Y, instanceCounts.Z, usedDeltaMB, processPeakUsedMB);
+						jsonPhases.Add(FString::Printf(TEXT("\"%s\": {\"minMs\": %.4f, \"medianMs\": %.4f, \"p99Ms\": %.4f}"), PhaseNames[phase], minMs, medianMs, p99Ms));
+					}
+					jsonEntries.Add(FString::Printf(TEXT("{\"dungeonSize\": %d, \"tileSize\": %d, \"splitIterations\": %d, \"minTilesPerRoom\": %d, \"runs\": %d, ")
+						TEXT("\"instances\": {\"floors\": %d, \"walls\": %d, \"pillars\": %d}, \"usedDeltaMB\": %.1f, \"processPeakUsedMB\": %.1f, \"phases\": {%s}}"),
+						dungeonSize, tileSize, iterations, minTiles, runs, instanceCounts.X, instanceCounts.Y, instanceCounts.Z, usedDeltaMB, processPeakUsedMB, *FString::Join(jsonPhases, TEXT(", "))));
+
+					UE_LOG(LogDungeonBenchmark, Display, TEXT("DungeonSize %d, TileSize %d, SplitIterations %d, MinTilesPerRoom %d: median %.3f ms, p99 %.3f ms, %d instances"),
+						dungeonSize, tileSize, iterations, minTiles, GetPercentile(samples[PHASE_TOTAL], 0.5), GetPercentile(samples[PHASE_TOTAL], 0.99), instanceCounts.X + instanceCounts.Y + instanceCounts.Z);
+				}
+			}
+		}
+	}
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+
+	const FString json = FString::Printf(TEXT("{\"results\": [\n%s\n]}\n"), *FString::Join(jsonEntries, TEXT(",\n")));
+	const bool isSaved = FFileHelper::SaveStringToFile(csv, *(outputPath + TEXT(".csv"))) && FFileHelper::SaveStringToFile(json, *(outputPath + TEXT(".json")));
+	if (!isSaved)
+	{
+		UE_LOG(LogDungeonBenchmark, Error, TEXT("Could not write the results to %s"), *outputPath);
+		return 1;
+	}
+
+	UE_LOG(LogDungeonBenchmark, Display, TEXT("Results written to %s.csv and %s.json"), *outputPath, *outputPath);
+	return 0;
+}
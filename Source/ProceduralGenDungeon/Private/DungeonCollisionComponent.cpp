@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCollisionComponent.h"
+#include "PhysicsEngine/BodySetup.h"
+
+UDungeonCollisionComponent::UDungeonCollisionComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	BoxBodySetup = nullptr;
+	LocalBounds = FBox(ForceInit);
+	SetCollisionProfileName("BlockAll");
+	SetGenerateOverlapEvents(false);
+	bHiddenInGame = true;
+	SetCastShadow(false);
+}
+
+void UDungeonCollisionComponent::SetBoxes(const TArray<FBox>& boxes)
+{
+	if (BoxBodySetup == nullptr)
+	{
+		BoxBodySetup = NewObject<UBodySetup>(this, NAME_None, RF_Transient);
+		BoxBodySetup->CollisionTraceFlag = CTF_UseSimpleAsComplex;
+		BoxBodySetup->bNeverNeedsCookedCollisionData = true;
+	}
+
+	//boxes need no cooking, so the body can be rebuilt on every generation
+	BoxBodySetup->RemoveSimpleCollision();
+	LocalBounds = FBox(ForceInit);
+	for (const FBox& box : boxes)
+	{
+		const FVector size = box.GetSize();
+		FKBoxElem& boxElem = BoxBodySetup->AggGeom.BoxElems.Emplace_GetRef(size.X, size.Y, size.Z);
+		boxElem.Center = box.GetCenter();
+		LocalBounds += box;
+	}
+	BoxBodySetup->InvalidatePhysicsData();
+	BoxBodySetup->CreatePhysicsMeshes();
+
+	RecreatePhysicsState();
+	UpdateBounds();
+}
+
+int UDungeonCollisionComponent::GetNumBoxes() const
+{
+	return BoxBodySetup != nullptr ? BoxBodySetup->AggGeom.BoxElems.Num() : 0;
+}
+
+UBodySetup* UDungeonCollisionComponent::GetBodySetup()
+{
+	return BoxBodySetup;
+}
+
+FBoxSphereBounds UDungeonCollisionComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (!LocalBounds.IsValid)
+		return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.f);
+
+	return FBoxSphereBounds(LocalBounds.TransformBy(LocalToWorld));
+}
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonFlowField.h"
+
+#include <algorithm>
+
+namespace DungeonCore
+{
+	//C++14 needs a definition of the constants that are bound to references
+	constexpr int FFlowField::MaxRepairSteps;
+	constexpr int32_t FFlowField::Unreachable;
+
+	void FFlowField::Init(const uint8_t* tiles, int rows)
+	{
+		Rows = rows;
+		PaddedRows = rows + 2;
+		Walkable.assign(size_t(PaddedRows) * PaddedRows, 0);
+		for (int row = 0; row < rows; row++)
+		{
+			uint8_t* walkable = Walkable.data() + (row + 1) * PaddedRows + 1;
+			for (int col = 0; col < rows; col++)
+			{
+				walkable[col] = tiles[row * rows + col] != 0;
+			}
+		}
+		Distances.assign(Walkable.size(), Unreachable);
+		Bias = 0;
+		Target = -1;
+		NumVisitedTiles = 0;
+	}
+
+	void FFlowField::Reset()
+	{
+		Rows = 0;
+		PaddedRows = 0;
+		Walkable.clear();
+		Distances.clear();
+		Target = -1;
+		NumVisitedTiles = 0;
+	}
+
+	int FFlowField::GetDistance(int tileIndex) const
+	{
+		if (Target == -1 || tileIndex < 0 || tileIndex >= Rows * Rows)
+			return -1;
+
+		const int32_t distance = Distances[ToPadded(tileIndex)];
+		return distance == Unreachable ? -1 : distance + Bias;
+	}
+
+	int FFlowField::GetNextTile(int tileIndex) const
+	{
+		if (Target == -1 || tileIndex < 0 || tileIndex >= Rows * Rows)
+			return -1;
+
+		const int index = ToPadded(tileIndex);
+		const int32_t distance = Distances[index];
+		if (distance == Unreachable || index == Target)
+			return -1;
+
+		//the border is unreachable, so the neighbours need no bounds checks
+		const int neighbours[4] = { index + 1, index - 1, index + PaddedRows, index - PaddedRows };
+		for (int neighbour : neighbours)
+		{
+			if (Distances[neighbour] == distance - 1)
+				return ToTile(neighbour);
+		}
+		return -1;
+	}
+
+	bool FFlowField::SetTarget(int tileIndex)
+	{
+		NumVisitedTiles = 0;
+		if (tileIndex < 0 || tileIndex >= Rows * Rows || !Walkable[ToPadded(tileIndex)])
+		{
+			if (Target != -1)
+				std::fill(Distances.begin(), Distances.end(), Unreachable);
+			Target = -1;
+			return false;
+		}
+
+		const int target = ToPadded(tileIndex);
+		if (target == Target)
+			return true;
+
+		//repair along the path from the new target to the old one, when it is short
+		const int32_t distance = Target == -1 ? Unreachable : Distances[target];
+		if (distance == Unreachable || distance + Bias > MaxRepairSteps)
+		{
+			Search(target);
+			return false;
+		}
+
+		StepPath.clear();
+		for (int index = target; index != Target; index = ToPadded(GetNextTile(ToTile(index))))
+		{
+			StepPath.push_back(index);
+		}
+		for (auto step = StepPath.rbegin(); step != StepPath.rend(); ++step)
+		{
+			StepTarget(*step);
+		}
+		return true;
+	}
+
+	void FFlowField::Search(int target)
+	{
+		std::fill(Distances.begin(), Distances.end(), Unreachable);
+		Bias = 0;
+		Target = target;
+		Distances[target] = 0;
+		Queue.clear();
+		Queue.push_back(target);
+		for (size_t head = 0; head < Queue.size(); head++)
+		{
+			const int index = Queue[head];
+			const int32_t nextDistance = Distances[index] + 1;
+			const int neighbours[4] = { index + 1, index - 1, index + PaddedRows, index - PaddedRows };
+			for (int neighbour : neighbours)
+			{
+				if (Walkable[neighbour] && Distances[neighbour] == Unreachable)
+				{
+					Distances[neighbour] = nextDistance;
+					Queue.push_back(neighbour);
+				}
+			}
+		}
+		NumVisitedTiles += int(Queue.size());
+	}
+
+	void FFlowField::StepTarget(int target)
+	{
+		//the tiles whose shortest path passed through the new target follow it with a distance that grows by one every step.
+		//They get one closer, stored as two less because the bias below moves every tile one further.
+		//A tile is lowered when it is queued, neighbours always differ by one so a lowered tile never matches again
+		Queue.clear();
+		Queue.push_back(target);
+		Distances[target] -= 2;
+		for (size_t head = 0; head < Queue.size(); head++)
+		{
+			const int index = Queue[head];
+			const int32_t childDistance = Distances[index] + 3;
+			const int neighbours[4] = { index + 1, index - 1, index + PaddedRows, index - PaddedRows };
+			for (int neighbour : neighbours)
+			{
+				if (Distances[neighbour] == childDistance)
+				{
+					Distances[neighbour] -= 2;
+					Queue.push_back(neighbour);
+				}
+			}
+		}
+		Bias++;
+		Target = target;
+		NumVisitedTiles += int(Queue.size());
+	}
+}
@@ -0,0 +1,538 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonGenerator.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace DungeonCore
+{
+	void FLayout::Reset()
+	{
+		nodes.clear();
+		rooms.clear();
+		corridors.clear();
+		subtreeSeeds.clear();
+	}
+
+	float FRandomStream::GetFraction()
+	{
+		Seed = (Seed * 196314165U) + 907633515U;
+		const uint32_t bits = 0x3F800000U | (Seed >> 9);
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result - 1.0f;
+	}
+
+	int32_t FRandomStream::RandRange(int32_t min, int32_t max)
+	{
+		const int32_t range = (max - min) + 1;
+		return min + (range > 0 ? std::min(int32_t(GetFraction() * range), range - 1) : 0);
+	}
+
+	uint32_t HashCombine(uint32_t a, uint32_t c)
+	{
+		uint32_t b = 0x9e3779b9;
+		a += b;
+
+		a -= b; a -= c; a ^= (c >> 13);
+		b -= c; b -= a; b ^= (a << 8);
+		c -= a; c -= b; c ^= (b >> 13);
+		a -= b; a -= c; a ^= (c >> 12);
+		b -= c; b -= a; b ^= (a << 16);
+		c -= a; c -= b; c ^= (b >> 5);
+		a -= b; a -= c; a ^= (c >> 3);
+		b -= c; b -= a; b ^= (a << 10);
+		c -= a; c -= b; c ^= (b >> 15);
+
+		return c;
+	}
+
+	FRandomStream GetNodeStream(int32_t seed, int key, ENodeStream purpose)
+	{
+		uint32_t hash = HashCombine(uint32_t(seed), uint32_t(key));
+		hash = HashCombine(hash, uint32_t(purpose));
+		return FRandomStream(int32_t(hash));
+	}
+
+	bool IsInSubtree(int key, int subtreeKey)
+	{
+		while (key > subtreeKey)
+		{
+			key = (key - 1) / 2;
+		}
+		return key == subtreeKey;
+	}
+
+	int32_t GetNodeSeed(const FLayout& layout, int32_t seed, int key)
+	{
+		if (layout.subtreeSeeds.empty())
+			return seed;
+
+		//the subtrees never nest, a regenerated subtree drops the seeds of the subtrees inside it
+		for (const std::pair<int, int32_t>& subtreeSeed : layout.subtreeSeeds)
+		{
+			if (IsInSubtree(key, subtreeSeed.first))
+				return subtreeSeed.second;
+		}
+		return seed;
+	}
+
+	int GetMaxElements(int splitIterations)
+	{
+		return int(std::pow(2, splitIterations + 1)) - 1;
+	}
+
+	void SplitSpaces(const FSettings& settings, int32_t seed, FLayout& layout, const FParallelFor& parallelFor, const std::function<bool()>& isCancelled)
+	{
+		const int minRoomSize = settings.tileSize * settings.minTilesPerRoom + settings.tileSize * 2;
+		if (settings.dungeonSize <= minRoomSize)
+			return;
+
+		const int maxElements = GetMaxElements(settings.splitIterations);
+		layout.nodes.emplace_back();
+		FNode& root = layout.nodes.back();
+		root.data.width = settings.dungeonSize;
+		root.data.height = settings.dungeonSize;
+
+		auto splitNode = [&settings, &layout, seed, maxElements](int32_t levelStart, int32_t i)
+		{
+			FSpaceData& spaceData = layout.nodes[levelStart + i].data;
+			FSpaceData& leftChild = layout.levelChildren[2 * i];
+			FSpaceData& rightChild = layout.levelChildren[2 * i + 1];
+			leftChild.key = -1;
+			rightChild.key = -1;
+			if (!ChooseSplit(settings, GetNodeSeed(layout, seed, spaceData.key), spaceData))
+				return;
+
+			GetChildSpace(settings, spaceData, 2 * spaceData.key + 1, maxElements, leftChild);
+			GetChildSpace(settings, spaceData, 2 * spaceData.key + 2, maxElements, rightChild);
+		};
+
+		int levelStart = 0;
+		while (levelStart < int(layout.nodes.size()) && !(isCancelled && isCancelled()))
+		{
+			const int levelEnd = int(layout.nodes.size());
+			layout.levelChildren.resize(2 * (levelEnd - levelStart));
+			if (parallelFor)
+			{
+				parallelFor(levelEnd - levelStart, [&splitNode, levelStart](int32_t i) { splitNode(levelStart, i); });
+			}
+			else
+			{
+				for (int i = 0; i < levelEnd - levelStart; i++)
+				{
+					splitNode(levelStart, i);
+				}
+			}
+
+			//append the children of this level in order, the arena is only resized here
+			for (int i = 0; i < levelEnd - levelStart; i++)
+			{
+				const int parentIndex = levelStart + i;
+				for (int side = 0; side < 2; side++)
+				{
+					const FSpaceData& childData = layout.levelChildren[2 * i + side];
+					if (childData.key == -1)
+						continue;
+
+					const int childIndex = int(layout.nodes.size());
+					layout.nodes.emplace_back();
+					layout.nodes[childIndex].data = childData;
+					layout.nodes[childIndex].depth = layout.nodes[parentIndex].depth + 1;
+					(side == 0 ? layout.nodes[parentIndex].left : layout.nodes[parentIndex].right) = childIndex;
+				}
+
+				//connect the centers of both children with a corridor
+				const FNode& parent = layout.nodes[parentIndex];
+				if (parent.left != -1 && parent.right != -1)
+				{
+					const FSpaceData& leftData = layout.nodes[parent.left].data;
+					const FSpaceData& rightData = layout.nodes[parent.right].data;
+					const int tileSize = settings.tileSize;
+
+					layout.corridors.emplace_back();
+					FCorridorData& corridor = layout.corridors.back();
+					corridor.key = leftData.key;
+					corridor.seperation = parent.data.seperation;
+					corridor.startX = leftData.left + (leftData.width / tileSize / 2 - 1) * tileSize;
+					corridor.startY = leftData.bottom + (leftData.height / tileSize / 2 + 1) * tileSize;
+					corridor.endX = rightData.left + (rightData.width / tileSize / 2 + 1) * tileSize;
+					corridor.endY = rightData.bottom + (rightData.height / tileSize / 2 - 1) * tileSize;
+				}
+			}
+			levelStart = levelEnd;
+		}
+	}
+
+	bool ChooseSplit(const FSettings& settings, int32_t seed, FSpaceData& spaceData)
+	{
+		FRandomStream stream = GetNodeStream(seed, spaceData.key, ENodeStream::SPLIT);
+		const int tileSize = settings.tileSize;
+
+		//calculate next split
+		int minXTiles = int((float(spaceData.height) * settings.minRoomRatio)) / tileSize;
+		int maxXTiles = (spaceData.width / tileSize) - minXTiles;
+		bool isVerticalSplitValid = minXTiles < maxXTiles;
+
+		int minYTiles = int((float(spaceData.width) * settings.minRoomRatio)) / tileSize;
+		int maxYTiles = (spaceData.height / tileSize) - minYTiles;
+		bool isHorizontalSplitValid = minYTiles < maxYTiles;
+
+		if (isVerticalSplitValid && isHorizontalSplitValid)
+		{
+			//randomize split
+			spaceData.seperation = ESeperation(stream.RandRange(0, 1));
+			if (spaceData.seperation == ESeperation::VERTICAL)
+				spaceData.tilesSeperated = stream.RandRange(minXTiles, maxXTiles);
+			else
+				spaceData.tilesSeperated = stream.RandRange(maxYTiles, maxYTiles);
+		}
+		else if (isVerticalSplitValid && !isHorizontalSplitValid)
+		{
+			//vertical split
+			spaceData.tilesSeperated = stream.RandRange(minXTiles, maxXTiles);
+			spaceData.seperation = ESeperation::VERTICAL;
+		}
+		else if (!isVerticalSplitValid && isHorizontalSplitValid)
+		{
+			//horizontal split
+			spaceData.tilesSeperated = stream.RandRange(minYTiles, maxYTiles);
+			spaceData.seperation = ESeperation::HORIZONTAL;
+		}
+		else // no split possible
+			return false;
+
+		return true;
+	}
+
+	bool GetChildSpace(const FSettings& settings, const FSpaceData& parentData, int childKey, int maxElements, FSpaceData& childData)
+	{
+		if (childKey >= maxElements)
+			return false;
+
+		const int tileSize = settings.tileSize;
+		childData = parentData;
+		childData.key = childKey;
+
+		//Change data depending on left or right of parent space
+		if (childKey % 2 == 1)//odd = left or top of the space split
+		{
+			if (parentData.seperation == ESeperation::VERTICAL)
+			{
+				childData.width = tileSize * parentData.tilesSeperated;
+			}
+			else
+			{
+				childData.height = parentData.height - (tileSize * parentData.tilesSeperated);
+				childData.bottom = parentData.bottom + tileSize * parentData.tilesSeperated;
+			}
+		}
+		else//even = right or bottom of the space split
+		{
+			if (parentData.seperation == ESeperation::VERTICAL)
+			{
+				childData.width = parentData.width - (tileSize * parentData.tilesSeperated);
+				childData.left = parentData.left + tileSize * parentData.tilesSeperated;
+			}
+			else
+			{
+				childData.height = tileSize * parentData.tilesSeperated;
+			}
+		}
+
+		//check if the width and height are still big enough to split
+		const int minRoomSize = tileSize * settings.minTilesPerRoom + tileSize * 2;
+		if (childData.width <= minRoomSize && childData.height <= minRoomSize)
+		{
+			childData.key = -1;
+			return false;
+		}
+		return true;
+	}
+
+	void SelectRooms(const FSettings& settings, FLayout& layout)
+	{
+		//leaves are collected level by level, left to right within a level
+		for (const FNode& node : layout.nodes)
+		{
+			if (node.depth == settings.splitIterations || node.left == -1 || node.right == -1)
+			{
+				layout.rooms.push_back(node.data);
+			}
+		}
+	}
+
+	void ShrinkRoom(const FSettings& settings, int32_t seed, FSpaceData& roomData)
+	{
+		FRandomStream stream = GetNodeStream(seed, roomData.key, ENodeStream::ROOM);
+		const int tileSize = settings.tileSize;
+
+		//check if there are spare tiles
+		int extraTilesInWidth = (roomData.width / tileSize) - settings.minTilesPerRoom;
+		extraTilesInWidth = std::min(extraTilesInWidth, (roomData.width / tileSize / 2));
+		if (extraTilesInWidth > 1)
+		{
+			extraTilesInWidth = stream.RandRange(1, extraTilesInWidth);
+			roomData.width -= extraTilesInWidth * tileSize;
+			if (extraTilesInWidth % 2 == 1)
+				extraTilesInWidth = -1;
+			roomData.left += (extraTilesInWidth / 2) * tileSize;
+		}
+
+
+		int extraTilesInHeight = (roomData.height / tileSize) - settings.minTilesPerRoom;
+		extraTilesInHeight = std::min(extraTilesInHeight, (roomData.height / tileSize) / 2);
+		if (extraTilesInHeight > 1)
+		{
+			extraTilesInHeight = stream.RandRange(1, extraTilesInHeight);
+			roomData.height -= extraTilesInHeight * tileSize;
+			if (extraTilesInHeight % 2 == 1)
+				extraTilesInHeight = -1;
+			roomData.bottom += (extraTilesInHeight / 2) * tileSize;
+		}
+	}
+
+	void ShrinkRooms(const FSettings& settings, int32_t seed, FLayout& layout)
+	{
+		for (FSpaceData& room : layout.rooms)
+		{
+			ShrinkRoom(settings, GetNodeSeed(layout, seed, room.key), room); //todo fix corridor connections
+		}
+	}
+
+	int FindNode(const FLayout& layout, int key)
+	{
+		//follow the path of the key down from the root, the bits of key + 1 below its top bit are the sides
+		if (layout.nodes.empty() || key < 0)
+			return -1;
+
+		int depth = 0;
+		while ((key + 1) >> (depth + 1) != 0)
+		{
+			depth++;
+		}
+		int index = 0;
+		for (int level = depth - 1; level >= 0 && index != -1; level--)
+		{
+			const bool isRight = (((key + 1) >> level) & 1) != 0;
+			index = isRight ? layout.nodes[index].right : layout.nodes[index].left;
+		}
+		return index;
+	}
+
+	int FindNodeAt(const FLayout& layout, int x, int y, int depth)
+	{
+		auto contains = [x, y](const FSpaceData& data)
+		{
+			return x >= data.left && y >= data.bottom && x < data.left + data.width && y < data.bottom + data.height;
+		};
+		if (layout.nodes.empty() || !contains(layout.nodes[0].data))
+			return -1;
+
+		int index = 0;
+		for (int level = 0; level < depth; level++)
+		{
+			const FNode& node = layout.nodes[index];
+			if (node.left != -1 && contains(layout.nodes[node.left].data))
+				index = node.left;
+			else if (node.right != -1 && contains(layout.nodes[node.right].data))
+				index = node.right;
+			else
+				break;
+		}
+		return layout.nodes[index].data.key;
+	}
+
+	bool RegenerateSubtree(const FSettings& settings, int32_t seed, int key, int32_t subtreeSeed, FLayout& layout, FTileRect& changedTiles)
+	{
+		const int nodeIndex = FindNode(layout, key);
+		if (nodeIndex == -1)
+			return false;
+
+		//the space of a node only depends on its ancestors, so it stays the same
+		const FSpaceData space = layout.nodes[nodeIndex].data;
+		std::vector<std::pair<int, int32_t>> subtreeSeeds;
+		subtreeSeeds.swap(layout.subtreeSeeds);
+		subtreeSeeds.erase(std::remove_if(subtreeSeeds.begin(), subtreeSeeds.end(),
+			[key](const std::pair<int, int32_t>& subtree) { return IsInSubtree(subtree.first, key); }), subtreeSeeds.end());
+		subtreeSeeds.emplace_back(key, subtreeSeed);
+
+		//splitting the whole tree again is cheap next to the tiles and instances, the nodes outside of the subtree draw the same numbers
+		layout.Reset();
+		layout.subtreeSeeds.swap(subtreeSeeds);
+		SplitSpaces(settings, seed, layout);
+		SelectRooms(settings, layout);
+		ShrinkRooms(settings, seed, layout);
+
+		const int tileSize = settings.tileSize;
+		const int rows = settings.dungeonSize / tileSize;
+		changedTiles.minCol = std::max(0, space.left / tileSize);
+		changedTiles.minRow = std::max(0, space.bottom / tileSize);
+		changedTiles.maxCol = std::min(rows, (space.left + space.width + tileSize - 1) / tileSize);
+		changedTiles.maxRow = std::min(rows, (space.bottom + space.height + tileSize - 1) / tileSize);
+		return true;
+	}
+
+	int32_t GetNumGridTiles(int dungeonSize, int tileSize)
+	{
+		if (dungeonSize <= 0 || tileSize <= 0)
+			return -1;
+
+		const int64_t rows = dungeonSize / tileSize;
+		const int64_t numTiles = rows * rows;
+		return numTiles <= INT32_MAX ? int32_t(numTiles) : -1;
+	}
+
+	void FillTileGrid(const FSettings& settings, const FLayout& layout, uint8_t* tiles)
+	{
+		const int tilesDungeon = settings.dungeonSize / settings.tileSize;
+		FTileRect grid;
+		grid.maxCol = tilesDungeon;
+		grid.maxRow = tilesDungeon;
+		FillTileRect(settings, layout, grid, tiles);
+	}
+
+	void FillTileRect(const FSettings& settings, const FLayout& layout, const FTileRect& rect, uint8_t* tiles)
+	{
+		const int tileSize = settings.tileSize;
+		const int tilesDungeon = settings.dungeonSize / tileSize;
+		for (int row = rect.minRow; row < rect.maxRow; row++)
+		{
+			std::memset(tiles + row * tilesDungeon + rect.minCol, uint8_t(ETileType::EMPTY), std::max(0, rect.maxCol - rect.minCol));
+		}
+
+		//writes type into the tiles of a rectangle (max exclusive) that are inside rect, the corridors only fill empty tiles
+		auto fillClipped = [tiles, tilesDungeon, &rect](int minCol, int minRow, int maxCol, int maxRow, ETileType type)
+		{
+			minCol = std::max(minCol, rect.minCol);
+			minRow = std::max(minRow, rect.minRow);
+			maxCol = std::min(maxCol, rect.maxCol);
+			maxRow = std::min(maxRow, rect.maxRow);
+			for (int row = minRow; row < maxRow; row++)
+			{
+				for (int col = minCol; col < maxCol; col++)
+				{
+					uint8_t& tile = tiles[col + tilesDungeon * row];
+					if (type == ETileType::ROOM || tile == uint8_t(ETileType::EMPTY))
+						tile = uint8_t(type);
+				}
+			}
+		};
+
+		//Fill rooms in grid with floor tiles
+		for (const FSpaceData& room : layout.rooms)
+		{
+			const int col = room.left / tileSize;
+			const int row = room.bottom / tileSize;
+			fillClipped(col, row, col + (room.width + tileSize - 1) / tileSize, row + (room.height + tileSize - 1) / tileSize, ETileType::ROOM);
+		}
+
+		//fill corridors in grid with floor tiles
+		for (const FCorridorData& corridor : layout.corridors)
+		{
+			if (corridor.seperation == ESeperation::VERTICAL) //vertical seperation = horizontal corridor
+			{
+				const int col = corridor.startX / tileSize;
+				const int row = corridor.startY / tileSize;
+				fillClipped(col, row, col + (corridor.endX - corridor.startX) / tileSize + 1, row + 1, ETileType::CORRIDOR);
+			}
+			else //horizontal seperation = vertical corridor
+			{
+				const int col = corridor.startX / tileSize;
+				const int row = corridor.startY / tileSize;
+				fillClipped(col, row - (corridor.startY - corridor.endY) / tileSize, col + 1, row + 1, ETileType::CORRIDOR);
+			}
+		}
+	}
+
+	void ComputeNeighbourMasks(const uint8_t* tiles, int rows, uint8_t* paddedOccupancy, uint8_t* masks)
+	{
+		const int paddedRows = rows + 2;
+
+		//copy the occupancy into a grid with an empty border, so the edges need no bounds checks and rows don't wrap around
+		std::memset(paddedOccupancy, 0, size_t(paddedRows) * paddedRows);
+		for (int row = 0; row < rows; row++)
+		{
+			const uint8_t* rowTiles = tiles + row * rows;
+			uint8_t* occupancy = paddedOccupancy + (row + 1) * paddedRows + 1;
+			for (int col = 0; col < rows; col++)
+			{
+				occupancy[col] = rowTiles[col] != uint8_t(ETileType::EMPTY);
+			}
+		}
+
+		for (int row = 0; row < rows; row++)
+		{
+			const uint8_t* bot = paddedOccupancy + row * paddedRows + 1;
+			const uint8_t* mid = bot + paddedRows;
+			const uint8_t* top = mid + paddedRows;
+			uint8_t* rowMasks = masks + row * rows;
+
+			//branchless, so the compiler can vectorize the row
+			for (int col = 0; col < rows; col++)
+			{
+				rowMasks[col] = GetNeighbourMask(bot, mid, top, col);
+			}
+		}
+	}
+
+	void UpdateNeighbourMasks(const uint8_t* tiles, int rows, const FTileRect& rect, uint8_t* paddedOccupancy, uint8_t* masks)
+	{
+		const int paddedRows = rows + 2;
+		for (int row = std::max(0, rect.minRow); row < std::min(rows, rect.maxRow); row++)
+		{
+			for (int col = std::max(0, rect.minCol); col < std::min(rows, rect.maxCol); col++)
+			{
+				paddedOccupancy[(row + 1) * paddedRows + col + 1] = tiles[row * rows + col] != uint8_t(ETileType::EMPTY);
+			}
+		}
+
+		//a mask changes with its 8 neighbours, so the tiles around the rect are updated as well
+		for (int row = std::max(0, rect.minRow - 1); row < std::min(rows, rect.maxRow + 1); row++)
+		{
+			const uint8_t* bot = paddedOccupancy + row * paddedRows + 1;
+			const uint8_t* mid = bot + paddedRows;
+			const uint8_t* top = mid + paddedRows;
+			uint8_t* rowMasks = masks + row * rows;
+			for (int col = std::max(0, rect.minCol - 1); col < std::min(rows, rect.maxCol + 1); col++)
+			{
+				rowMasks[col] = GetNeighbourMask(bot, mid, top, col);
+			}
+		}
+	}
+
+	FObjectLUT::FObjectLUT()
+	{
+		//side neighbours and diagonal of each corner, in EDungeonObjectAlign corner order
+		const uint8_t cornerSides[4][2] = { { NEIGHBOUR_LEFT, NEIGHBOUR_TOP }, { NEIGHBOUR_RIGHT, NEIGHBOUR_TOP }, { NEIGHBOUR_LEFT, NEIGHBOUR_BOTTOM }, { NEIGHBOUR_RIGHT, NEIGHBOUR_BOTTOM } };
+		const uint8_t cornerDiagonals[4] = { NEIGHBOUR_TOP_LEFT, NEIGHBOUR_TOP_RIGHT, NEIGHBOUR_BOTTOM_LEFT, NEIGHBOUR_BOTTOM_RIGHT };
+
+		for (int mask = 0; mask < 256; mask++)
+		{
+			uint8_t objects = uint8_t(~mask & 0x0F); //a wall on every empty side
+
+			for (int corner = 0; corner < 4; corner++)
+			{
+				const bool hasSideA = (mask & cornerSides[corner][0]) != 0;
+				const bool hasSideB = (mask & cornerSides[corner][1]) != 0;
+				const bool hasDiagonal = (mask & cornerDiagonals[corner]) != 0;
+
+				//outer corner, when the diagonal tile is filled it sees the same corner so only the top corners keep it
+				const bool isOuterCorner = !hasSideA && !hasSideB && (!hasDiagonal || corner < 2);
+				//inner corner, only this tile has both sides filled around the empty diagonal
+				const bool isInnerCorner = hasSideA && hasSideB && !hasDiagonal;
+
+				if (isOuterCorner || isInnerCorner)
+					objects |= 1 << (corner + 4);
+			}
+
+			Objects[mask] = objects;
+		}
+	}
+
+	const FObjectLUT ObjectLUT;
+}
@@ -0,0 +1,457 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonPathGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+
+namespace DungeonCore
+{
+	//fills the offsets of a list per key from (key, value) pairs sorted by key
+	static void BuildOffsets(const std::vector<std::pair<int32_t, int32_t>>& pairs, int numKeys, std::vector<int32_t>& offsets, std::vector<int32_t>& values)
+	{
+		offsets.assign(numKeys + 1, 0);
+		values.resize(pairs.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			offsets[pairs[i].first + 1]++;
+			values[i] = pairs[i].second;
+		}
+		for (int key = 0; key < numKeys; key++)
+		{
+			offsets[key + 1] += offsets[key];
+		}
+	}
+
+	void FPathGraph::Reset()
+	{
+		Rows = 0;
+		RegionIds.clear();
+		Entrances.clear();
+		NodeTiles.clear();
+		NodeRegions.clear();
+		RegionNodeOffsets.assign(1, 0);
+		RegionNodes.clear();
+		RegionLinkOffsets.assign(1, 0);
+		RegionLinks.clear();
+		EdgeOffsets.assign(1, 0);
+		EdgeTargets.clear();
+		EdgeCosts.clear();
+	}
+
+	void FPathGraph::Build(const int32_t* regionIds, int rows, int numRegions)
+	{
+		Reset();
+		Rows = rows;
+		RegionIds.assign(regionIds, regionIds + rows * rows);
+
+		std::vector<int32_t> tileNodes(RegionIds.size(), -1);
+		auto addNode = [this, &tileNodes](int tileIndex)
+		{
+			if (tileNodes[tileIndex] == -1)
+			{
+				tileNodes[tileIndex] = int32_t(NodeTiles.size());
+				NodeTiles.push_back(tileIndex);
+				NodeRegions.push_back(RegionIds[tileIndex]);
+			}
+			return tileNodes[tileIndex];
+		};
+
+		//a straight stretch of touching tiles between the same two regions is one entrance
+		std::vector<std::pair<int32_t, int32_t>> edges;
+		auto scanBorder = [this, rows, &edges, &addNode](int tileStep, int runStep, int lineStep)
+		{
+			for (int line = 0; line < rows - 1; line++)
+			{
+				int runStart = -1;
+				int runLength = 0;
+				for (int i = 0; i <= rows; i++)
+				{
+					const int tileA = line * lineStep + i * runStep;
+					const int regionA = i < rows ? RegionIds[tileA] : -1;
+					const int regionB = i < rows ? RegionIds[tileA + tileStep] : -1;
+					const bool isBorder = regionA != -1 && regionB != -1 && regionA != regionB;
+					if (runLength > 0 && isBorder && regionA == RegionIds[runStart] && regionB == RegionIds[runStart + tileStep])
+					{
+						runLength++;
+						continue;
+					}
+
+					if (runLength > 0)
+					{
+						FEntrance entrance;
+						entrance.tileA = runStart + (runLength / 2) * runStep;
+						entrance.tileB = entrance.tileA + tileStep;
+						entrance.regionA = RegionIds[entrance.tileA];
+						entrance.regionB = RegionIds[entrance.tileB];
+						entrance.firstTileA = runStart;
+						entrance.length = runLength;
+						Entrances.push_back(entrance);
+
+						const int nodeA = addNode(entrance.tileA);
+						const int nodeB = addNode(entrance.tileB);
+						edges.emplace_back(nodeA, nodeB);
+						edges.emplace_back(nodeB, nodeA);
+					}
+					runStart = isBorder ? tileA : -1;
+					runLength = isBorder ? 1 : 0;
+				}
+			}
+		};
+		scanBorder(1, rows, 1); //between a column and the next one, runs go up the column
+		scanBorder(rows, 1, rows); //between a row and the next one, runs go along the row
+
+		//nodes of every region
+		std::vector<std::pair<int32_t, int32_t>> regionNodes;
+		for (int node = 0; node < int(NodeTiles.size()); node++)
+		{
+			regionNodes.emplace_back(NodeRegions[node], node);
+		}
+		std::sort(regionNodes.begin(), regionNodes.end());
+		BuildOffsets(regionNodes, numRegions, RegionNodeOffsets, RegionNodes);
+
+		std::vector<std::pair<int32_t, int32_t>> regionLinks;
+		for (const FEntrance& entrance : Entrances)
+		{
+			regionLinks.emplace_back(entrance.regionA, entrance.regionB);
+			regionLinks.emplace_back(entrance.regionB, entrance.regionA);
+		}
+		std::sort(regionLinks.begin(), regionLinks.end());
+		regionLinks.erase(std::unique(regionLinks.begin(), regionLinks.end()), regionLinks.end());
+		BuildOffsets(regionLinks, numRegions, RegionLinkOffsets, RegionLinks);
+
+		//the nodes of a region are connected by their distance inside the region, searched once per node
+		std::vector<int32_t> edgeCosts(edges.size(), 1);
+		FPathScratch scratch;
+		for (int region = 0; region < numRegions; region++)
+		{
+			for (int i = RegionNodeOffsets[region]; i < RegionNodeOffsets[region + 1]; i++)
+			{
+				const int node = RegionNodes[i];
+				SearchRegion(NodeTiles[node], -1, scratch);
+				for (int j = RegionNodeOffsets[region]; j < RegionNodeOffsets[region + 1]; j++)
+				{
+					const int otherNode = RegionNodes[j];
+					if (otherNode != node && IsVisited(NodeTiles[otherNode], scratch))
+					{
+						edges.emplace_back(node, otherNode);
+						edgeCosts.push_back(scratch.tileDistance[NodeTiles[otherNode]]);
+					}
+				}
+			}
+		}
+
+		std::vector<int32_t> edgeOrder(edges.size());
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			edgeOrder[i] = int32_t(i);
+		}
+		std::stable_sort(edgeOrder.begin(), edgeOrder.end(), [&edges](int32_t a, int32_t b) { return edges[a].first < edges[b].first; });
+		std::vector<std::pair<int32_t, int32_t>> sortedEdges(edges.size());
+		EdgeCosts.resize(edges.size());
+		for (size_t i = 0; i < edgeOrder.size(); i++)
+		{
+			sortedEdges[i] = edges[edgeOrder[i]];
+			EdgeCosts[i] = edgeCosts[edgeOrder[i]];
+		}
+		BuildOffsets(sortedEdges, int(NodeTiles.size()), EdgeOffsets, EdgeTargets);
+	}
+
+	const int32_t* FPathGraph::GetLinkedRegions(int region, int& numLinkedRegions) const
+	{
+		numLinkedRegions = RegionLinkOffsets[region + 1] - RegionLinkOffsets[region];
+		return RegionLinks.data() + RegionLinkOffsets[region];
+	}
+
+	void FPathGraph::SearchRegion(int startTile, int stopTile, FPathScratch& scratch) const
+	{
+		const size_t numTiles = RegionIds.size();
+		if (scratch.tileVisited.size() < numTiles || ++scratch.tileStamp == 0)
+		{
+			//new buffers, or the stamp wrapped around and old stamps could match again
+			scratch.tileVisited.assign(numTiles, 0);
+			scratch.tileParent.resize(numTiles);
+			scratch.tileDistance.resize(numTiles);
+			scratch.tileStamp = 1;
+		}
+
+		const int region = RegionIds[startTile];
+		scratch.queue.clear();
+		scratch.queue.push_back(startTile);
+		scratch.tileVisited[startTile] = scratch.tileStamp;
+		scratch.tileParent[startTile] = -1;
+		scratch.tileDistance[startTile] = 0;
+		for (size_t head = 0; head < scratch.queue.size(); head++)
+		{
+			const int tile = scratch.queue[head];
+			if (tile == stopTile)
+				return;
+
+			const int col = tile % Rows;
+			const int neighbours[4] = { col + 1 < Rows ? tile + 1 : -1, col > 0 ? tile - 1 : -1, tile + Rows < int(numTiles) ? tile + Rows : -1, tile - Rows };
+			for (int neighbour : neighbours)
+			{
+				if (neighbour >= 0 && RegionIds[neighbour] == region && scratch.tileVisited[neighbour] != scratch.tileStamp)
+				{
+					scratch.tileVisited[neighbour] = scratch.tileStamp;
+					scratch.tileParent[neighbour] = tile;
+					scratch.tileDistance[neighbour] = scratch.tileDistance[tile] + 1;
+					scratch.queue.push_back(neighbour);
+				}
+			}
+		}
+	}
+
+	void FPathGraph::AppendRegionPath(int fromTile, int toTile, FPathScratch& scratch, std::vector<int32_t>& path) const
+	{
+		if (fromTile == toTile)
+			return;
+
+		//search back from the target, so the parents lead forward from fromTile
+		SearchRegion(toTile, fromTile, scratch);
+		if (!IsVisited(fromTile, scratch))
+			return;
+
+		for (int tile = scratch.tileParent[fromTile]; tile != -1; tile = scratch.tileParent[tile])
+		{
+			path.push_back(tile);
+		}
+	}
+
+	bool FPathGraph::FindPath(int startTile, int goalTile, FPathScratch& scratch, std::vector<int32_t>& path) const
+	{
+		path.clear();
+		const int numTiles = int(RegionIds.size());
+		if (startTile < 0 || goalTile < 0 || startTile >= numTiles || goalTile >= numTiles)
+			return false;
+
+		const int startRegion = RegionIds[startTile];
+		const int goalRegion = RegionIds[goalTile];
+		if (startRegion == -1 || goalRegion == -1)
+			return false;
+
+		//a room can be cut in two by a room of a child space, then the path leaves the region
+		if (startRegion == goalRegion)
+		{
+			SearchRegion(goalTile, startTile, scratch);
+			if (IsVisited(startTile, scratch))
+			{
+				for (int tile = startTile; tile != -1; tile = scratch.tileParent[tile])
+				{
+					path.push_back(tile);
+				}
+				return true;
+			}
+		}
+
+		//connect the start and the goal to the nodes of their regions
+		const int startNodes = RegionNodeOffsets[startRegion];
+		const int numStartNodes = RegionNodeOffsets[startRegion + 1] - startNodes;
+		const int goalNodes = RegionNodeOffsets[goalRegion];
+		const int numGoalNodes = RegionNodeOffsets[goalRegion + 1] - goalNodes;
+		if (numStartNodes == 0 || numGoalNodes == 0)
+			return false;
+
+		SearchRegion(startTile, -1, scratch);
+		scratch.startCosts.resize(numStartNodes);
+		for (int i = 0; i < numStartNodes; i++)
+		{
+			const int nodeTile = NodeTiles[RegionNodes[startNodes + i]];
+			scratch.startCosts[i] = IsVisited(nodeTile, scratch) ? scratch.tileDistance[nodeTile] : -1;
+		}
+		SearchRegion(goalTile, -1, scratch);
+		scratch.goalCosts.resize(numGoalNodes);
+		for (int i = 0; i < numGoalNodes; i++)
+		{
+			const int nodeTile = NodeTiles[RegionNodes[goalNodes + i]];
+			scratch.goalCosts[i] = IsVisited(nodeTile, scratch) ? scratch.tileDistance[nodeTile] : -1;
+		}
+
+		//A* over the abstract graph, the heuristic is the manhattan distance in tiles
+		const size_t numNodes = NodeTiles.size();
+		if (scratch.nodeVisited.size() < numNodes || ++scratch.nodeStamp == 0)
+		{
+			scratch.nodeVisited.assign(numNodes, 0);
+			scratch.nodeCost.resize(numNodes);
+			scratch.nodeParent.resize(numNodes);
+			scratch.nodeStamp = 1;
+		}
+		const int goalCol = goalTile % Rows;
+		const int goalRow = goalTile / Rows;
+		auto heuristic = [this, goalCol, goalRow](int node)
+		{
+			return std::abs(NodeTiles[node] % Rows - goalCol) + std::abs(NodeTiles[node] / Rows - goalRow);
+		};
+		auto openNode = [&scratch, &heuristic](int node, int cost, int parent)
+		{
+			if (scratch.nodeVisited[node] == scratch.nodeStamp && scratch.nodeCost[node] <= cost)
+				return;
+
+			scratch.nodeVisited[node] = scratch.nodeStamp;
+			scratch.nodeCost[node] = cost;
+			scratch.nodeParent[node] = parent;
+			scratch.open.emplace_back(-(cost + heuristic(node)), node);
+			std::push_heap(scratch.open.begin(), scratch.open.end());
+		};
+
+		scratch.open.clear();
+		for (int i = 0; i < numStartNodes; i++)
+		{
+			if (scratch.startCosts[i] >= 0)
+				openNode(RegionNodes[startNodes + i], scratch.startCosts[i], -1);
+		}
+
+		int bestCost = INT32_MAX;
+		int bestNode = -1;
+		while (!scratch.open.empty())
+		{
+			std::pop_heap(scratch.open.begin(), scratch.open.end());
+			const int estimate = -scratch.open.back().first;
+			const int node = scratch.open.back().second;
+			scratch.open.pop_back();
+			if (estimate >= bestCost)
+				break;
+			if (estimate != scratch.nodeCost[node] + heuristic(node))
+				continue; //opened again with a lower cost
+
+			const int cost = scratch.nodeCost[node];
+			if (NodeRegions[node] == goalRegion)
+			{
+				const int goalCost = scratch.goalCosts[std::lower_bound(RegionNodes.begin() + goalNodes, RegionNodes.begin() + goalNodes + numGoalNodes, node) - (RegionNodes.begin() + goalNodes)];
+				if (goalCost >= 0 && cost + goalCost < bestCost)
+				{
+					bestCost = cost + goalCost;
+					bestNode = node;
+				}
+			}
+			for (int edge = EdgeOffsets[node]; edge < EdgeOffsets[node + 1]; edge++)
+			{
+				openNode(EdgeTargets[edge], cost + EdgeCosts[edge], node);
+			}
+		}
+		if (bestNode == -1)
+			return false;
+
+		scratch.nodePath.clear();
+		for (int node = bestNode; node != -1; node = scratch.nodeParent[node])
+		{
+			scratch.nodePath.push_back(node);
+		}
+
+		//refine the abstract path, the nodes are either in the same region or on both sides of an entrance
+		path.push_back(startTile);
+		int tile = startTile;
+		for (auto node = scratch.nodePath.rbegin(); node != scratch.nodePath.rend(); ++node)
+		{
+			const int nodeTile = NodeTiles[*node];
+			if (RegionIds[nodeTile] == RegionIds[tile])
+				AppendRegionPath(tile, nodeTile, scratch, path);
+			else
+				path.push_back(nodeTile);
+			tile = nodeTile;
+		}
+		AppendRegionPath(tile, goalTile, scratch, path);
+		return true;
+	}
+
+	bool FPathGraph::Raycast(float startX, float startY, float endX, float endY, float& hitFraction) const
+	{
+		int col = int(std::floor(startX));
+		int row = int(std::floor(startY));
+		hitFraction = 0.f;
+		if (!IsWalkable(col, row))
+			return true;
+
+		//grid traversal, t is the fraction of the segment at the next column and row border
+		const float dx = endX - startX;
+		const float dy = endY - startY;
+		const int stepCol = dx > 0.f ? 1 : -1;
+		const int stepRow = dy > 0.f ? 1 : -1;
+		const float deltaX = dx != 0.f ? std::abs(1.f / dx) : INFINITY;
+		const float deltaY = dy != 0.f ? std::abs(1.f / dy) : INFINITY;
+		float nextX = dx > 0.f ? (col + 1 - startX) * deltaX : dx < 0.f ? (startX - col) * deltaX : INFINITY;
+		float nextY = dy > 0.f ? (row + 1 - startY) * deltaY : dy < 0.f ? (startY - row) * deltaY : INFINITY;
+		while (true)
+		{
+			const float t = std::min(nextX, nextY);
+			if (t >= 1.f)
+				break;
+
+			if (std::abs(nextX - nextY) < 1e-5f)
+			{
+				//through a corner, an agent can't squeeze between two diagonal tiles
+				if (!IsWalkable(col + stepCol, row) || !IsWalkable(col, row + stepRow))
+				{
+					hitFraction = t;
+					return true;
+				}
+				col += stepCol;
+				row += stepRow;
+				nextX += deltaX;
+				nextY += deltaY;
+			}
+			else if (nextX < nextY)
+			{
+				col += stepCol;
+				nextX += deltaX;
+			}
+			else
+			{
+				row += stepRow;
+				nextY += deltaY;
+			}
+			if (!IsWalkable(col, row))
+			{
+				hitFraction = t;
+				return true;
+			}
+		}
+		hitFraction = 1.f;
+		return false;
+	}
+
+	bool FPathGraph::IsLineWalkable(int fromTile, int toTile, float clearance) const
+	{
+		const float fromX = fromTile % Rows + 0.5f;
+		const float fromY = fromTile / Rows + 0.5f;
+		const float toX = toTile % Rows + 0.5f;
+		const float toY = toTile / Rows + 0.5f;
+		float hitFraction;
+		if (Raycast(fromX, fromY, toX, toY, hitFraction))
+			return false;
+
+		const float length = std::sqrt((toX - fromX) * (toX - fromX) + (toY - fromY) * (toY - fromY));
+		if (clearance <= 0.f || length == 0.f)
+			return true;
+
+		//the side lines start and end inside the tiles of the center line
+		const float sideX = -(toY - fromY) / length * clearance;
+		const float sideY = (toX - fromX) / length * clearance;
+		return !Raycast(fromX + sideX, fromY + sideY, toX + sideX, toY + sideY, hitFraction)
+			&& !Raycast(fromX - sideX, fromY - sideY, toX - sideX, toY - sideY, hitFraction);
+	}
+
+	void FPathGraph::SmoothPath(std::vector<int32_t>& path, float clearance) const
+	{
+		if (path.size() < 3)
+			return;
+
+		//greedy, every kept tile goes as far along the path as a straight line can
+		size_t numKept = 1;
+		size_t from = 0;
+		while (from + 1 < path.size())
+		{
+			size_t to = from + 1;
+			while (to + 1 < path.size() && IsLineWalkable(path[from], path[to + 1], clearance))
+			{
+				to++;
+			}
+			path[numKept++] = path[to];
+			from = to;
+		}
+		path.resize(numKept);
+	}
+}
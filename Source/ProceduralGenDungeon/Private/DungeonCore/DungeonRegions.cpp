@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonRegions.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace DungeonCore
+{
+	int FillRegionIds(const FSettings& settings, const FLayout& layout, const uint8_t* tiles, int32_t* regionIds)
+	{
+		const int tileSize = settings.tileSize;
+		const int rows = settings.dungeonSize / tileSize;
+		std::fill(regionIds, regionIds + rows * rows, -1);
+
+		//rooms are filled in the same order as the tile grid, so a room inside an other room owns its tiles
+		const int numRooms = int(layout.rooms.size());
+		for (int room = 0; room < numRooms; room++)
+		{
+			const FSpaceData& roomData = layout.rooms[room];
+			const int minCol = std::max(0, roomData.left / tileSize);
+			const int minRow = std::max(0, roomData.bottom / tileSize);
+			const int maxCol = std::min(rows, (roomData.left + roomData.width) / tileSize);
+			const int maxRow = std::min(rows, (roomData.bottom + roomData.height) / tileSize);
+			for (int row = minRow; row < maxRow; row++)
+			{
+				int32_t* rowIds = regionIds + row * rows;
+				std::fill(rowIds + minCol, rowIds + std::max(minCol, maxCol), int32_t(room));
+			}
+		}
+
+		//flood the corridor tiles, every connected group is one region
+		int numRegions = numRooms;
+		std::vector<int> stack;
+		for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+		{
+			if (tiles[tileIndex] != uint8_t(ETileType::CORRIDOR) || regionIds[tileIndex] != -1)
+				continue;
+
+			const int32_t region = numRegions++;
+			regionIds[tileIndex] = region;
+			stack.push_back(tileIndex);
+			while (!stack.empty())
+			{
+				const int tile = stack.back();
+				stack.pop_back();
+				const int col = tile % rows;
+				const int neighbours[4] = { col + 1 < rows ? tile + 1 : -1, col > 0 ? tile - 1 : -1, tile + rows < rows * rows ? tile + rows : -1, tile - rows };
+				for (int neighbour : neighbours)
+				{
+					if (neighbour >= 0 && tiles[neighbour] == uint8_t(ETileType::CORRIDOR) && regionIds[neighbour] == -1)
+					{
+						regionIds[neighbour] = region;
+						stack.push_back(neighbour);
+					}
+				}
+			}
+		}
+		return numRegions;
+	}
+}
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonTorches.h"
+#include "DungeonCore/DungeonGenerator.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace DungeonCore
+{
+	void PlaceTorches(const uint8_t* tiles, const uint8_t* masks, int rows, int spacing, std::vector<FTorch>& torches)
+	{
+		torches.clear();
+		spacing = std::max(1, spacing);
+		auto hasWall = [tiles, masks, rows](int col, int row, int side)
+		{
+			if (col < 0 || row < 0 || col >= rows || row >= rows)
+				return false;
+			const int tileIndex = col + rows * row;
+			return tiles[tileIndex] == uint8_t(ETileType::ROOM) && (ObjectLUT.Objects[masks[tileIndex]] & (1 << side)) != 0;
+		};
+
+		//the LEFT and RIGHT walls (+x and -x) run along a column, the TOP and BOTTOM walls (+y and -y) along a row
+		for (int side = 0; side < 4; side++)
+		{
+			const bool isAlongColumn = side < 2;
+			const int stepCol = isAlongColumn ? 0 : 1;
+			const int stepRow = isAlongColumn ? 1 : 0;
+			for (int row = 0; row < rows; row++)
+			{
+				for (int col = 0; col < rows; col++)
+				{
+					//a run of the wall starts at a tile without the same wall before it
+					if (!hasWall(col, row, side) || hasWall(col - stepCol, row - stepRow, side))
+						continue;
+
+					int length = 1;
+					while (hasWall(col + length * stepCol, row + length * stepRow, side))
+					{
+						length++;
+					}
+
+					const int numTorches = std::max(1, length / spacing);
+					for (int i = 0; i < numTorches; i++)
+					{
+						const int offset = (2 * i + 1) * length / (2 * numTorches);
+						FTorch torch;
+						torch.tile = (col + offset * stepCol) + rows * (row + offset * stepRow);
+						torch.side = uint8_t(side);
+						torches.push_back(torch);
+					}
+				}
+			}
+		}
+	}
+
+	void SelectLowestCosts(const std::vector<float>& costs, int numSelected, std::vector<int32_t>& selected)
+	{
+		selected.resize(costs.size());
+		std::iota(selected.begin(), selected.end(), 0);
+		if (numSelected >= int(costs.size()))
+			return;
+
+		numSelected = std::max(0, numSelected);
+		std::nth_element(selected.begin(), selected.begin() + numSelected, selected.end(),
+			[&costs](int32_t a, int32_t b) { return costs[a] < costs[b] || (costs[a] == costs[b] && a < b); });
+		selected.resize(numSelected);
+	}
+}
@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonCore/DungeonVisibility.h"
+#include "DungeonCore/DungeonPathGraph.h"
+
+#include <cmath>
+
+namespace DungeonCore
+{
+	//Appends the regions of the tiles a ray passes, from (x, y) in tiles until it leaves the grid or hits an empty tile
+	static void TraceRegions(const FPathGraph& graph, float x, float y, float dirX, float dirY, std::vector<int32_t>& regions)
+	{
+		const int rows = graph.GetRows();
+		int col = int(std::floor(x));
+		int row = int(std::floor(y));
+		const int stepCol = dirX > 0.f ? 1 : -1;
+		const int stepRow = dirY > 0.f ? 1 : -1;
+		//distance along the ray to the next column and row border, and between two borders
+		const float deltaX = dirX != 0.f ? std::abs(1.f / dirX) : INFINITY;
+		const float deltaY = dirY != 0.f ? std::abs(1.f / dirY) : INFINITY;
+		float nextX = dirX != 0.f ? (stepCol > 0 ? col + 1 - x : x - col) * deltaX : INFINITY;
+		float nextY = dirY != 0.f ? (stepRow > 0 ? row + 1 - y : y - row) * deltaY : INFINITY;
+
+		while (col >= 0 && row >= 0 && col < rows && row < rows)
+		{
+			const int region = graph.GetRegion(col + rows * row);
+			if (region == -1)
+				return;
+			if (regions.empty() || regions.back() != region)
+				regions.push_back(region);
+
+			if (nextX < nextY)
+			{
+				col += stepCol;
+				nextX += deltaX;
+			}
+			else
+			{
+				row += stepRow;
+				nextY += deltaY;
+			}
+		}
+	}
+
+	void FRegionVisibility::Reset()
+	{
+		NumRegions = 0;
+		WordsPerRegion = 0;
+		Bits.clear();
+	}
+
+	void FRegionVisibility::SetVisible(int regionA, int regionB)
+	{
+		Bits[size_t(regionA) * WordsPerRegion + regionB / 64] |= uint64_t(1) << (regionB % 64);
+		Bits[size_t(regionB) * WordsPerRegion + regionA / 64] |= uint64_t(1) << (regionA % 64);
+	}
+
+	void FRegionVisibility::Build(const FPathGraph& graph, int numRayAngles)
+	{
+		NumRegions = graph.GetNumRegions();
+		WordsPerRegion = (NumRegions + 63) / 64;
+		Bits.assign(size_t(NumRegions) * WordsPerRegion, 0);
+		for (int region = 0; region < NumRegions; region++)
+		{
+			SetVisible(region, region);
+		}
+
+		//the directions are offset by half a step, so no line runs along a portal
+		const float pi = 3.14159265f;
+		std::vector<float> dirX(numRayAngles);
+		std::vector<float> dirY(numRayAngles);
+		for (int angle = 0; angle < numRayAngles; angle++)
+		{
+			const float theta = (angle + 0.5f) * pi / numRayAngles;
+			dirX[angle] = std::cos(theta);
+			dirY[angle] = std::sin(theta);
+		}
+
+		const int rows = graph.GetRows();
+		std::vector<int32_t> backRegions;
+		std::vector<int32_t> lineRegions;
+		for (const FEntrance& entrance : graph.GetEntrances())
+		{
+			//the portal is the border line between the A and B tiles, sampled every half tile
+			const bool isColumnBorder = entrance.tileB - entrance.tileA == 1;
+			const float borderX = float(entrance.firstTileA % rows + (isColumnBorder ? 1 : 0));
+			const float borderY = float(entrance.firstTileA / rows + (isColumnBorder ? 0 : 1));
+			for (int sample = 0; sample < 2 * entrance.length; sample++)
+			{
+				const float offset = (sample + 0.5f) * 0.5f;
+				const float x = isColumnBorder ? borderX : borderX + offset;
+				const float y = isColumnBorder ? borderY + offset : borderY;
+				for (int angle = 0; angle < numRayAngles; angle++)
+				{
+					//both halves of the line, started a little away from the border so they begin in the tiles on their side
+					const float nudge = 1e-3f;
+					backRegions.clear();
+					TraceRegions(graph, x - dirX[angle] * nudge, y - dirY[angle] * nudge, -dirX[angle], -dirY[angle], backRegions);
+					lineRegions.assign(backRegions.rbegin(), backRegions.rend());
+					TraceRegions(graph, x + dirX[angle] * nudge, y + dirY[angle] * nudge, dirX[angle], dirY[angle], lineRegions);
+
+					for (size_t i = 0; i < lineRegions.size(); i++)
+					{
+						for (size_t j = i + 1; j < lineRegions.size(); j++)
+						{
+							SetVisible(lineRegions[i], lineRegions[j]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int FRegionVisibility::GetNumVisible(int region) const
+	{
+		int numVisible = 0;
+		for (int word = 0; word < WordsPerRegion; word++)
+		{
+			uint64_t bits = Bits[size_t(region) * WordsPerRegion + word];
+			for (; bits != 0; bits &= bits - 1)
+			{
+				numVisible++;
+			}
+		}
+		return numVisible;
+	}
+}
@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonLayoutSerializer.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/BufferReader.h"
+#include "Serialization/MemoryWriter.h"
+
+static void SerializeSeperation(FArchive& ar, ESeperation& seperation)
+{
+	uint8 value = uint8(seperation);
+	ar << value;
+	seperation = ESeperation(value);
+}
+
+static void SerializeRoom(FArchive& ar, FData& room)
+{
+	ar << room.key << room.width << room.height << room.left << room.bottom;
+	SerializeSeperation(ar, room.seperation);
+	ar << room.tilesSeperated;
+}
+
+static void SerializeCorridor(FArchive& ar, FCorridor& corridor)
+{
+	ar << corridor.start << corridor.end;
+	SerializeSeperation(ar, corridor.seperation);
+	ar << corridor.key;
+}
+
+bool FDungeonLayoutSerializer::SaveLayout(const FString& filePath, const FDungeonLayout& layout)
+{
+	TArray<uint8> bytes;
+	FMemoryWriter writer(bytes);
+	Serialize(writer, const_cast<FDungeonLayout&>(layout));
+	return !writer.IsError() && FFileHelper::SaveArrayToFile(bytes, *filePath);
+}
+
+bool FDungeonLayoutSerializer::LoadLayout(const FString& filePath, FDungeonLayout& layout)
+{
+	//large layouts are read straight from the mapped pages instead of being copied into a buffer first
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IMappedFileHandle> mappedFile(platformFile.OpenMapped(*filePath));
+	if (mappedFile.IsValid() && mappedFile->GetFileSize() > 0)
+	{
+		TUniquePtr<IMappedFileRegion> region(mappedFile->MapRegion(0, mappedFile->GetFileSize()));
+		if (region.IsValid())
+			return LoadFromMemory(region->GetMappedPtr(), region->GetMappedSize(), layout);
+	}
+
+	TArray<uint8> bytes;
+	if (!FFileHelper::LoadFileToArray(bytes, *filePath, FILEREAD_Silent))
+		return false;
+	return LoadFromMemory(bytes.GetData(), bytes.Num(), layout);
+}
+
+bool FDungeonLayoutSerializer::LoadFromMemory(const uint8* data, int64 size, FDungeonLayout& layout)
+{
+	//Serialize checks the sizes and the tile count before it allocates the tiles
+	FBufferReader reader(const_cast<uint8*>(data), size, false);
+	Serialize(reader, layout);
+	return !reader.IsError();
+}
+
+void FDungeonLayoutSerializer::Serialize(FArchive& ar, FDungeonLayout& layout)
+{
+	uint32 magic = Magic;
+	uint32 version = Version;
+	ar << magic << version;
+	if (magic != Magic || version != Version)
+	{
+		ar.SetError();
+		return;
+	}
+
+	ar << layout.DungeonSize << layout.TileSize << layout.SplitIterations << layout.MinTilesPerRoom << layout.MinRoomRatio << layout.Seed;
+	const int32 numGridTiles = DungeonCore::GetNumGridTiles(layout.DungeonSize, layout.TileSize);
+	if (ar.IsLoading() && numGridTiles < 0)
+	{
+		ar.SetError();
+		return;
+	}
+
+	int32 numRooms = layout.Rooms.Num();
+	ar << numRooms;
+	if (ar.IsLoading())
+	{
+		if (numRooms < 0 || numRooms > ar.TotalSize())
+		{
+			ar.SetError();
+			return;
+		}
+		layout.Rooms.SetNum(numRooms);
+	}
+	for (FData& room : layout.Rooms)
+	{
+		SerializeRoom(ar, room);
+	}
+
+	int32 numCorridors = layout.Corridors.Num();
+	ar << numCorridors;
+	if (ar.IsLoading())
+	{
+		if (numCorridors < 0 || numCorridors > ar.TotalSize())
+		{
+			ar.SetError();
+			return;
+		}
+		layout.Corridors.SetNum(numCorridors);
+	}
+	for (FCorridor& corridor : layout.Corridors)
+	{
+		SerializeCorridor(ar, corridor);
+	}
+
+	SerializeTiles(ar, layout.Tiles, numGridTiles);
+}
+
+void FDungeonLayoutSerializer::SerializeTiles(FArchive& ar, TArray<uint8>& tiles, int32 numGridTiles)
+{
+	//runs of (tile, packed length), most of the grid is long runs of empty tiles
+	int32 numTiles = tiles.Num();
+	ar << numTiles;
+	if (ar.IsLoading())
+	{
+		//the count comes from the file, only the count of the grid the sizes describe is allocated
+		if (numTiles != numGridTiles)
+		{
+			ar.SetError();
+			return;
+		}
+		tiles.SetNumUninitialized(numTiles);
+		int32 tileIndex = 0;
+		while (tileIndex < numTiles && !ar.IsError())
+		{
+			uint8 tile;
+			uint32 runLength;
+			ar << tile;
+			ar.SerializeIntPacked(runLength);
+			if (runLength == 0 || runLength > uint32(numTiles - tileIndex) || !DungeonCore::IsValidTileType(tile))
+			{
+				ar.SetError();
+				return;
+			}
+			FMemory::Memset(tiles.GetData() + tileIndex, tile, runLength);
+			tileIndex += runLength;
+		}
+		return;
+	}
+
+	int32 runStart = 0;
+	while (runStart < numTiles)
+	{
+		int32 runEnd = runStart + 1;
+		while (runEnd < numTiles && tiles[runEnd] == tiles[runStart])
+		{
+			runEnd++;
+		}
+		uint8 tile = tiles[runStart];
+		uint32 runLength = runEnd - runStart;
+		ar << tile;
+		ar.SerializeIntPacked(runLength);
+		runStart = runEnd;
+	}
+}
@@ -0,0 +1,321 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonNavigationData.h"
+#include "DungeonSpace.h"
+#include "DungeonWorldSubsystem.h"
+#include "NavigationPath.h"
+
+//tries of the random point queries before they give up, a try picks a location and fails when its tile is empty
+static const int NumRandomPointTries = 64;
+
+//the path queries run on the game thread and on the async pathfinding thread, every thread searches with its own buffers
+static thread_local DungeonCore::FPathScratch NavigationPathScratch;
+static thread_local std::vector<int32_t> NavigationPathTiles;
+
+//a walkable tile of a dungeon inside a circle, INDEX_NONE when no try finds one
+static int FindRandomWalkableTile(const FDungeonNavSnapshot& dungeon, const FVector& origin, float radius)
+{
+	for (int i = 0; i < NumRandomPointTries; i++)
+	{
+		const FVector2D offset = FMath::RandPointInCircle(radius);
+		const int tileIndex = dungeon.GetTileIndexAtLocation(origin + FVector(offset, 0.f));
+		if (tileIndex != INDEX_NONE && dungeon.GetTileTypeAt(tileIndex) != ETileType::EMPTY)
+			return tileIndex;
+	}
+	return INDEX_NONE;
+}
+
+ADungeonNavigationData::ADungeonNavigationData(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		FindPathImplementation = FindPath;
+		FindHierarchicalPathImplementation = FindPath;
+		TestPathImplementation = TestPath;
+		TestHierarchicalPathImplementation = TestPath;
+		RaycastImplementation = Raycast;
+	}
+}
+
+void ADungeonNavigationData::InvalidateActivePaths()
+{
+	//an invalidated path that updates on its own asks for a repath, it is searched again on the next tick
+	FScopeLock pathLock(&ActivePathsLock);
+	for (const FNavPathWeakPtr& activePath : ActivePaths)
+	{
+		const FNavPathSharedPtr path = activePath.Pin();
+		if (path.IsValid())
+			path->Invalidate();
+	}
+}
+
+FBox ADungeonNavigationData::GetBounds() const
+{
+	FBox bounds(ForceInit);
+	const UDungeonWorldSubsystem* subsystem = GetDungeonSubsystem();
+	if (subsystem == nullptr)
+		return bounds;
+
+	TArray<FDungeonNavSnapshotPtr> snapshots;
+	subsystem->GetNavSnapshots(snapshots);
+	for (const FDungeonNavSnapshotPtr& dungeon : snapshots)
+	{
+		bounds += dungeon->GetTileGridBounds();
+	}
+	return bounds;
+}
+
+FNavLocation ADungeonNavigationData::GetRandomPoint(FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	const UDungeonWorldSubsystem* subsystem = GetDungeonSubsystem();
+	if (subsystem == nullptr)
+		return FNavLocation();
+
+	TArray<FDungeonNavSnapshotPtr> snapshots;
+	subsystem->GetNavSnapshots(snapshots);
+	for (const FDungeonNavSnapshotPtr& dungeon : snapshots)
+	{
+		//the circle around the grid covers all of its tiles
+		const FBox bounds = dungeon->GetTileGridBounds();
+		const int tileIndex = FindRandomWalkableTile(*dungeon, bounds.GetCenter(), bounds.GetExtent().Size2D());
+		if (tileIndex != INDEX_NONE)
+			return FNavLocation(dungeon->GetTileLocation(tileIndex), tileIndex);
+	}
+	return FNavLocation();
+}
+
+bool ADungeonNavigationData::GetRandomReachablePointInRadius(const FVector& Origin, float Radius, FNavLocation& OutResult, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	int originTile;
+	const FDungeonNavSnapshotPtr dungeon = FindTileAtLocation(Origin, originTile);
+	if (!dungeon.IsValid())
+		return false;
+
+	originTile = dungeon->FindNearestWalkableTile(originTile, 1);
+	for (int i = 0; i < NumRandomPointTries && originTile != INDEX_NONE; i++)
+	{
+		//rooms in the circle may only be connected through the rest of the dungeon, any path counts
+		const int tileIndex = FindRandomWalkableTile(*dungeon, Origin, Radius);
+		if (tileIndex != INDEX_NONE && dungeon->PathGraph.FindPath(originTile, tileIndex, NavigationPathScratch, NavigationPathTiles))
+		{
+			OutResult = FNavLocation(dungeon->GetTileLocation(tileIndex), tileIndex);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ADungeonNavigationData::GetRandomPointInNavigableRadius(const FVector& Origin, float Radius, FNavLocation& OutResult, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	int originTile;
+	const FDungeonNavSnapshotPtr dungeon = FindTileAtLocation(Origin, originTile);
+	const int tileIndex = dungeon.IsValid() ? FindRandomWalkableTile(*dungeon, Origin, Radius) : INDEX_NONE;
+	if (tileIndex == INDEX_NONE)
+		return false;
+
+	OutResult = FNavLocation(dungeon->GetTileLocation(tileIndex), tileIndex);
+	return true;
+}
+
+bool ADungeonNavigationData::ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	int tileIndex;
+	const FDungeonNavSnapshotPtr dungeon = FindTileAtLocation(Point, tileIndex);
+	if (!dungeon.IsValid())
+		return false;
+
+	//a point over an empty tile snaps to the center of a walkable tile in the extent
+	const int maxTiles = FMath::CeilToInt(FMath::Max(Extent.X, Extent.Y) / dungeon->TileSize);
+	const int walkableTile = dungeon->FindNearestWalkableTile(tileIndex, maxTiles);
+	if (walkableTile == INDEX_NONE)
+		return false;
+
+	const FVector tileLocation = dungeon->GetTileLocation(walkableTile);
+	if (FMath::Abs(Point.Z - tileLocation.Z) > Extent.Z)
+		return false;
+
+	OutLocation = FNavLocation(walkableTile == tileIndex ? FVector(Point.X, Point.Y, tileLocation.Z) : tileLocation, walkableTile);
+	return true;
+}
+
+void ADungeonNavigationData::BatchProjectPoints(TArray<FNavigationProjectionWork>& Workload, const FVector& Extent, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	for (FNavigationProjectionWork& work : Workload)
+	{
+		work.bResult = ProjectPoint(work.Point, work.OutLocation, Extent, Filter, Querier);
+	}
+}
+
+void ADungeonNavigationData::BatchProjectPoints(TArray<FNavigationProjectionWork>& Workload, FSharedConstNavQueryFilter Filter, const UObject* Querier) const
+{
+	for (FNavigationProjectionWork& work : Workload)
+	{
+		const FVector extent = work.ProjectionLimit.IsValid ? work.ProjectionLimit.GetExtent() : GetConfig().DefaultQueryExtent;
+		work.bResult = ProjectPoint(work.Point, work.OutLocation, extent, Filter, Querier);
+	}
+}
+
+void ADungeonNavigationData::BatchRaycast(TArray<FNavigationRaycastWork>& Workload, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	for (FNavigationRaycastWork& work : Workload)
+	{
+		FVector hitLocation;
+		work.bDidHit = Raycast(this, work.RayStart, work.RayEnd, hitLocation, QueryFilter, Querier);
+		work.HitLocation = FNavLocation(hitLocation);
+	}
+}
+
+ENavigationQueryResult::Type ADungeonNavigationData::CalcPathCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	float pathLength;
+	return CalcPathLengthAndCost(PathStart, PathEnd, pathLength, OutPathCost, QueryFilter, Querier);
+}
+
+ENavigationQueryResult::Type ADungeonNavigationData::CalcPathLength(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	float pathCost;
+	return CalcPathLengthAndCost(PathStart, PathEnd, OutPathLength, pathCost, QueryFilter, Querier);
+}
+
+ENavigationQueryResult::Type ADungeonNavigationData::CalcPathLengthAndCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier) const
+{
+	TArray<FVector> pathLocations;
+	if (!FindLocationPath(PathStart, PathEnd, 0.f, pathLocations))
+		return ENavigationQueryResult::Fail;
+
+	//every tile costs the same, so the cost is the length
+	OutPathLength = 0.f;
+	for (int i = 1; i < pathLocations.Num(); i++)
+	{
+		OutPathLength += FVector::Dist(pathLocations[i - 1], pathLocations[i]);
+	}
+	OutPathCost = OutPathLength;
+	return ENavigationQueryResult::Success;
+}
+
+bool ADungeonNavigationData::DoesNodeContainLocation(NavNodeRef NodeRef, const FVector& WorldSpaceLocation) const
+{
+	int tileIndex;
+	return FindTileAtLocation(WorldSpaceLocation, tileIndex).IsValid() && NavNodeRef(tileIndex) == NodeRef;
+}
+
+FPathFindingResult ADungeonNavigationData::FindPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query)
+{
+	const ADungeonNavigationData* navData = Cast<const ADungeonNavigationData>(Query.NavData.Get());
+	if (navData == nullptr)
+		return FPathFindingResult(ENavigationQueryResult::Error);
+
+	FPathFindingResult result(ENavigationQueryResult::Error);
+	if (Query.PathInstanceToFill.IsValid())
+	{
+		result.Path = Query.PathInstanceToFill;
+		result.Path->ResetForRepath();
+	}
+	else
+	{
+		result.Path = navData->CreatePathInstance<FNavigationPath>(Query);
+	}
+
+	TArray<FVector> pathLocations;
+	if (!navData->FindLocationPath(Query.StartLocation, Query.EndLocation, AgentProperties.AgentRadius, pathLocations))
+	{
+		result.Result = ENavigationQueryResult::Fail;
+		return result;
+	}
+
+	TArray<FNavPathPoint>& pathPoints = result.Path->GetPathPoints();
+	pathPoints.Reserve(pathLocations.Num());
+	for (const FVector& location : pathLocations)
+	{
+		pathPoints.Add(FNavPathPoint(location));
+	}
+	result.Path->MarkReady();
+	result.Result = ENavigationQueryResult::Success;
+	return result;
+}
+
+bool ADungeonNavigationData::TestPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query, int32* NumVisitedNodes)
+{
+	//the ends are snapped like the ones of FindPath, so both queries agree
+	const ADungeonNavigationData* navData = Cast<const ADungeonNavigationData>(Query.NavData.Get());
+	bool isStartSnapped, isGoalSnapped;
+	const bool isFound = navData != nullptr && navData->FindTilePath(Query.StartLocation, Query.EndLocation, isStartSnapped, isGoalSnapped).IsValid();
+	if (NumVisitedNodes != nullptr)
+		*NumVisitedNodes = isFound ? int32(NavigationPathTiles.size()) : 0;
+	return isFound;
+}
+
+bool ADungeonNavigationData::Raycast(const ANavigationData* NavDataInstance, const FVector& RayStart, const FVector& RayEnd, FVector& HitLocation, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier)
+{
+	const ADungeonNavigationData* navData = Cast<const ADungeonNavigationData>(NavDataInstance);
+	int startTile;
+	const FDungeonNavSnapshotPtr dungeon = navData != nullptr ? navData->FindTileAtLocation(RayStart, startTile) : FDungeonNavSnapshotPtr();
+	if (!dungeon.IsValid())
+	{
+		HitLocation = RayStart;
+		return true;
+	}
+	return dungeon->RaycastTiles(RayStart, RayEnd, HitLocation);
+}
+
+const UDungeonWorldSubsystem* ADungeonNavigationData::GetDungeonSubsystem() const
+{
+	const UWorld* world = GetWorld();
+	return world != nullptr ? world->GetSubsystem<UDungeonWorldSubsystem>() : nullptr;
+}
+
+FDungeonNavSnapshotPtr ADungeonNavigationData::FindTileAtLocation(const FVector& worldLocation, int& tileIndex) const
+{
+	const UDungeonWorldSubsystem* subsystem = GetDungeonSubsystem();
+	if (subsystem == nullptr)
+	{
+		tileIndex = INDEX_NONE;
+		return nullptr;
+	}
+	return subsystem->FindNavSnapshotAtLocation(worldLocation, tileIndex);
+}
+
+FDungeonNavSnapshotPtr ADungeonNavigationData::FindTilePath(const FVector& startLocation, const FVector& goalLocation, bool& isStartSnapped, bool& isGoalSnapped) const
+{
+	int locationStartTile;
+	const FDungeonNavSnapshotPtr dungeon = FindTileAtLocation(startLocation, locationStartTile);
+	if (!dungeon.IsValid())
+		return nullptr;
+
+	//an agent pressed against a wall may stand over the empty tile behind it
+	const int locationGoalTile = dungeon->GetTileIndexAtLocation(goalLocation);
+	const int startTile = dungeon->FindNearestWalkableTile(locationStartTile, 1);
+	const int goalTile = locationGoalTile != INDEX_NONE ? dungeon->FindNearestWalkableTile(locationGoalTile, 1) : INDEX_NONE;
+	if (startTile == INDEX_NONE || goalTile == INDEX_NONE || !dungeon->PathGraph.FindPath(startTile, goalTile, NavigationPathScratch, NavigationPathTiles))
+		return nullptr;
+
+	isStartSnapped = startTile != locationStartTile;
+	isGoalSnapped = goalTile != locationGoalTile;
+	return dungeon;
+}
+
+bool ADungeonNavigationData::FindLocationPath(const FVector& startLocation, const FVector& goalLocation, float agentRadius, TArray<FVector>& pathLocations) const
+{
+	bool isStartSnapped, isGoalSnapped;
+	const FDungeonNavSnapshotPtr dungeon = FindTilePath(startLocation, goalLocation, isStartSnapped, isGoalSnapped);
+	if (!dungeon.IsValid())
+		return false;
+
+	//the lines between the kept tiles stay on walkable tiles with the radius of the agent to their sides
+	const float clearance = FMath::Clamp(agentRadius / dungeon->TileSize, 0.f, 0.45f);
+	dungeon->PathGraph.SmoothPath(NavigationPathTiles, clearance);
+
+	pathLocations.Reset(int(NavigationPathTiles.size()) + 1);
+	//an end that was snapped to another tile starts at the center of that tile, the line from the empty tile would cross the wall
+	const FVector startTileLocation = dungeon->GetTileLocation(NavigationPathTiles.front());
+	const FVector goalTileLocation = dungeon->GetTileLocation(NavigationPathTiles.back());
+	pathLocations.Add(isStartSnapped ? startTileLocation : FVector(startLocation.X, startLocation.Y, startTileLocation.Z));
+	for (size_t i = 1; i + 1 < NavigationPathTiles.size(); i++)
+	{
+		pathLocations.Add(dungeon->GetTileLocation(NavigationPathTiles[i]));
+	}
+	pathLocations.Add(isGoalSnapped ? goalTileLocation : FVector(goalLocation.X, goalLocation.Y, goalTileLocation.Z));
+	return true;
+}
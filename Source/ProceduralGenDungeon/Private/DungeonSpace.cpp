@@ -2,7 +2,52 @@
 
 
 #include "DungeonSpace.h"
+#include "DungeonWorldSubsystem.h"
+#include "DungeonNavigationData.h"
+#include "DungeonCore/DungeonRegions.h"
+#include "DungeonLayoutSerializer.h"
+#include "DungeonCollisionComponent.h"
+#include "DungeonStats.h"
 #include "DrawDebugHelpers.h"
+#include "EngineUtils.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Engine/Texture2D.h"
+#include "Kismet/GameplayStatics.h"
+
+UE_TRACE_CHANNEL_DEFINE(DungeonChannel);
+
+//milliseconds since phaseStart, phaseStart is moved to now so the next phase is timed from here
+static double GetPhaseMs(double& phaseStart)
+{
+	const double now = FPlatformTime::Seconds();
+	const double phaseMs = (now - phaseStart) * 1000.0;
+	phaseStart = now;
+	return phaseMs;
+}
+
+//Objects derived from the walls and pillars of a tile, indexed by EDungeonObjectAlign
+static const FDungeonObject WallObjects[] =
+{
+	FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::LEFT, FVector(1, 0, 0)),
+	FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::RIGHT, FVector(1, 0, 0)),
+	FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::TOP, FVector(0, -1, 0)),
+	FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::BOTTOM, FVector(0, -1, 0)),
+};
+static const FDungeonObject PillarObjects[] =
+{
+	FDungeonObject(EDungeonObjectType::PILLAR, EDungeonObjectAlign::TOP_LEFT, FVector(1, 0, 0)),
+	FDungeonObject(EDungeonObjectType::PILLAR, EDungeonObjectAlign::TOP_RIGHT, FVector(1, 0, 0)),
+	FDungeonObject(EDungeonObjectType::PILLAR, EDungeonObjectAlign::BOTTOM_LEFT, FVector(1, 0, 0)),
+	FDungeonObject(EDungeonObjectType::PILLAR, EDungeonObjectAlign::BOTTOM_RIGHT, FVector(1, 0, 0)),
+};
+//Direction from a wall into its tile, a torch faces it. Indexed by the EDungeonObjectAlign of the wall
+static const FVector TorchDirections[] = { FVector(-1, 0, 0), FVector(1, 0, 0), FVector(0, -1, 0), FVector(0, 1, 0) };
 
 // Sets default values
 ADungeonSpace::ADungeonSpace()
@@ -10,14 +55,26 @@ ADungeonSpace::ADungeonSpace()
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
-	TileRows = DungeonSize / TileSize;
-	TileArray.Init(FTile(), TileRows * TileRows);
-	RootSpace = nullptr;
+	Grid = MakeUnique<FDungeonGrid>();
+	PendingGrid = MakeUnique<FDungeonGrid>();
+	MinimapTexture = nullptr;
+	MinimapMaterial = nullptr;
+	MinimapPlayerTile = INDEX_NONE;
+	IsDungeonGenerated = false;
+	CancelGeneration = false;
+	IsGenerationRunning = false;
+	IsGenerationPending = false;
+	ConstructionTileCursor = 0;
+	ConstructionMsPerInstance = 0.002f;
+	IsConstructing = false;
+	VisibleFromRegion = INDEX_NONE;
+	TorchLightsTile = INDEX_NONE;
+	TorchLightsRegion = INDEX_NONE;
 
 	CubeISMC = CreateDefaultSubobject<class UInstancedStaticMeshComponent>(TEXT("Cube InstancedStaticMesh"));
 	CubeISMC->SetMobility(EComponentMobility::Static);
 	CubeISMC->SetCollisionProfileName("NoCollision");
-	CubeISMC->NumCustomDataFloats = TileRows * TileRows;
+	CubeISMC->NumCustomDataFloats = 1;
 
 	FloorTileISMC = CreateDefaultSubobject<class UInstancedStaticMeshComponent>(TEXT("Floor InstancedStaticMesh"));
 	FloorTileISMC->SetMobility(EComponentMobility::Static);
@@ -27,6 +84,24 @@ ADungeonSpace::ADungeonSpace()
 	WallTileISMC->SetMobility(EComponentMobility::Static);
 	WallTileISMC->SetCollisionProfileName("BlockAll");
 
+	PillarTileISMC = CreateDefaultSubobject<class UInstancedStaticMeshComponent>(TEXT("Pillar InstancedStaticMesh"));
+	PillarTileISMC->SetMobility(EComponentMobility::Static);
+	PillarTileISMC->SetCollisionProfileName("BlockAll");
+
+	TorchISMC = CreateDefaultSubobject<class UInstancedStaticMeshComponent>(TEXT("Torch InstancedStaticMesh"));
+	TorchISMC->SetMobility(EComponentMobility::Static);
+	TorchISMC->SetCollisionProfileName("NoCollision");
+	TorchISMC->NumCustomDataFloats = 1;
+
+	MinimapPlane = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Minimap Plane"));
+	MinimapPlane->SetupAttachment(CubeISMC);
+	MinimapPlane->SetCollisionProfileName("NoCollision");
+	MinimapPlane->SetCanEverAffectNavigation(false);
+	MinimapPlane->SetVisibility(false);
+
+	CollisionComponent = CreateDefaultSubobject<UDungeonCollisionComponent>(TEXT("Merged Collision"));
+	CollisionComponent->SetMobility(EComponentMobility::Static);
+
 
 
 
@@ -35,10 +110,26 @@ ADungeonSpace::ADungeonSpace()
 
 void ADungeonSpace::GenerateMinimap(FTransform& playerTransform)
 {
+	DUNGEON_SCOPE_PHASE(GenerateMinimap);
 	if (GEngine)
 	{
 		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Emerald, TEXT("Generating minimap..."));
 	}
+
+	if (MinimapMode == EMinimapMode::TEXTURE)
+	{
+		//there is no texture to size before the first grid is done
+		if (!HasTileGrid())
+			return;
+
+		//the texture is kept up to date while the player moves, only the fog of war is reset
+		ResetMinimapTexture();
+		ShowMinimapPlane(playerTransform);
+		UpdateMinimapPlayer(playerTransform.GetLocation());
+		return;
+	}
+	MinimapPlane->SetVisibility(false);
+
 	float minDistanceFromPlayer = 10.f;
 	FVector minimapPos = playerTransform.GetLocation() + playerTransform.GetRotation().Vector() * minDistanceFromPlayer;
 	FVector FromActorToMinimapPos = minimapPos - GetActorLocation();
@@ -50,24 +141,28 @@ void ADungeonSpace::GenerateMinimap(FTransform& playerTransform)
 	FTransform minimapTileTransform = GetTransform();
 	minimapTileTransform.SetScale3D(FVector(float(MinimapTileSize) / CubeMeshSize, float(MinimapTileSize) / CubeMeshSize, float(MinimapTileSize) / CubeMeshSize));
 	int tileIndex = -1;
-	int rows = TileRows;
+	int rows = Grid->TileRows;
 	int newInstanceIndex{};
 
+	int tilePlayerIndex = GetTileIndexAtLocation(playerTransform.GetLocation());
+	int playerInstanceIndex = INDEX_NONE;
+
 	for (int row = 0; row < rows; row++)
 	{
 		for (int col = 0; col < rows; col++)
 		{
 			tileIndex = col + rows * row;
 			//Check if index is valid and tile is not empty
-			if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].tileType != ETileType::EMPTY)
+			if (Grid->TileArray.IsValidIndex(tileIndex) && GetTileType(Grid->TileArray[tileIndex]) != ETileType::EMPTY)
 			{
 				//create minimap
 				if (IsShowingMinimap)
 				{
 					minimapTileTransform.SetLocation(FVector(col * MinimapTileSize + FromActorToMinimapPos.X, row * MinimapTileSize + FromActorToMinimapPos.Y, FromActorToMinimapPos.Z -50.f));
 					newInstanceIndex = CubeISMC->AddInstance(minimapTileTransform);
-					TileArray[tileIndex].miniMapTileInstanceID = newInstanceIndex;
-					switch (TileArray[tileIndex].tileType)
+					if (tileIndex == tilePlayerIndex)
+						playerInstanceIndex = newInstanceIndex;
+					switch (GetTileType(Grid->TileArray[tileIndex]))
 					{
 					case ETileType::ROOM:
 						CubeISMC->SetCustomDataValue(newInstanceIndex, 0, 0.15f, true);
@@ -81,592 +176,2419 @@ void ADungeonSpace::GenerateMinimap(FTransform& playerTransform)
 		}
 	}
 
-	//works when the the dungeon space location = 0,0,0
-	int tilePlayerIndex = int(playerTransform.GetLocation().X / TileSize) + TileRows * int(playerTransform.GetLocation().Y / TileSize);
-	if (TileArray.IsValidIndex(tilePlayerIndex) && TileArray[tilePlayerIndex].tileType != ETileType::EMPTY)
+	if (playerInstanceIndex != INDEX_NONE)
 	{
 		if (GEngine)
 		{
 			GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Emerald, TEXT("Player is in the dungeon!"));
 		}
-		CubeISMC->SetCustomDataValue(TileArray[tilePlayerIndex].miniMapTileInstanceID, 0, 0.25f, true);
+		CubeISMC->SetCustomDataValue(playerInstanceIndex, 0, 0.25f, true);
 	}
 
 
 }
 
-void ADungeonSpace::DebugTiles(FVector& tilePos)
-{
-	int tileIndex = int(tilePos.X / TileSize) + TileRows * int(tilePos.Y / TileSize);
-	FString infoTile{};
-	infoTile.Append(TEXT("Center tile: type("));
-	ShowDebugTile(tileIndex, infoTile, FColor::White);
-
-	infoTile.Reset();
-	infoTile.Append(TEXT("Right tile: type("));
-	ShowDebugTile(tileIndex - 1, infoTile, FColor::Purple);
-
-	infoTile.Reset();
-	infoTile.Append(TEXT("Left tile: type("));
-	ShowDebugTile(tileIndex + 1, infoTile, FColor::Green);
-
-	infoTile.Reset();
-	infoTile.Append(TEXT("Top tile: type("));
-	ShowDebugTile(tileIndex + TileRows, infoTile, FColor::Yellow);
-
-	infoTile.Reset();
-	infoTile.Append(TEXT("Bot tile: type("));
-	ShowDebugTile(tileIndex - TileRows, infoTile, FColor::Orange);
-}
-
-// Called when the game starts or when spawned
-void ADungeonSpace::BeginPlay()
-{
-	Super::BeginPlay();
-
-	GenerateDungeon();
-	FString text;
-	PrintTree(text, RootSpace);
-	if (GEngine)
-		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Cyan, text);
-}
-
-void ADungeonSpace::GenerateDungeon()
+void ADungeonSpace::UpdateMinimapPlayer(const FVector& playerLocation)
 {
-	if (GEngine)
-		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Emerald, TEXT("Generating dungeon..."));
+	DUNGEON_SCOPE_PHASE(UpdateMinimapPlayer);
+	//nothing shows the texture before the minimap is spawned
+	if (MinimapMode != EMinimapMode::TEXTURE || !MinimapPlane->IsVisible() || MinimapTexture == nullptr || Grid->Settings.UseChunkStreaming)
+		return;
 
-	ResetDungeon();
-
-	const int maxElements = pow(2, SplitIterations + 1) - 1;
-	FData parentData = FData();
-	parentData.width = DungeonSize;
-	parentData.height = DungeonSize;
-	parentData.left = 0;
-	parentData.bottom = 0;
-	parentData.seperation = ESeperation(FMath::RandRange(0, 1));
-	parentData.tilesSeperated = FMath::RandRange(MinTilesPerRoom, DungeonSize / TileSize - MinTilesPerRoom);
-	RootSpace = SplitSpace(nullptr, 0, maxElements, parentData);
-	SelectDungeonRooms(RootSpace, 0);
-	FillTileGrid();
-	ConstructDungeonGrid();
-	IsDungeonGenerated = true;
-}
+	const int playerTile = GetTileIndexAtLocation(playerLocation);
+	if (playerTile == MinimapPlayerTile)
+		return;
 
-FSpace* ADungeonSpace::SplitSpace(FSpace* currentSpace, int index, int maxElements, FData parentData)
-{
-	if (index < maxElements)
+	FIntRect dirtyRegion(MAX_int32, MAX_int32, MIN_int32, MIN_int32);
+	auto addDirtyTile = [&dirtyRegion, this](int tileIndex)
 	{
-		int minRoomSize = TileSize * MinTilesPerRoom + TileSize * 2;
-
-		FSpace* temp = new FSpace();
-		temp->data.key = index;
+		const FIntPoint tile(tileIndex % Grid->TileRows, tileIndex / Grid->TileRows);
+		dirtyRegion.Include(tile);
+		dirtyRegion.Include(tile + FIntPoint(1, 1));
+	};
 
-		//check if the width and height are still big enough to split
-		if (parentData.width <= minRoomSize && parentData.height <= minRoomSize)
-			return currentSpace;
+	//restore the old texel of the player
+	if (MinimapPlayerTile != INDEX_NONE)
+	{
+		MinimapPixels[MinimapPlayerTile] = GetMinimapTileColor(MinimapPlayerTile);
+		addDirtyTile(MinimapPlayerTile);
+	}
+	MinimapPlayerTile = playerTile;
 
-		//Change data depending on left or right of parent space
-		if (index > 0)
+	if (playerTile != INDEX_NONE)
+	{
+		//explore the tiles around the player, only the tiles that were still covered by fog change
+		const int playerCol = playerTile % Grid->TileRows;
+		const int playerRow = playerTile / Grid->TileRows;
+		for (int row = FMath::Max(0, playerRow - MinimapRevealRadius); row <= FMath::Min(Grid->TileRows - 1, playerRow + MinimapRevealRadius); row++)
 		{
-			if (index % 2 == 1)//odd = left or top of the space split
-			{
-				if (parentData.seperation == ESeperation::VERTICAL)
-				{
-					parentData.width = TileSize * parentData.tilesSeperated;
-				}
-				else
-				{
-					parentData.height = parentData.height - (TileSize * parentData.tilesSeperated);
-					parentData.bottom = parentData.bottom + TileSize * parentData.tilesSeperated;
-				}
-
-				//create startpoint of corridor
-				FCorridor* corridor = new FCorridor();
-				corridor->start.X = parentData.left + (parentData.width / TileSize / 2 - 1) * TileSize;
-				corridor->start.Y = parentData.bottom + (parentData.height / TileSize / 2 + 1) * TileSize;
-				corridor->seperation = parentData.seperation;
-
-				DungeonCorridors.Add(index, corridor);
-
-			}
-			else//even = right or bottom of the space split
+			for (int col = FMath::Max(0, playerCol - MinimapRevealRadius); col <= FMath::Min(Grid->TileRows - 1, playerCol + MinimapRevealRadius); col++)
 			{
-				if (parentData.seperation == ESeperation::VERTICAL)
-				{
-					parentData.width = parentData.width - (TileSize * parentData.tilesSeperated);
-					parentData.left = parentData.left + TileSize * parentData.tilesSeperated;
-				}
-				else
-				{
-					parentData.height = TileSize * parentData.tilesSeperated;
-				}
-
-				//create endpoint of corridor if corridor exists
-				if (DungeonCorridors.Contains(index - 1))
+				const int tileIndex = col + Grid->TileRows * row;
+				if (!ExploredTiles[tileIndex])
 				{
-					FCorridor* corridorOfSister = DungeonCorridors[index - 1];
-					corridorOfSister->end.X = parentData.left + (parentData.width / TileSize / 2 + 1) * TileSize;
-					corridorOfSister->end.Y = parentData.bottom + (parentData.height / TileSize / 2 - 1) * TileSize;
-
+					ExploredTiles[tileIndex] = true;
+					MinimapPixels[tileIndex] = GetMinimapTileColor(tileIndex);
+					addDirtyTile(tileIndex);
 				}
 			}
 		}
 
-		//change data of current space
-		temp->data.width = parentData.width;
-		temp->data.height = parentData.height;
-		temp->data.left = parentData.left;
-		temp->data.bottom = parentData.bottom;
-
-		currentSpace = temp;
-
-
-
-		//calculate next split
-		int minXTiles = int((float(parentData.height) * MinRoomRatio)) / TileSize;
-		int maxXTiles = (parentData.width / TileSize) - minXTiles;
-		bool isVerticalSplitValid = minXTiles < maxXTiles;
-
-		int minYTiles = int((float(parentData.width) * MinRoomRatio)) / TileSize;
-		int maxYTiles = (parentData.height / TileSize) - minYTiles;
-		bool isHorizontalSplitValid = minYTiles < maxYTiles;
-
-		if (isVerticalSplitValid && isHorizontalSplitValid)
-		{
-			//randomize split
-			parentData.seperation = ESeperation(FMath::RandRange(0, 1));
-			if (parentData.seperation == ESeperation::VERTICAL)
-				parentData.tilesSeperated = FMath::RandRange(minXTiles, maxXTiles);
-			else
-				parentData.tilesSeperated = FMath::RandRange(maxYTiles, maxYTiles);
-		}
-		else if (isVerticalSplitValid && !isHorizontalSplitValid)
-		{
-			//vertical split
-			parentData.tilesSeperated = FMath::RandRange(minXTiles, maxXTiles);
-			parentData.seperation = ESeperation::VERTICAL;
-		}
-		else if (!isVerticalSplitValid && isHorizontalSplitValid)
-		{
-			//horizontal split
-			parentData.tilesSeperated = FMath::RandRange(minYTiles, maxYTiles);
-			parentData.seperation = ESeperation::HORIZONTAL;
-		}
-		else // no split possible
-			return currentSpace;
-
-
-		currentSpace->left = SplitSpace(currentSpace->left, 2 * index + 1, maxElements, parentData);
-
-		currentSpace->right = SplitSpace(currentSpace->right, 2 * index + 2, maxElements, parentData);
+		MinimapPixels[playerTile] = MinimapPlayerColor;
+		addDirtyTile(playerTile);
 	}
-	return currentSpace;
+
+	if (dirtyRegion.Min.X < dirtyRegion.Max.X)
+		UploadMinimapTexels(dirtyRegion);
 }
 
-void ADungeonSpace::PrintTree(FString& string, FSpace* root)
+void ADungeonSpace::UpdateDungeonStats() const
 {
-	if (root != nullptr)
+#if STATS
+	int roomTiles = 0;
+	int corridorTiles = 0;
+	for (uint8 tile : Grid->TileArray)
 	{
-		PrintTree(string, root->left);
-		string.Append(FString::FromInt(root->data.key));
-		string.Append(TEXT(" "));
-		PrintTree(string, root->right);
+		roomTiles += tile == uint8(ETileType::ROOM);
+		corridorTiles += tile == uint8(ETileType::CORRIDOR);
 	}
+	SET_DWORD_STAT(STAT_DungeonBSPNodes, int(Grid->CoreLayout.nodes.size()));
+	SET_DWORD_STAT(STAT_DungeonRooms, Grid->DungeonRooms.Num());
+	SET_DWORD_STAT(STAT_DungeonCorridors, Grid->DungeonCorridors.Num());
+	SET_DWORD_STAT(STAT_DungeonRoomTiles, roomTiles);
+	SET_DWORD_STAT(STAT_DungeonCorridorTiles, corridorTiles);
+	UpdateInstanceStats();
+#endif
 }
 
-void ADungeonSpace::SelectDungeonRooms(FSpace* currentSpace, int currentDepth)
+void ADungeonSpace::UpdateInstanceStats() const
 {
-	if (currentSpace == nullptr)
-		return;
+#if STATS
+	const FIntVector instanceCounts = GetInstanceCounts();
+	SET_DWORD_STAT(STAT_DungeonFloorInstances, instanceCounts.X);
+	SET_DWORD_STAT(STAT_DungeonWallInstances, instanceCounts.Y);
+	SET_DWORD_STAT(STAT_DungeonPillarInstances, instanceCounts.Z);
+	SET_DWORD_STAT(STAT_DungeonLoadedChunks, LoadedChunks.Num());
+#endif
+}
 
-	if (currentDepth == SplitIterations || (currentSpace->left == nullptr || currentSpace->right == nullptr))
+FIntVector ADungeonSpace::GetInstanceCounts() const
+{
+	FIntVector counts(FloorTileISMC->GetInstanceCount(), WallTileISMC->GetInstanceCount(), PillarTileISMC->GetInstanceCount());
+	for (const TPair<FIntPoint, FDungeonChunkMeshes>& loadedChunk : LoadedChunks)
 	{
-		DungeonRooms.Add(currentSpace);
+		if (loadedChunk.Value.Floor != nullptr)
+			counts += FIntVector(loadedChunk.Value.Floor->GetInstanceCount(), loadedChunk.Value.Wall->GetInstanceCount(), loadedChunk.Value.Pillar->GetInstanceCount());
 	}
-
-	SelectDungeonRooms(currentSpace->left, currentDepth + 1);
-	SelectDungeonRooms(currentSpace->right, currentDepth + 1);
+	return counts;
 }
 
-void ADungeonSpace::FillTileGrid()
+int ADungeonSpace::GetTileIndexAtLocation(const FVector& worldLocation) const
 {
-	int tilesDungeon = DungeonSize / TileSize;
-	int tileIndex;
-	//Fill rooms in grid with floor tiles
-	int left, right, top, bottom;
-	for (int i = 0; i < DungeonRooms.Num(); i++)
-	{
-		ShrinkSpaceToRoom(DungeonRooms[i]); //todo fix corridor connections
+	const FVector localLocation = GetActorTransform().InverseTransformPosition(worldLocation);
+	const int col = FMath::FloorToInt(localLocation.X / Grid->Settings.TileSize);
+	const int row = FMath::FloorToInt(localLocation.Y / Grid->Settings.TileSize);
+	if (col < 0 || row < 0 || col >= Grid->TileRows || row >= Grid->TileRows)
+		return INDEX_NONE;
 
-		left = DungeonRooms[i]->data.left;
-		right = DungeonRooms[i]->data.left + DungeonRooms[i]->data.width;
-		bottom = DungeonRooms[i]->data.bottom;
-		top = DungeonRooms[i]->data.bottom + DungeonRooms[i]->data.height;
+	return col + Grid->TileRows * row;
+}
 
-		for (int row = bottom; row < top; row += TileSize)
-		{
-			for (int col = left; col < right; col += TileSize) {
+FVector ADungeonSpace::GetTileLocation(int tileIndex) const
+{
+	const FVector localLocation((tileIndex % Grid->TileRows + 0.5f) * Grid->Settings.TileSize, (tileIndex / Grid->TileRows + 0.5f) * Grid->Settings.TileSize, 0.f);
+	return GetActorTransform().TransformPosition(localLocation);
+}
 
-				tileIndex = (col / TileSize) + tilesDungeon * (row / TileSize);
-				if (TileArray.IsValidIndex(tileIndex))
-				{
-					TileArray[tileIndex].tileType = ETileType::ROOM;
-					TileArray[tileIndex].objectsToSpawn.Add(FDungeonObject()); //default object is a floor
-					TileArray[tileIndex].left = col;
-					TileArray[tileIndex].bottom = row;
-				}
+int ADungeonSpace::GetWalkableNeighbours(int tileIndex, int (&neighbours)[4]) const
+{
+	//the side bits of the neighbour mask are the walkable side neighbours, the mask has no bits outside of the grid
+	const uint8 mask = Grid->TileNeighbourMasks[tileIndex];
+	int numNeighbours = 0;
+	if (mask & (1 << uint8(EDungeonObjectAlign::LEFT)))
+		neighbours[numNeighbours++] = tileIndex + 1;
+	if (mask & (1 << uint8(EDungeonObjectAlign::RIGHT)))
+		neighbours[numNeighbours++] = tileIndex - 1;
+	if (mask & (1 << uint8(EDungeonObjectAlign::TOP)))
+		neighbours[numNeighbours++] = tileIndex + Grid->TileRows;
+	if (mask & (1 << uint8(EDungeonObjectAlign::BOTTOM)))
+		neighbours[numNeighbours++] = tileIndex - Grid->TileRows;
+	return numNeighbours;
+}
 
-			}
+bool ADungeonSpace::FindPath(const FVector& startLocation, const FVector& goalLocation, TArray<FVector>& pathLocations)
+{
+	pathLocations.Reset();
+	if (!HasTileGrid())
+		return false;
 
-		}
-	}
+	if (!FindTilePath(GetTileIndexAtLocation(startLocation), GetTileIndexAtLocation(goalLocation), PathScratch, PathTiles))
+		return false;
 
-	//fill corridors in grid with floor tiles
-	for (auto& elem : DungeonCorridors)
+	pathLocations.Reserve(PathTiles.size());
+	for (int32 tileIndex : PathTiles)
 	{
-		FCorridor* currentCorridor = elem.Value;
-		int x, y;
-		if (currentCorridor->seperation == ESeperation::VERTICAL) //vertical seperation = horizontal corridor
-		{
-			int startTile = -1, endTile = -1;
-			y = currentCorridor->start.Y;
-			for (x = currentCorridor->start.X; x <= currentCorridor->end.X; x += TileSize)
-			{
-				tileIndex = (x / TileSize) + tilesDungeon * (y / TileSize);
-				if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].objectsToSpawn.Num() == 0)
-				{
-					TileArray[tileIndex].tileType = ETileType::CORRIDOR;
-					TileArray[tileIndex].objectsToSpawn.Add(FDungeonObject()); //floor
-					TileArray[tileIndex].left = x;
-					TileArray[tileIndex].bottom = y;
-				}
-			}
-		}
-		else if (currentCorridor->seperation == ESeperation::HORIZONTAL)//horizontal seperation = vertical corridor
-		{
-			int startTile = -1, endTile = -1;
-			x = currentCorridor->start.X;
-			for (y = currentCorridor->start.Y; y >= currentCorridor->end.Y; y -= TileSize)
-			{
-				tileIndex = (x / TileSize) + tilesDungeon * (y / TileSize);
-				if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].objectsToSpawn.Num() == 0)
-				{
-					TileArray[tileIndex].tileType = ETileType::CORRIDOR;
-					TileArray[tileIndex].objectsToSpawn.Add(FDungeonObject()); //floor
-					TileArray[tileIndex].left = x;
-					TileArray[tileIndex].bottom = y;
-				}
-			}
-		}
+		pathLocations.Add(GetTileLocation(tileIndex));
 	}
+	return true;
+}
 
-	//add other objectsToSpawn to rooms
-	for (int i = 0; i < DungeonRooms.Num(); i++)
-	{
-		left = DungeonRooms[i]->data.left;
-		right = DungeonRooms[i]->data.left + DungeonRooms[i]->data.width;
-		bottom = DungeonRooms[i]->data.bottom;
-		top = DungeonRooms[i]->data.bottom + DungeonRooms[i]->data.height;
+FVector ADungeonSpace::GetFlowDirection(const FVector& worldLocation) const
+{
+	const int tileIndex = GetTileIndexAtLocation(worldLocation);
+	const int nextTile = tileIndex != INDEX_NONE ? PlayerFlowField.GetNextTile(tileIndex) : INDEX_NONE;
+	if (nextTile == INDEX_NONE)
+		return FVector::ZeroVector;
 
-		for (int row = bottom; row < top; row += TileSize)
-		{
-			for (int col = left; col < right; col += TileSize) {
+	return (GetTileLocation(nextTile) - GetTileLocation(tileIndex)).GetSafeNormal();
+}
 
-				tileIndex = (col / TileSize) + tilesDungeon * (row / TileSize);
-				if (TileArray.IsValidIndex(tileIndex))
-				{
-					PlaceWalls(tileIndex);
-				}
+int ADungeonSpace::GetFlowDistance(const FVector& worldLocation) const
+{
+	const int tileIndex = GetTileIndexAtLocation(worldLocation);
+	return tileIndex != INDEX_NONE ? PlayerFlowField.GetDistance(tileIndex) : INDEX_NONE;
+}
 
-			}
+void ADungeonSpace::UpdateFlowField()
+{
+	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	const int playerTile = playerPawn != nullptr ? GetTileIndexAtLocation(playerPawn->GetActorLocation()) : INDEX_NONE;
+	if (playerTile == PlayerFlowField.GetTarget())
+		return;
 
-		}
+	//a player on a wall or outside of the dungeon keeps the last field
+	if (playerTile == INDEX_NONE || GetTileTypeAt(playerTile) == ETileType::EMPTY)
+		return;
 
-	}
+	DUNGEON_SCOPE_PHASE(UpdateFlowField);
+	PlayerFlowField.SetTarget(playerTile);
+	SET_DWORD_STAT(STAT_DungeonFlowFieldTiles, PlayerFlowField.GetNumVisitedTiles());
+}
 
-	//add other objects to corridors (walls)
-	for (auto& elem : DungeonCorridors)
-	{
-		FCorridor* currentCorridor = elem.Value;
-		int x, y;
-		if (currentCorridor->seperation == ESeperation::VERTICAL) //vertical seperation = horizontal corridor
-		{
-			int startTile = -1, endTile = -1;
-			y = currentCorridor->start.Y;
-			for (x = currentCorridor->start.X; x <= currentCorridor->end.X; x += TileSize)
-			{
-				tileIndex = (x / TileSize) + tilesDungeon * (y / TileSize);
-				if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].tileType == ETileType::CORRIDOR)
-				{
-					PlaceWalls(tileIndex);
-				}
-			}
-		}
-		else if (currentCorridor->seperation == ESeperation::HORIZONTAL)//horizontal seperation = vertical corridor
-		{
-			int startTile = -1, endTile = -1;
-			x = currentCorridor->start.X;
-			for (y = currentCorridor->start.Y; y >= currentCorridor->end.Y; y -= TileSize)
-			{
-				tileIndex = (x / TileSize) + tilesDungeon * (y / TileSize);
-				if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].tileType == ETileType::CORRIDOR)
-				{
-					PlaceWalls(tileIndex);
-				}
-			}
-		}
-	}
+int FDungeonNavSnapshot::GetTileIndexAtLocation(const FVector& worldLocation) const
+{
+	const FVector localLocation = Transform.InverseTransformPosition(worldLocation);
+	const int col = FMath::FloorToInt(localLocation.X / TileSize);
+	const int row = FMath::FloorToInt(localLocation.Y / TileSize);
+	if (col < 0 || row < 0 || col >= TileRows || row >= TileRows)
+		return INDEX_NONE;
 
+	return col + TileRows * row;
 }
 
-void ADungeonSpace::ConstructDungeonGrid()
+FVector FDungeonNavSnapshot::GetTileLocation(int tileIndex) const
+{
+	const FVector localLocation((tileIndex % TileRows + 0.5f) * TileSize, (tileIndex / TileRows + 0.5f) * TileSize, 0.f);
+	return Transform.TransformPosition(localLocation);
+}
+
+int FDungeonNavSnapshot::FindNearestWalkableTile(int tileIndex, int maxTiles) const
 {
-	int rows = DungeonSize / TileSize;
-	int tileIndex;
-	FTransform dungeonTileTranform = GetTransform();
-	UInstancedStaticMeshComponent* meshISMCToAddInstance = nullptr;
-	int objectWidth;
-	uint32 newInstanceIndex;
+	if (GetTileTypeAt(tileIndex) != ETileType::EMPTY)
+		return tileIndex;
 
-	for (int row = 0; row < rows; row++)
+	//rings of growing size around the tile, the first ring with a walkable tile has the nearest one or one close to it
+	const int col = tileIndex % TileRows;
+	const int row = tileIndex / TileRows;
+	for (int ring = 1; ring <= maxTiles; ring++)
 	{
-		for (int col = 0; col < rows; col++)
+		int nearestTile = INDEX_NONE;
+		int nearestDistance = MAX_int32;
+		for (int y = FMath::Max(0, row - ring); y <= FMath::Min(TileRows - 1, row + ring); y++)
 		{
-			tileIndex = col + rows * row;
-			//Check if index is valid and tile is not empty
-			if (TileArray.IsValidIndex(tileIndex) && TileArray[tileIndex].tileType != ETileType::EMPTY)
+			//the rows inside the ring only have their two ends on it
+			const bool isEdgeRow = y == row - ring || y == row + ring;
+			const int step = isEdgeRow ? 1 : 2 * ring;
+			for (int x = col - ring; x <= col + ring; x += step)
 			{
-				//create instances for all objectsToSpawn on the tile
-				//loop over dungeon objectsToSpawn to create instances of meshes
-				if (TileArray[tileIndex].objectsToSpawn.Num() > 0)
-				{
-					int left, bottom;
-					for (int i = 0; i < TileArray[tileIndex].objectsToSpawn.Num(); i++)
-					{
-						left = TileArray[tileIndex].left;
-						bottom = TileArray[tileIndex].bottom;
-						//change ISMC depending on object type and the object width (helps with alighning object)
-						switch (TileArray[tileIndex].objectsToSpawn[i].objectType)
-						{
-						case EDungeonObjectType::FLOOR:
-							meshISMCToAddInstance = FloorTileISMC;
-							objectWidth = 0;
-							break;
-						case EDungeonObjectType::WALL:
-							meshISMCToAddInstance = WallTileISMC;
-							objectWidth = WallTileWidth;
-						case EDungeonObjectType::CEILING:
-							break;
-						case EDungeonObjectType::PILLAR:
-							break;
-						case EDungeonObjectType::TORCH:
-							break;
-						}
-
-						//change transform to alignment of object
-						FVector rotationVector = TileArray[tileIndex].objectsToSpawn[i].rotation;
-						float customDataValue = 0.7f;
-						switch (TileArray[tileIndex].objectsToSpawn[i].objectAlignement)
-						{
-						case EDungeonObjectAlign::LEFT:
-							dungeonTileTranform.SetLocation(FVector(left + TileSize, bottom + TileSize / 2, 0));
-							dungeonTileTranform.SetRotation(rotationVector.Rotation().Quaternion());
-							customDataValue = 0.2f;
-							break;
-						case EDungeonObjectAlign::RIGHT:
-							dungeonTileTranform.SetLocation(FVector(left, bottom + TileSize / 2, 0));
-							dungeonTileTranform.SetRotation(rotationVector.Rotation().Quaternion());
-							customDataValue = 0.2f;
-							break;
-						case EDungeonObjectAlign::TOP:
-							dungeonTileTranform.SetLocation(FVector(left + TileSize / 2, bottom + TileSize, 0));
-							dungeonTileTranform.SetRotation(rotationVector.Rotation().Quaternion());
-							customDataValue = 0.7f;
-							break;
-						case EDungeonObjectAlign::BOTTOM:
-							dungeonTileTranform.SetLocation(FVector(left + TileSize / 2, bottom, 0));
-							dungeonTileTranform.SetRotation(rotationVector.Rotation().Quaternion());
-							customDataValue = 0.7f;
-							break;
-						case EDungeonObjectAlign::CENTER:
-							dungeonTileTranform.SetLocation(FVector(left + TileSize / 2, bottom + TileSize / 2, 0));
-							dungeonTileTranform.SetRotation(rotationVector.Rotation().Quaternion());
-							break;
-						}
-
-						if (meshISMCToAddInstance != nullptr)
-						{
-							newInstanceIndex = meshISMCToAddInstance->AddInstance(dungeonTileTranform);
-							meshISMCToAddInstance->SetCustomDataValue(newInstanceIndex, 0, customDataValue, true);
-						}
+				const int ringTile = x + TileRows * y;
+				if (x < 0 || x >= TileRows || GetTileTypeAt(ringTile) == ETileType::EMPTY)
+					continue;
 
-						meshISMCToAddInstance = nullptr;
-					}
+				const int distance = (x - col) * (x - col) + (y - row) * (y - row);
+				if (distance < nearestDistance)
+				{
+					nearestDistance = distance;
+					nearestTile = ringTile;
 				}
 			}
 		}
+		if (nearestTile != INDEX_NONE)
+			return nearestTile;
 	}
+	return INDEX_NONE;
+}
+
+bool FDungeonNavSnapshot::RaycastTiles(const FVector& startLocation, const FVector& endLocation, FVector& hitLocation) const
+{
+	//the path graph traces in tile units
+	const FVector localStart = Transform.InverseTransformPosition(startLocation) / TileSize;
+	const FVector localEnd = Transform.InverseTransformPosition(endLocation) / TileSize;
+	float hitFraction;
+	const bool isHit = PathGraph.Raycast(localStart.X, localStart.Y, localEnd.X, localEnd.Y, hitFraction);
+	hitLocation = FMath::Lerp(startLocation, endLocation, hitFraction);
+	return isHit;
+}
+
+FBox FDungeonNavSnapshot::GetTileGridBounds() const
+{
+	const float gridSize = float(TileRows) * TileSize;
+	return FBox(FVector::ZeroVector, FVector(gridSize, gridSize, 0.f)).TransformBy(Transform);
 }
 
-void ADungeonSpace::ShrinkSpaceToRoom(FSpace* currentSpace)
+void ADungeonSpace::PublishNavSnapshot()
 {
-	if (currentSpace != nullptr)
+	UDungeonWorldSubsystem* dungeonSubsystem = GetWorld()->GetSubsystem<UDungeonWorldSubsystem>();
+	if (dungeonSubsystem == nullptr)
+		return;
+
+	if (!UseTileNavigation || !HasTileGrid())
 	{
-		//check if there are spare tiles
-		int extraTilesInWidth = (currentSpace->data.width / TileSize) - MinTilesPerRoom;
-		extraTilesInWidth = std::min(extraTilesInWidth, (currentSpace->data.width / TileSize / 2));
-		if (extraTilesInWidth > 1)
-		{
-			extraTilesInWidth = FMath::RandRange(1, extraTilesInWidth);
-			currentSpace->data.width -= extraTilesInWidth * TileSize;
-			if (extraTilesInWidth % 2 == 1)
-				extraTilesInWidth = -1;
-			currentSpace->data.left += (extraTilesInWidth / 2) * TileSize;
-		}
+		dungeonSubsystem->SetNavSnapshot(this, nullptr);
+		return;
+	}
 
+	//the grid is rewritten by the next generation and by subtree regenerations, the queries get a copy that nobody writes
+	TSharedPtr<FDungeonNavSnapshot, ESPMode::ThreadSafe> snapshot = MakeShared<FDungeonNavSnapshot, ESPMode::ThreadSafe>();
+	snapshot->Transform = GetActorTransform();
+	snapshot->TileRows = Grid->TileRows;
+	snapshot->TileSize = Grid->Settings.TileSize;
+	snapshot->TileArray = Grid->TileArray;
+	snapshot->PathGraph = Grid->PathGraph;
+	dungeonSubsystem->SetNavSnapshot(this, snapshot);
+}
 
-		int extraTilesInHeight = (currentSpace->data.height / TileSize) - MinTilesPerRoom;
-		extraTilesInHeight = std::min(extraTilesInHeight, (currentSpace->data.height / TileSize) / 2);
-		if (extraTilesInHeight > 1)
-		{
-			extraTilesInHeight = FMath::RandRange(1, extraTilesInHeight);
-			currentSpace->data.height -= extraTilesInHeight * TileSize;
-			if (extraTilesInHeight % 2 == 1)
-				extraTilesInHeight = -1;
-			currentSpace->data.bottom += (extraTilesInHeight / 2) * TileSize;
-		}
+void ADungeonSpace::InvalidateNavigationPaths()
+{
+	//the navigation data reads the published snapshot, only the paths that were found on the old layout are out of date
+	for (TActorIterator<ADungeonNavigationData> navData(GetWorld()); navData; ++navData)
+	{
+		navData->InvalidateActivePaths();
 	}
 }
 
-bool ADungeonSpace::CheckIfWallShouldBePlaced(int tileIndex, int adjacentTileIndex)
+bool ADungeonSpace::IsRegionPotentiallyVisible(int region) const
 {
-	EDungeonObjectAlign adjacentTileAlignment = EDungeonObjectAlign::RIGHT;
-	//check if the adjacent tile is not in grid -> place wall
-	if (!TileArray.IsValidIndex(adjacentTileIndex))
+	if (!HasTileGrid() || VisibleFromRegion == INDEX_NONE || region == INDEX_NONE || Grid->RegionVisibility.GetNumRegions() != Grid->NumRegions)
 		return true;
+	return Grid->RegionVisibility.IsVisible(VisibleFromRegion, region);
+}
 
-	//put wall if adjacent tile is empty
-	if (TileArray[adjacentTileIndex].tileType == ETileType::EMPTY)
-		return true;
+bool ADungeonSpace::IsLocationPotentiallyVisible(const FVector& worldLocation) const
+{
+	const int tileIndex = HasTileGrid() ? GetTileIndexAtLocation(worldLocation) : INDEX_NONE;
+	return IsRegionPotentiallyVisible(tileIndex != INDEX_NONE ? GetTileRegion(tileIndex) : INDEX_NONE);
+}
 
-	return false;
+void ADungeonSpace::UpdateVisibilityCulling()
+{
+	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	const int playerTile = playerPawn != nullptr ? GetTileIndexAtLocation(playerPawn->GetActorLocation()) : INDEX_NONE;
+	//a player on a wall keeps the last region, outside of the dungeon everything is shown
+	int playerRegion = VisibleFromRegion;
+	if (playerTile == INDEX_NONE)
+		playerRegion = INDEX_NONE;
+	else if (GetTileRegion(playerTile) != INDEX_NONE)
+		playerRegion = GetTileRegion(playerTile);
+	if (playerRegion == VisibleFromRegion)
+		return;
+
+	DUNGEON_SCOPE_PHASE(UpdateVisibilityCulling);
+	VisibleFromRegion = playerRegion;
+	SetClusterVisibility(playerRegion != INDEX_NONE);
 }
 
-bool ADungeonSpace::IsCorridorConnected(int tileIndex)
+void ADungeonSpace::SetClusterVisibility(bool isCullingClusters)
 {
-	//check for 2 connections
-	int connections = 0;
+	if (Grid->ClusterRegionLists.Num() != Grid->InstanceRegions.Num())
+		return;
 
-	//adjacent tile LEFT
-	int adjacentTileIndex = tileIndex - 1;
-	if (TileArray.IsValidIndex(adjacentTileIndex) && TileArray[adjacentTileIndex].tileType != ETileType::EMPTY)
+	int numVisibleClusters = 0;
+	for (int cluster = 0; cluster < Grid->InstanceRegions.Num(); cluster++)
 	{
-		connections++;
-	}
+		FDungeonChunkMeshes* meshes = LoadedChunks.Find(Grid->InstanceRegions[cluster].Min / FMath::Max(1, Grid->Settings.ChunkTiles));
+		if (meshes == nullptr || meshes->Floor == nullptr)
+			continue;
 
-	//adjacent tile RIGHT
-	adjacentTileIndex = tileIndex + 1;
-	if (TileArray.IsValidIndex(adjacentTileIndex) && TileArray[adjacentTileIndex].tileType != ETileType::EMPTY)
-	{
-		connections++;
+		bool isVisible = !isCullingClusters;
+		for (int i = 0; i < Grid->ClusterRegionLists[cluster].Num() && !isVisible; i++)
+		{
+			isVisible = IsRegionPotentiallyVisible(Grid->ClusterRegionLists[cluster][i]);
+		}
+		meshes->Floor->SetVisibility(isVisible);
+		meshes->Wall->SetVisibility(isVisible);
+		meshes->Pillar->SetVisibility(isVisible);
+		numVisibleClusters += isVisible ? 1 : 0;
 	}
+	SET_DWORD_STAT(STAT_DungeonVisibleClusters, numVisibleClusters);
+}
 
-	//adjacent tile TOP
-	adjacentTileIndex = tileIndex + TileRows;
-	if (TileArray.IsValidIndex(adjacentTileIndex) && TileArray[adjacentTileIndex].tileType != ETileType::EMPTY)
-	{
-		connections++;
-	}
+FVector FDungeonGrid::GetTorchLocation(int torch) const
+{
+	const DungeonCore::FTorch& torchData = Torches[torch];
+	const FVector tileCenter((torchData.tile % TileRows + 0.5f) * Settings.TileSize, (torchData.tile / TileRows + 0.5f) * Settings.TileSize, Settings.TorchHeight);
+	return tileCenter - TorchDirections[torchData.side] * (Settings.TileSize * 0.5f - Settings.TorchWallOffset);
+}
+
+void FDungeonGrid::BuildTorches()
+{
+	Torches.clear();
+	TorchInstances.NumCustomData = 1;
+	TorchInstances.SetNum(0);
+	if (!Settings.UseTorches || Settings.UseChunkStreaming)
+		return;
 
-	//adjacent tile BOT
-	adjacentTileIndex = tileIndex - TileRows;
-	if (TileArray.IsValidIndex(adjacentTileIndex) && TileArray[adjacentTileIndex].tileType != ETileType::EMPTY)
+	DUNGEON_SCOPE_PHASE(BuildTorches);
+	DungeonCore::PlaceTorches(TileArray.GetData(), TileNeighbourMasks.GetData(), TileRows, Settings.TorchSpacing, Torches);
+	TorchInstances.SetNum(int(Torches.size()));
+	for (int torch = 0; torch < int(Torches.size()); torch++)
 	{
-		connections++;
+		TorchInstances.Transforms[torch] = FTransform(TorchDirections[Torches[torch].side].Rotation().Quaternion(), GetTorchLocation(torch), Settings.InstanceScale);
+		TorchInstances.CustomData[torch] = 0.f;
 	}
+}
 
-	return connections > 1;
+void ADungeonSpace::ConstructTorches()
+{
+	//the buffer has no lit torches, so the lights are assigned again
+	ResetTorchLights();
+	UpdateInstances(TorchISMC, Grid->TorchInstances, 0, Grid->TorchInstances.Transforms.Num());
+	TorchLightIndices.Init(INDEX_NONE, int(Grid->Torches.size()));
+	SET_DWORD_STAT(STAT_DungeonTorches, int(Grid->Torches.size()));
 }
 
-void ADungeonSpace::ShowDebugTile(int tileIndex, FString& tileInfo, FColor colorBox)
+void ADungeonSpace::ResetTorchLights()
 {
-	if (TileArray.IsValidIndex(tileIndex))
+	for (int light = 0; light < TorchLights.Num(); light++)
 	{
-		FVector centerTile{ float(TileArray[tileIndex].left + TileSize / 2),  float(TileArray[tileIndex].bottom + TileSize / 2), GetActorLocation().Z };
-		switch (TileArray[tileIndex].tileType)
-		{
-		case ETileType::EMPTY:
-			tileInfo.Append(TEXT("EMPTY)"));
-			break;
-		case ETileType::CORRIDOR:
-			tileInfo.Append(TEXT("CORRIDOR)"));
-			break;
-		case ETileType::ROOM:
-			tileInfo.Append(TEXT("ROOM)"));
-			break;
-		}
-		tileInfo.Append(TEXT(", tileID(")).Append(FString::FromInt(tileIndex)).Append(TEXT(")"));
-		DrawDebugBox(GetWorld(), centerTile, FVector(TileSize / 2, TileSize / 2, 100.f), colorBox, true, 15.f, 0, 5.f);
-		if (GEngine)
-			GEngine->AddOnScreenDebugMessage(-1, 10.f, colorBox, tileInfo);
+		TorchLights[light]->SetVisibility(false);
+		LightTorches[light] = INDEX_NONE;
 	}
+	TorchLightIndices.Init(INDEX_NONE, TorchLightIndices.Num());
+	TorchLightsTile = INDEX_NONE;
+	TorchLightsRegion = INDEX_NONE;
+}
 
+UPointLightComponent* ADungeonSpace::CreateTorchLight()
+{
+	UPointLightComponent* light = NewObject<UPointLightComponent>(this, NAME_None, RF_Transient);
+	light->SetMobility(EComponentMobility::Movable);
+	light->SetIntensity(TorchLightIntensity);
+	light->SetAttenuationRadius(TorchLightRadius);
+	light->SetLightColor(TorchLightColor);
+	light->SetCastShadows(TorchLightsCastShadows);
+	light->SetVisibility(false);
+	light->SetupAttachment(GetRootComponent());
+	light->RegisterComponent();
+	TorchLights.Add(light);
+	LightTorches.Add(INDEX_NONE);
+	return light;
 }
 
-void ADungeonSpace::PlaceWalls(int tileIndex)
+void ADungeonSpace::UpdateTorchLights()
 {
-	int adjacentTileIndex = 0;
-	
-	//LEFT  	//check if first in row
-	adjacentTileIndex = tileIndex + 1;
-	if (CheckIfWallShouldBePlaced(tileIndex, adjacentTileIndex) || tileIndex % TileRows == TileRows - 1)
+	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	if (playerPawn == nullptr || Grid->Torches.empty())
+		return;
+
+	//the lights only move when the player steps to another tile or the visible rooms change
+	const FVector playerLocation = playerPawn->GetActorLocation();
+	const int playerTile = GetTileIndexAtLocation(playerLocation);
+	if (playerTile == TorchLightsTile && VisibleFromRegion == TorchLightsRegion)
+		return;
+
+	DUNGEON_SCOPE_PHASE(UpdateTorchLights);
+	TorchLightsTile = playerTile;
+	TorchLightsRegion = VisibleFromRegion;
+
+	//the nearest torches, the ones in rooms the player can't see only when there are not enough visible ones
+	const int numTorches = int(Grid->Torches.size());
+	const FVector localPlayerLocation = GetActorTransform().InverseTransformPosition(playerLocation);
+	const float hiddenCost = FMath::Square(2.f * Grid->Settings.DungeonSize);
+	TorchCosts.resize(numTorches);
+	for (int torch = 0; torch < numTorches; torch++)
 	{
-		FDungeonObject dObject = FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::LEFT, FVector(1, 0, 0));
-		TileArray[tileIndex].objectsToSpawn.Add(dObject);
+		const bool isVisible = IsRegionPotentiallyVisible(Grid->TileRegionIds[Grid->Torches[torch].tile]);
+		TorchCosts[torch] = FVector::DistSquared(Grid->GetTorchLocation(torch), localPlayerLocation) + (isVisible ? 0.f : hiddenCost);
 	}
-
-	//RIGHT 	//check if last in row
-	adjacentTileIndex = tileIndex - 1;
-	if (CheckIfWallShouldBePlaced(tileIndex, adjacentTileIndex) || tileIndex % TileRows == 0)
+	const int numLights = FMath::Min(MaxTorchLights, numTorches);
+	DungeonCore::SelectLowestCosts(TorchCosts, numLights, SelectedTorches);
+	while (TorchLights.Num() < numLights)
 	{
-		FDungeonObject dObject = FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::RIGHT, FVector(1, 0, 0));
-		TileArray[tileIndex].objectsToSpawn.Add(dObject);
+		CreateTorchLight();
 	}
 
-	//TOP
-	adjacentTileIndex = tileIndex + TileRows;
-	if (CheckIfWallShouldBePlaced(tileIndex, adjacentTileIndex))
+	//lights of the torches that are still selected stay where they are, the others move to the new torches
+	SelectedTorchMask.Init(false, numTorches);
+	for (int32_t torch : SelectedTorches)
+	{
+		SelectedTorchMask[torch] = true;
+	}
+	FreeTorchLights.Reset();
+	bool isCustomDataChanged = false;
+	for (int light = 0; light < TorchLights.Num(); light++)
 	{
-		FDungeonObject dObject = FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::TOP, FVector(0, -1, 0));
-		TileArray[tileIndex].objectsToSpawn.Add(dObject);
+		const int torch = LightTorches[light];
+		if (torch != INDEX_NONE && SelectedTorchMask[torch])
+			continue;
+
+		if (torch != INDEX_NONE)
+		{
+			TorchISMC->SetCustomDataValue(torch, 0, 0.f, false);
+			TorchLightIndices[torch] = INDEX_NONE;
+			LightTorches[light] = INDEX_NONE;
+			isCustomDataChanged = true;
+		}
+		FreeTorchLights.Add(light);
 	}
 
-	//BOTTOM
-	adjacentTileIndex = tileIndex - TileRows;
-	if (CheckIfWallShouldBePlaced(tileIndex, adjacentTileIndex))
+	int numFreeLights = FreeTorchLights.Num();
+	for (int32_t torch : SelectedTorches)
 	{
-		FDungeonObject dObject = FDungeonObject(EDungeonObjectType::WALL, EDungeonObjectAlign::BOTTOM, FVector(0, -1, 0));
-		TileArray[tileIndex].objectsToSpawn.Add(dObject);
+		if (TorchLightIndices[torch] != INDEX_NONE)
+			continue;
+
+		const int light = FreeTorchLights[--numFreeLights];
+		TorchLights[light]->SetRelativeLocation(Grid->GetTorchLocation(torch) + TorchDirections[Grid->Torches[torch].side] * Grid->Settings.TorchWallOffset);
+		TorchLights[light]->SetVisibility(true);
+		TorchISMC->SetCustomDataValue(torch, 0, 1.f, false);
+		TorchLightIndices[torch] = light;
+		LightTorches[light] = torch;
+		isCustomDataChanged = true;
 	}
 
-	
+	//lights above a lowered MaxTorchLights are switched off
+	for (int i = 0; i < numFreeLights; i++)
+	{
+		TorchLights[FreeTorchLights[i]]->SetVisibility(false);
+	}
+	if (isCustomDataChanged)
+		TorchISMC->MarkRenderStateDirty();
 }
 
-void ADungeonSpace::ResetDungeon()
+bool ADungeonSpace::FindTilePath(int startTile, int goalTile, DungeonCore::FPathScratch& scratch, std::vector<int32_t>& path) const
 {
-	TileArray.Init(FTile(), TileRows * TileRows);
-	CubeISMC->ClearInstances();
-	FloorTileISMC->ClearInstances();
-	WallTileISMC->ClearInstances();
-	DungeonRooms.Empty();
-	DungeonCorridors.Empty();
+	DUNGEON_SCOPE_PHASE(FindPath);
+	return Grid->PathGraph.FindPath(startTile, goalTile, scratch, path);
 }
 
-// Called every frame
-void ADungeonSpace::Tick(float DeltaTime)
+void ADungeonSpace::DebugTiles(FVector& tilePos)
+{
+	int tileIndex = GetTileIndexAtLocation(tilePos);
+	if (tileIndex == INDEX_NONE)
+		return;
+
+	FString infoTile{};
+	infoTile.Append(TEXT("Center tile: type("));
+	ShowDebugTile(tileIndex, infoTile, FColor::White);
+
+	infoTile.Reset();
+	infoTile.Append(TEXT("Right tile: type("));
+	ShowDebugTile(tileIndex - 1, infoTile, FColor::Purple);
+
+	infoTile.Reset();
+	infoTile.Append(TEXT("Left tile: type("));
+	ShowDebugTile(tileIndex + 1, infoTile, FColor::Green);
+
+	infoTile.Reset();
+	infoTile.Append(TEXT("Top tile: type("));
+	ShowDebugTile(tileIndex + Grid->TileRows, infoTile, FColor::Yellow);
+
+	infoTile.Reset();
+	infoTile.Append(TEXT("Bot tile: type("));
+	ShowDebugTile(tileIndex - Grid->TileRows, infoTile, FColor::Orange);
+}
+
+// Called when the game starts or when spawned
+void ADungeonSpace::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UDungeonWorldSubsystem* dungeonSubsystem = GetWorld()->GetSubsystem<UDungeonWorldSubsystem>())
+		dungeonSubsystem->RegisterDungeon(this);
+
+	GenerateDungeon();
+	if (!IsGenerationRunning)
+	{
+		FString text;
+		PrintTree(text);
+		if (GEngine)
+			GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Cyan, text);
+	}
+}
+
+void ADungeonSpace::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//the layout computation uses this actor, so it has to finish before the actor goes away
+	IsGenerationPending = false;
+	CancelGeneration = true;
+	if (GenerationTask.IsValid())
+		GenerationTask.Wait();
+
+	if (UDungeonWorldSubsystem* dungeonSubsystem = GetWorld()->GetSubsystem<UDungeonWorldSubsystem>())
+		dungeonSubsystem->UnregisterDungeon(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ADungeonSpace::GenerateDungeon()
+{
+	DUNGEON_SCOPE_PHASE(GenerateDungeon);
+	if (GEngine)
+		GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Emerald, TEXT("Generating dungeon..."));
+
+	if (IsGenerationRunning)
+	{
+		//the running generation starts the new one when it is cancelled
+		CancelGeneration = true;
+		IsGenerationPending = true;
+		return;
+	}
+
+	if (UseAsyncGeneration)
+	{
+		StartAsyncGeneration();
+		return;
+	}
+
+	StartGeneration();
+	PendingGrid->ComputeLayout(CancelGeneration);
+	FinishDungeonGeneration();
+}
+
+void ADungeonSpace::StartGeneration()
+{
+	//everything the layout computation needs from the game thread is copied before it starts
+	if (RandomizeSeed)
+		Seed = FMath::Rand();
+	CancelGeneration = false;
+	PendingGrid->Settings = CaptureGridSettings();
+}
+
+FDungeonGridSettings ADungeonSpace::CaptureGridSettings() const
+{
+	FDungeonGridSettings settings;
+	settings.DungeonSize = DungeonSize;
+	settings.TileSize = TileSize;
+	settings.SplitIterations = SplitIterations;
+	settings.MinTilesPerRoom = MinTilesPerRoom;
+	settings.MinRoomRatio = MinRoomRatio;
+	settings.Seed = Seed;
+	settings.WallTileWidth = WallTileWidth;
+	settings.UseTimeSlicedConstruction = UseTimeSlicedConstruction;
+	settings.UseMergedFloors = UseMergedFloors;
+	settings.WallMergeMode = WallMergeMode;
+	settings.WallModuleTiles = WallModuleTiles;
+	settings.UseMergedCollision = UseMergedCollision;
+	settings.WallCollisionHeight = WallCollisionHeight;
+	settings.FloorCollisionThickness = FloorCollisionThickness;
+	settings.UseChunkStreaming = UseChunkStreaming;
+	settings.UseClusteredMeshes = UseClusteredMeshes;
+	settings.ChunkTiles = ChunkTiles;
+	settings.UseVisibilityCulling = UseVisibilityCulling;
+	settings.VisibilityRayAngles = VisibilityRayAngles;
+	settings.UseFlowField = UseFlowField;
+	settings.UseTorches = UseTorches;
+	settings.TorchSpacing = TorchSpacing;
+	settings.TorchHeight = TorchHeight;
+	settings.TorchWallOffset = TorchWallOffset;
+	settings.InstanceScale = GetActorScale3D();
+	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	settings.ConstructionOrigin = playerPawn != nullptr ? GetActorTransform().InverseTransformPosition(playerPawn->GetActorLocation()) : FVector::ZeroVector;
+	return settings;
+}
+
+bool FDungeonGrid::ComputeLayout(const TAtomic<bool>& isCancelled)
+{
+	DUNGEON_SCOPE_PHASE(ComputeDungeonLayout);
+	LastTimings = FDungeonGenerationTimings();
+	double phaseStart = FPlatformTime::Seconds();
+	ResetLayout();
+
+	SplitSpaces(isCancelled);
+	LastTimings.SplitSpaceMs = GetPhaseMs(phaseStart);
+	if (isCancelled)
+		return false;
+
+	SelectDungeonRooms();
+	ShrinkRooms();
+	LastTimings.SelectDungeonRoomsMs = GetPhaseMs(phaseStart);
+	if (Settings.UseChunkStreaming)
+	{
+		//the chunks are rasterized when they are loaded, the full grid is never built
+		BuildChunkIndex();
+		BuildObjectTemplates();
+		return !isCancelled;
+	}
+
+	FillTileGrid();
+	BuildRegionIds();
+	BuildPathGraph();
+	BuildRegionVisibility();
+	LastTimings.FillTileGridMs = GetPhaseMs(phaseStart);
+	if (isCancelled)
+		return false;
+
+	BuildInstances();
+	LastTimings.BuildInstancesMs = GetPhaseMs(phaseStart);
+	return !isCancelled;
+}
+
+void FDungeonGrid::BuildInstances()
+{
+	DUNGEON_SCOPE_PHASE(BuildInstances);
+	IsMergingFloors = Settings.UseMergedFloors && !Settings.UseTimeSlicedConstruction;
+	IsMergingWalls = Settings.WallMergeMode != EWallMergeMode::NONE && !Settings.UseTimeSlicedConstruction;
+	if (Settings.UseMergedCollision || IsMergingWalls)
+		ExtractWallRuns(WallRuns);
+	if (Settings.UseMergedCollision)
+	{
+		BuildTileRects();
+		BuildCollisionBoxes();
+	}
+
+	BuildObjectTemplates();
+	FloorInstances.NumCustomData = 1;
+	WallInstances.NumCustomData = 1;
+	if (Settings.UseTimeSlicedConstruction)
+		BuildConstructionQueue();
+	else
+		BuildInstanceBuffers();
+	BuildClusterRegionLists();
+	BuildTorches();
+}
+
+bool ADungeonSpace::ExportLayout(const FString& filePath)
+{
+	if (!IsDungeonGenerated)
+		return false;
+
+	//the grid that is shown, a running generation builds the next one next to it
+	FDungeonLayout layout;
+	layout.DungeonSize = Grid->Settings.DungeonSize;
+	layout.TileSize = Grid->Settings.TileSize;
+	layout.SplitIterations = Grid->Settings.SplitIterations;
+	layout.MinTilesPerRoom = Grid->Settings.MinTilesPerRoom;
+	layout.MinRoomRatio = Grid->Settings.MinRoomRatio;
+	layout.Seed = Grid->Settings.Seed;
+	layout.Rooms = Grid->DungeonRooms;
+	layout.Corridors = Grid->DungeonCorridors;
+	layout.Tiles = Grid->TileArray;
+	return FDungeonLayoutSerializer::SaveLayout(filePath, layout);
+}
+
+bool ADungeonSpace::ImportLayout(const FString& filePath)
+{
+	//the running generation writes the pending grid
+	if (IsGenerationRunning)
+		return false;
+
+	FDungeonLayout layout;
+	if (!FDungeonLayoutSerializer::LoadLayout(filePath, layout))
+	{
+		if (GEngine)
+			GEngine->AddOnScreenDebugMessage(-1, 2.f, FColor::Red, FString::Printf(TEXT("Could not load dungeon layout %s"), *filePath));
+		return false;
+	}
+
+	//the loaded layout replaces the split and the tile fill, only the instances are built from it
+	DungeonSize = layout.DungeonSize;
+	TileSize = layout.TileSize;
+	SplitIterations = layout.SplitIterations;
+	MinTilesPerRoom = layout.MinTilesPerRoom;
+	MinRoomRatio = layout.MinRoomRatio;
+	Seed = layout.Seed;
+	PendingGrid->Settings = CaptureGridSettings();
+	PendingGrid->ResetLayout();
+	PendingGrid->DungeonRooms = MoveTemp(layout.Rooms);
+	PendingGrid->DungeonCorridors = MoveTemp(layout.Corridors);
+	PendingGrid->CopyRoomsToCore();
+	if (PendingGrid->Settings.UseChunkStreaming)
+	{
+		PendingGrid->BuildChunkIndex();
+		PendingGrid->BuildObjectTemplates();
+	}
+	else
+	{
+		PendingGrid->TileArray = MoveTemp(layout.Tiles);
+		PendingGrid->ComputeNeighbourMasks();
+		PendingGrid->BuildRegionIds();
+		PendingGrid->BuildPathGraph();
+		PendingGrid->BuildRegionVisibility();
+		PendingGrid->BuildInstances();
+	}
+	FinishDungeonGeneration();
+	return true;
+}
+
+bool ADungeonSpace::RegenerateSubtree(int key, int32 subtreeSeed)
+{
+	DUNGEON_SCOPE_PHASE(RegenerateSubtree);
+	if (!IsDungeonGenerated || IsGenerationRunning || IsConstructing || Grid->Settings.UseChunkStreaming || Grid->Settings.UseTimeSlicedConstruction)
+		return false;
+
+	//the rest of the tree draws the same numbers, so only the tiles of the subtree space change. The grid keeps the settings it was built with, edited ones apply to the next generation
+	DungeonCore::FTileRect changed;
+	if (!DungeonCore::RegenerateSubtree(Grid->GetCoreSettings(), Grid->Settings.Seed, key, subtreeSeed, Grid->CoreLayout, changed))
+		return false;
+
+	Grid->CopyRoomsFromCore();
+	DungeonCore::FillTileRect(Grid->GetCoreSettings(), Grid->CoreLayout, changed, Grid->TileArray.GetData());
+	DungeonCore::UpdateNeighbourMasks(Grid->TileArray.GetData(), Grid->TileRows, changed, Grid->PaddedOccupancy.GetData(), Grid->TileNeighbourMasks.GetData());
+
+	//the room indices of the regions shift, the graphs are built again
+	Grid->BuildRegionIds();
+	Grid->BuildPathGraph();
+	Grid->BuildRegionVisibility();
+	Grid->BuildInstances();
+
+	//the walls and pillars around the subtree space depend on its tiles as well
+	const FIntRect changedTiles(FMath::Max(0, changed.minCol - 1), FMath::Max(0, changed.minRow - 1), FMath::Min(Grid->TileRows, changed.maxCol + 1), FMath::Min(Grid->TileRows, changed.maxRow + 1));
+	UpdateChangedInstances(changedTiles);
+	ConstructTorches();
+	if (Grid->Settings.UseMergedCollision)
+		CollisionComponent->SetBoxes(Grid->CollisionBoxes);
+	if (MinimapMode == EMinimapMode::TEXTURE && MinimapTexture != nullptr)
+		UpdateMinimapTexels(changedTiles);
+
+	if (Grid->Settings.UseFlowField)
+		PlayerFlowField.Init(Grid->TileArray.GetData(), Grid->TileRows);
+	VisibleFromRegion = INDEX_NONE;
+	PublishNavSnapshot();
+	if (UseTileNavigation)
+		InvalidateNavigationPaths();
+	UpdateDungeonStats();
+	OnDungeonGenerated.Broadcast();
+	return true;
+}
+
+int ADungeonSpace::GetSubtreeKeyAtLocation(const FVector& worldLocation, int depth) const
+{
+	const FVector localLocation = GetActorTransform().InverseTransformPosition(worldLocation);
+	return DungeonCore::FindNodeAt(Grid->CoreLayout, FMath::FloorToInt(localLocation.X), FMath::FloorToInt(localLocation.Y), depth);
+}
+
+void ADungeonSpace::UpdateChangedInstances(const FIntRect& changedTiles)
+{
+	int numChanged = 0;
+	if (!Grid->Settings.UseClusteredMeshes)
+	{
+		//every tile row keeps its own slots, so only the rows that overlap the change are written
+		numChanged += UpdateRegionSlots(FloorTileISMC, Grid->FloorInstances, FloorSlots, &FIntVector::X, changedTiles, Grid->IsMergingFloors);
+		numChanged += UpdateRegionSlots(WallTileISMC, Grid->WallInstances, WallSlots, &FIntVector::Y, changedTiles, Grid->IsMergingWalls);
+		numChanged += UpdateRegionSlots(PillarTileISMC, Grid->PillarInstances, PillarSlots, &FIntVector::Z, changedTiles, false);
+		SET_DWORD_STAT(STAT_DungeonChangedInstances, numChanged);
+		return;
+	}
+
+	//only the clusters that overlap the change are touched
+	for (int region = 0; region < Grid->InstanceRegions.Num(); region++)
+	{
+		const FIntRect& tiles = Grid->InstanceRegions[region];
+		if (tiles.Max.X <= changedTiles.Min.X || tiles.Max.Y <= changedTiles.Min.Y || tiles.Min.X >= changedTiles.Max.X || tiles.Min.Y >= changedTiles.Max.Y)
+			continue;
+
+		const FIntPoint chunk = tiles.Min / FMath::Max(1, Grid->Settings.ChunkTiles);
+		const FIntVector first = Grid->RegionInstanceOffsets[region];
+		const FIntVector count = Grid->RegionInstanceOffsets[region + 1] - first;
+		FDungeonChunkMeshes* meshes = LoadedChunks.Find(chunk);
+		if (count.X == 0)
+		{
+			if (meshes != nullptr)
+			{
+				numChanged += meshes->Floor->GetInstanceCount() + meshes->Wall->GetInstanceCount() + meshes->Pillar->GetInstanceCount();
+				ReleaseChunk(*meshes);
+				LoadedChunks.Remove(chunk);
+			}
+			continue;
+		}
+
+		if (meshes == nullptr)
+			meshes = &LoadedChunks.Add(chunk, AcquireChunkMeshes());
+		numChanged += UpdateInstances(meshes->Floor, Grid->FloorInstances, first.X, count.X);
+		numChanged += UpdateInstances(meshes->Wall, Grid->WallInstances, first.Y, count.Y);
+		numChanged += UpdateInstances(meshes->Pillar, Grid->PillarInstances, first.Z, count.Z);
+	}
+	SET_DWORD_STAT(STAT_DungeonChangedInstances, numChanged);
+}
+
+void ADungeonSpace::UpdateMinimapTexels(const FIntRect& changedTiles)
+{
+	if (MinimapPixels.Num() != Grid->TileArray.Num())
+		return;
+
+	for (int row = changedTiles.Min.Y; row < changedTiles.Max.Y; row++)
+	{
+		for (int tileIndex = row * Grid->TileRows + changedTiles.Min.X; tileIndex < row * Grid->TileRows + changedTiles.Max.X; tileIndex++)
+		{
+			MinimapPixels[tileIndex] = tileIndex == MinimapPlayerTile ? MinimapPlayerColor : GetMinimapTileColor(tileIndex);
+		}
+	}
+	UploadMinimapTexels(changedTiles);
+}
+
+void ADungeonSpace::StartAsyncGeneration()
+{
+	StartGeneration();
+	IsGenerationPending = false;
+	IsGenerationRunning = true;
+
+	TWeakObjectPtr<ADungeonSpace> weakThis(this);
+	//the task only writes the pending grid, the grid that is shown is swapped on the game thread when it is done
+	FDungeonGrid* pendingGrid = PendingGrid.Get();
+	GenerationTask = Async(EAsyncExecution::ThreadPool, [this, pendingGrid, weakThis]()
+		{
+			const bool isCompleted = pendingGrid->ComputeLayout(CancelGeneration);
+			AsyncTask(ENamedThreads::GameThread, [weakThis, isCompleted]()
+				{
+					if (ADungeonSpace* dungeonSpace = weakThis.Get())
+						dungeonSpace->OnAsyncGenerationFinished(isCompleted);
+				});
+		});
+}
+
+void ADungeonSpace::OnAsyncGenerationFinished(bool isCompleted)
+{
+	IsGenerationRunning = false;
+
+	if (IsGenerationPending)
+	{
+		StartAsyncGeneration();
+		return;
+	}
+
+	if (isCompleted)
+		FinishDungeonGeneration();
+}
+
+void ADungeonSpace::FinishDungeonGeneration()
+{
+	//the old grid becomes the pending one, its buffers are reused by the next generation
+	Swap(Grid, PendingGrid);
+	double phaseStart = FPlatformTime::Seconds();
+	ConstructDungeonGrid();
+	Grid->LastTimings.ConstructDungeonGridMs = GetPhaseMs(phaseStart);
+	IsDungeonGenerated = true;
+	UpdateDungeonStats();
+
+	//the new clusters are all shown, Tick culls them for the region of the player
+	VisibleFromRegion = INDEX_NONE;
+
+	//the field only holds a copy of the walkable tiles, it is searched again when the player is found
+	if (Grid->Settings.UseFlowField && !Grid->Settings.UseChunkStreaming)
+		PlayerFlowField.Init(Grid->TileArray.GetData(), Grid->TileRows);
+	else
+		PlayerFlowField.Reset();
+
+	if (MinimapMode == EMinimapMode::TEXTURE && !Grid->Settings.UseChunkStreaming)
+		ResetMinimapTexture();
+
+	//the navigation queries read a copy of the new grid right away, without a navmesh rebuild
+	PublishNavSnapshot();
+	if (UseTileNavigation && !Grid->Settings.UseChunkStreaming)
+		InvalidateNavigationPaths();
+
+	//the time-sliced construction broadcasts when its last instances are added
+	if (!IsConstructing)
+		OnDungeonGenerated.Broadcast();
+}
+
+DungeonCore::FSettings FDungeonGrid::GetCoreSettings() const
+{
+	DungeonCore::FSettings settings;
+	settings.dungeonSize = Settings.DungeonSize;
+	settings.splitIterations = Settings.SplitIterations;
+	settings.tileSize = Settings.TileSize;
+	settings.minTilesPerRoom = Settings.MinTilesPerRoom;
+	settings.minRoomRatio = Settings.MinRoomRatio;
+	return settings;
+}
+
+void FDungeonGrid::SplitSpaces(const TAtomic<bool>& isCancelled)
+{
+	DUNGEON_SCOPE_PHASE(SplitSpace);
+	//the nodes of a level are split with the task graph, the core runs them on the calling thread without it
+	const DungeonCore::FParallelFor parallelFor = [](int32 count, const std::function<void(int32)>& body)
+	{
+		ParallelFor(count, [&body](int32 i) { body(i); });
+	};
+	DungeonCore::SplitSpaces(GetCoreSettings(), Settings.Seed, CoreLayout, parallelFor, [&isCancelled]() { return bool(isCancelled); });
+}
+
+void ADungeonSpace::PrintTree(FString& string)
+{
+	//the arena is stored level by level, the keys are printed in pre-order
+	TArray<int, TInlineAllocator<64>> stack;
+	if (Grid->CoreLayout.nodes.size() > 0)
+		stack.Add(0);
+	while (stack.Num() > 0)
+	{
+		const DungeonCore::FNode& node = Grid->CoreLayout.nodes[stack.Pop(false)];
+		string.Append(FString::FromInt(node.data.key));
+		string.Append(TEXT(" "));
+		if (node.right != INDEX_NONE)
+			stack.Add(node.right);
+		if (node.left != INDEX_NONE)
+			stack.Add(node.left);
+	}
+}
+
+void FDungeonGrid::SelectDungeonRooms()
+{
+	DUNGEON_SCOPE_PHASE(SelectDungeonRooms);
+	DungeonCore::SelectRooms(GetCoreSettings(), CoreLayout);
+}
+
+void FDungeonGrid::ShrinkRooms()
+{
+	DUNGEON_SCOPE_PHASE(ShrinkRooms);
+	DungeonCore::ShrinkRooms(GetCoreSettings(), Settings.Seed, CoreLayout);
+	CopyRoomsFromCore();
+}
+
+void FDungeonGrid::FillTileGrid()
+{
+	DUNGEON_SCOPE_PHASE(FillTileGrid);
+	DungeonCore::FillTileGrid(GetCoreSettings(), CoreLayout, TileArray.GetData());
+
+	//walls and pillars are derived from the neighbours of every tile in one pass
+	ComputeNeighbourMasks();
+}
+
+void FDungeonGrid::ComputeNeighbourMasks()
+{
+	DUNGEON_SCOPE_PHASE(ComputeNeighbourMasks);
+	PaddedOccupancy.SetNumUninitialized((TileRows + 2) * (TileRows + 2), false);
+	TileNeighbourMasks.SetNumUninitialized(TileArray.Num());
+	DungeonCore::ComputeNeighbourMasks(TileArray.GetData(), TileRows, PaddedOccupancy.GetData(), TileNeighbourMasks.GetData());
+}
+
+void FDungeonGrid::BuildRegionIds()
+{
+	DUNGEON_SCOPE_PHASE(BuildRegionIds);
+	TileRegionIds.SetNumUninitialized(TileArray.Num());
+	NumRegions = DungeonCore::FillRegionIds(GetCoreSettings(), CoreLayout, TileArray.GetData(), TileRegionIds.GetData());
+}
+
+void FDungeonGrid::BuildPathGraph()
+{
+	DUNGEON_SCOPE_PHASE(BuildPathGraph);
+	PathGraph.Build(TileRegionIds.GetData(), TileRows, NumRegions);
+}
+
+void FDungeonGrid::BuildRegionVisibility()
+{
+	if (!Settings.UseVisibilityCulling)
+	{
+		RegionVisibility.Reset();
+		return;
+	}
+
+	DUNGEON_SCOPE_PHASE(BuildRegionVisibility);
+	RegionVisibility.Build(PathGraph, FMath::Max(4, Settings.VisibilityRayAngles));
+}
+
+void FDungeonGrid::BuildClusterRegionLists()
+{
+	ClusterRegionLists.Reset();
+	if (!Settings.UseVisibilityCulling || !Settings.UseClusteredMeshes || Settings.UseTimeSlicedConstruction)
+		return;
+
+	//the regions of the tiles of every cluster, a wall or pillar always belongs to a walkable tile of its cluster
+	ClusterRegionLists.SetNum(InstanceRegions.Num());
+	ParallelFor(InstanceRegions.Num(), [this](int cluster)
+		{
+			const FIntRect& tiles = InstanceRegions[cluster];
+			TArray<int32>& regions = ClusterRegionLists[cluster];
+			for (int row = tiles.Min.Y; row < tiles.Max.Y; row++)
+			{
+				for (int col = tiles.Min.X; col < tiles.Max.X; col++)
+				{
+					const int region = TileRegionIds[col + TileRows * row];
+					if (region != INDEX_NONE && (regions.Num() == 0 || regions.Last() != region))
+						regions.AddUnique(region);
+				}
+			}
+		});
+}
+
+void FDungeonGrid::CopyRoomsFromCore()
+{
+	DungeonRooms.Reset();
+	DungeonRooms.Reserve(CoreLayout.rooms.size());
+	for (const DungeonCore::FSpaceData& coreRoom : CoreLayout.rooms)
+	{
+		FData& room = DungeonRooms.AddDefaulted_GetRef();
+		room.key = coreRoom.key;
+		room.width = coreRoom.width;
+		room.height = coreRoom.height;
+		room.left = coreRoom.left;
+		room.bottom = coreRoom.bottom;
+		room.seperation = ESeperation(coreRoom.seperation);
+		room.tilesSeperated = coreRoom.tilesSeperated;
+	}
+
+	DungeonCorridors.Reset();
+	DungeonCorridors.Reserve(CoreLayout.corridors.size());
+	for (const DungeonCore::FCorridorData& coreCorridor : CoreLayout.corridors)
+	{
+		FCorridor& corridor = DungeonCorridors.AddDefaulted_GetRef();
+		corridor.start = FIntVector(coreCorridor.startX, coreCorridor.startY, 0);
+		corridor.end = FIntVector(coreCorridor.endX, coreCorridor.endY, 0);
+		corridor.seperation = ESeperation(coreCorridor.seperation);
+		corridor.key = coreCorridor.key;
+	}
+}
+
+void FDungeonGrid::CopyRoomsToCore()
+{
+	//the core only gets the rooms and corridors of a loaded layout, it has no tree
+	for (const FData& room : DungeonRooms)
+	{
+		CoreLayout.rooms.emplace_back();
+		DungeonCore::FSpaceData& coreRoom = CoreLayout.rooms.back();
+		coreRoom.key = room.key;
+		coreRoom.width = room.width;
+		coreRoom.height = room.height;
+		coreRoom.left = room.left;
+		coreRoom.bottom = room.bottom;
+		coreRoom.seperation = DungeonCore::ESeperation(room.seperation);
+		coreRoom.tilesSeperated = room.tilesSeperated;
+	}
+	for (const FCorridor& corridor : DungeonCorridors)
+	{
+		CoreLayout.corridors.emplace_back();
+		DungeonCore::FCorridorData& coreCorridor = CoreLayout.corridors.back();
+		coreCorridor.startX = corridor.start.X;
+		coreCorridor.startY = corridor.start.Y;
+		coreCorridor.endX = corridor.end.X;
+		coreCorridor.endY = corridor.end.Y;
+		coreCorridor.seperation = DungeonCore::ESeperation(corridor.seperation);
+		coreCorridor.key = corridor.key;
+	}
+}
+
+void ADungeonSpace::ConstructDungeonGrid()
+{
+	DUNGEON_SCOPE_PHASE(ConstructDungeonGrid);
+	//the instance buffers are built with the layout, only the components are updated here on the game thread.
+	//The components keep their instances, the new layout overwrites their slots. The time-sliced construction and the streamed chunks start empty
+	CubeISMC->ClearInstances();
+	MinimapPlane->SetVisibility(false);
+	//a time-sliced construction of the last grid stops here
+	IsConstructing = false;
+	const bool isReusingSlots = !Grid->Settings.UseChunkStreaming && !Grid->Settings.UseTimeSlicedConstruction;
+	if (!isReusingSlots || Grid->Settings.UseClusteredMeshes)
+	{
+		FloorTileISMC->ClearInstances();
+		WallTileISMC->ClearInstances();
+		PillarTileISMC->ClearInstances();
+		//the regions own no slot until the components are built in order again
+		FloorSlots = FDungeonRegionSlots();
+		WallSlots = FDungeonRegionSlots();
+		PillarSlots = FDungeonRegionSlots();
+	}
+	if (!isReusingSlots || !Grid->Settings.UseClusteredMeshes)
+		ReleaseAllChunks();
+
+	//the merged boxes replace the bodies of the instances, the streamed chunks keep their own bodies
+	const bool isCollisionMerged = Grid->Settings.UseMergedCollision && !Grid->Settings.UseChunkStreaming;
+	const ECollisionEnabled::Type instanceCollision = isCollisionMerged ? ECollisionEnabled::NoCollision : ECollisionEnabled::QueryAndPhysics;
+	FloorTileISMC->SetCollisionEnabled(instanceCollision);
+	WallTileISMC->SetCollisionEnabled(instanceCollision);
+	PillarTileISMC->SetCollisionEnabled(instanceCollision);
+	if (isCollisionMerged)
+		CollisionComponent->SetBoxes(Grid->CollisionBoxes);
+	else if (CollisionComponent->GetNumBoxes() > 0)
+		CollisionComponent->SetBoxes(TArray<FBox>());
+
+	//with the tile navigation no body of the dungeon is gathered for the navmesh, the chunks copy the flag. The streamed chunks have no tile grid to navigate on
+	const bool isAffectingNavigation = !UseTileNavigation || Grid->Settings.UseChunkStreaming;
+	FloorTileISMC->SetCanEverAffectNavigation(isAffectingNavigation);
+	WallTileISMC->SetCanEverAffectNavigation(isAffectingNavigation);
+	PillarTileISMC->SetCanEverAffectNavigation(isAffectingNavigation);
+	CollisionComponent->SetCanEverAffectNavigation(isAffectingNavigation);
+
+	//the torches are few, they are added at once in every mode
+	ConstructTorches();
+
+	//Tick loads the chunks around the player
+	if (Grid->Settings.UseChunkStreaming)
+		return;
+
+	if (Grid->Settings.UseTimeSlicedConstruction)
+	{
+		//Tick adds the instances of the construction queue within the frame budget
+		ConstructionTileCursor = 0;
+		ConstructionInstancesTotal = Grid->NumConstructionInstances;
+		ConstructionInstancesRemaining = ConstructionInstancesTotal;
+		ConstructionLastFrameMs = 0.f;
+		IsConstructing = true;
+		return;
+	}
+
+	int numChanged = 0;
+	if (Grid->Settings.UseClusteredMeshes)
+	{
+		//every cluster gets its own components, so it is culled and rebuilt on its own. A cluster that had instances keeps its components
+		TMap<FIntPoint, FDungeonChunkMeshes> previousChunks = MoveTemp(LoadedChunks);
+		LoadedChunks.Reset();
+		for (int region = 0; region < Grid->InstanceRegions.Num(); region++)
+		{
+			const FIntVector first = Grid->RegionInstanceOffsets[region];
+			const FIntVector count = Grid->RegionInstanceOffsets[region + 1] - first;
+			if (count.X == 0)
+				continue;
+
+			const FIntPoint chunk = Grid->InstanceRegions[region].Min / FMath::Max(1, Grid->Settings.ChunkTiles);
+			FDungeonChunkMeshes meshes;
+			const FDungeonChunkMeshes* previousMeshes = previousChunks.Find(chunk);
+			if (previousMeshes != nullptr && previousMeshes->Floor != nullptr && previousMeshes->Floor->IsA<UHierarchicalInstancedStaticMeshComponent>())
+			{
+				meshes = *previousMeshes;
+				previousChunks.Remove(chunk);
+				meshes.Floor->SetCollisionEnabled(instanceCollision);
+				meshes.Wall->SetCollisionEnabled(instanceCollision);
+				meshes.Pillar->SetCollisionEnabled(instanceCollision);
+				meshes.Floor->SetCanEverAffectNavigation(isAffectingNavigation);
+				meshes.Wall->SetCanEverAffectNavigation(isAffectingNavigation);
+				meshes.Pillar->SetCanEverAffectNavigation(isAffectingNavigation);
+				//the cluster may have been hidden by the visibility culling of the last layout
+				meshes.Floor->SetVisibility(true);
+				meshes.Wall->SetVisibility(true);
+				meshes.Pillar->SetVisibility(true);
+			}
+			else
+			{
+				meshes = AcquireChunkMeshes();
+			}
+			numChanged += UpdateInstances(meshes.Floor, Grid->FloorInstances, first.X, count.X);
+			numChanged += UpdateInstances(meshes.Wall, Grid->WallInstances, first.Y, count.Y);
+			numChanged += UpdateInstances(meshes.Pillar, Grid->PillarInstances, first.Z, count.Z);
+			LoadedChunks.Add(chunk, meshes);
+		}
+
+		for (TPair<FIntPoint, FDungeonChunkMeshes>& previousChunk : previousChunks)
+		{
+			ReleaseChunk(previousChunk.Value);
+		}
+		SET_DWORD_STAT(STAT_DungeonChangedInstances, numChanged);
+		return;
+	}
+
+	numChanged += UpdateInstances(FloorTileISMC, Grid->FloorInstances, 0, Grid->FloorInstances.Transforms.Num());
+	numChanged += UpdateInstances(WallTileISMC, Grid->WallInstances, 0, Grid->WallInstances.Transforms.Num());
+	numChanged += UpdateInstances(PillarTileISMC, Grid->PillarInstances, 0, Grid->PillarInstances.Transforms.Num());
+	InitRegionSlots(FloorSlots, &FIntVector::X);
+	InitRegionSlots(WallSlots, &FIntVector::Y);
+	InitRegionSlots(PillarSlots, &FIntVector::Z);
+	SET_DWORD_STAT(STAT_DungeonChangedInstances, numChanged);
+}
+
+void FDungeonGrid::BuildObjectTemplates()
+{
+	const int halfTile = Settings.TileSize / 2;
+
+	//transform and custom data of every object relative to the bottom left of its tile, indexed by EDungeonObjectAlign.
+	//there are only a few orientations, so the quaternions are built once instead of once per instance
+	const FVector alignOffsets[] =
+	{
+		FVector(Settings.TileSize, halfTile, 0), //LEFT
+		FVector(0, halfTile, 0), //RIGHT
+		FVector(halfTile, Settings.TileSize, 0), //TOP
+		FVector(halfTile, 0, 0), //BOTTOM
+		FVector(halfTile, halfTile, 0), //CENTER
+		FVector(Settings.TileSize, Settings.TileSize, 0), //TOP_LEFT
+		FVector(0, Settings.TileSize, 0), //TOP_RIGHT
+		FVector(Settings.TileSize, 0, 0), //BOTTOM_LEFT
+		FVector(0, 0, 0), //BOTTOM_RIGHT
+	};
+	static_assert(UE_ARRAY_COUNT(alignOffsets) == UE_ARRAY_COUNT(ObjectTransforms), "Every EDungeonObjectAlign needs an offset");
+
+	const FDungeonObject floorObject = FDungeonObject();
+	ObjectTransforms[int(EDungeonObjectAlign::CENTER)] = FTransform(floorObject.rotation.Rotation().Quaternion(), alignOffsets[int(EDungeonObjectAlign::CENTER)], Settings.InstanceScale);
+	ObjectCustomData[int(EDungeonObjectAlign::CENTER)] = 0.7f;
+	for (int side = 0; side < 4; side++)
+	{
+		const FDungeonObject& wall = WallObjects[side];
+		ObjectTransforms[int(wall.objectAlignement)] = FTransform(wall.rotation.Rotation().Quaternion(), alignOffsets[int(wall.objectAlignement)], Settings.InstanceScale);
+		ObjectCustomData[int(wall.objectAlignement)] = wall.objectAlignement == EDungeonObjectAlign::LEFT || wall.objectAlignement == EDungeonObjectAlign::RIGHT ? 0.2f : 0.7f;
+
+		const FDungeonObject& pillar = PillarObjects[side];
+		ObjectTransforms[int(pillar.objectAlignement)] = FTransform(pillar.rotation.Rotation().Quaternion(), alignOffsets[int(pillar.objectAlignement)], Settings.InstanceScale);
+		ObjectCustomData[int(pillar.objectAlignement)] = 0.7f;
+	}
+}
+
+FIntVector FDungeonGrid::CountTileInstances(int tileIndex) const
+{
+	if (GetTileType(TileArray[tileIndex]) == ETileType::EMPTY)
+		return FIntVector::ZeroValue;
+
+	FIntVector count = CountObjects(GetTileObjects(tileIndex));
+	if (IsMergingFloors)
+		count.X = 0;
+	return count;
+}
+
+FIntVector FDungeonGrid::CountObjects(uint8 objects)
+{
+	return FIntVector(1, int(FMath::CountBits(objects & 0x0F)), int(FMath::CountBits(objects >> 4)));
+}
+
+void FDungeonGrid::WriteTileInstances(int tileIndex, FIntVector& offsets, FDungeonInstanceBuffer& floors, FDungeonInstanceBuffer& walls, FDungeonInstanceBuffer& pillars) const
+{
+	if (GetTileType(TileArray[tileIndex]) == ETileType::EMPTY)
+		return;
+
+	const FVector tileCorner((tileIndex % TileRows) * Settings.TileSize, (tileIndex / TileRows) * Settings.TileSize, 0);
+	WriteTileObjects(GetTileObjects(tileIndex), tileCorner, offsets, floors, walls, pillars, !IsMergingFloors);
+}
+
+uint8 FDungeonGrid::GetTileObjects(int tileIndex) const
+{
+	//the merged walls are built from the wall runs, only the pillars are left per tile
+	const uint8 objects = DungeonCore::ObjectLUT.Objects[TileNeighbourMasks[tileIndex]];
+	return IsMergingWalls ? objects & 0xF0 : objects;
+}
+
+void FDungeonGrid::WriteTileObjects(uint8 objects, const FVector& tileCorner, FIntVector& offsets, FDungeonInstanceBuffer& floors, FDungeonInstanceBuffer& walls, FDungeonInstanceBuffer& pillars, bool withFloor) const
+{
+	//default object is a floor
+	if (withFloor)
+	{
+		floors.Transforms[offsets.X] = ObjectTransforms[int(EDungeonObjectAlign::CENTER)];
+		floors.Transforms[offsets.X].AddToTranslation(tileCorner);
+		floors.CustomData[offsets.X] = ObjectCustomData[int(EDungeonObjectAlign::CENTER)];
+		offsets.X++;
+	}
+
+	for (int side = 0; side < 4; side++)
+	{
+		if (objects & (1 << side))
+		{
+			const int align = int(WallObjects[side].objectAlignement);
+			walls.Transforms[offsets.Y] = ObjectTransforms[align];
+			walls.Transforms[offsets.Y].AddToTranslation(tileCorner);
+			walls.CustomData[offsets.Y] = ObjectCustomData[align];
+			offsets.Y++;
+		}
+		if (objects & (1 << (side + 4)))
+		{
+			const int align = int(PillarObjects[side].objectAlignement);
+			pillars.Transforms[offsets.Z] = ObjectTransforms[align];
+			pillars.Transforms[offsets.Z].AddToTranslation(tileCorner);
+			pillars.CustomData[offsets.Z] = ObjectCustomData[align];
+			offsets.Z++;
+		}
+	}
+}
+
+void FDungeonGrid::BuildInstanceBuffers()
+{
+	DUNGEON_SCOPE_PHASE(BuildInstanceBuffers);
+	//the instances are built per region, a tile row or a cluster of ChunkTiles x ChunkTiles tiles. The instances of a region are contiguous
+	InstanceRegions.Reset();
+	if (Settings.UseClusteredMeshes)
+	{
+		const int clusterTiles = FMath::Max(1, Settings.ChunkTiles);
+		for (int row = 0; row < TileRows; row += clusterTiles)
+		{
+			for (int col = 0; col < TileRows; col += clusterTiles)
+			{
+				InstanceRegions.Emplace(col, row, FMath::Min(col + clusterTiles, TileRows), FMath::Min(row + clusterTiles, TileRows));
+			}
+		}
+	}
+	else
+	{
+		for (int row = 0; row < TileRows; row++)
+		{
+			InstanceRegions.Emplace(0, row, TileRows, row + 1);
+		}
+	}
+	const int numRegions = InstanceRegions.Num();
+
+	//count the instances of every region
+	RegionInstanceOffsets.SetNumUninitialized(numRegions + 1, false);
+	RegionInstanceOffsets[0] = FIntVector::ZeroValue;
+	ParallelFor(numRegions, [this](int32 region)
+		{
+			const FIntRect& tiles = InstanceRegions[region];
+			FIntVector count = FIntVector::ZeroValue;
+			for (int row = tiles.Min.Y; row < tiles.Max.Y; row++)
+			{
+				for (int tileIndex = row * TileRows + tiles.Min.X; tileIndex < row * TileRows + tiles.Max.X; tileIndex++)
+				{
+					count += CountTileInstances(tileIndex);
+				}
+			}
+			RegionInstanceOffsets[region + 1] = count;
+		});
+
+	for (int region = 0; region < numRegions; region++)
+	{
+		RegionInstanceOffsets[region + 1] += RegionInstanceOffsets[region];
+	}
+
+	FloorInstances.SetNum(RegionInstanceOffsets[numRegions].X);
+	WallInstances.SetNum(RegionInstanceOffsets[numRegions].Y);
+	PillarInstances.SetNum(RegionInstanceOffsets[numRegions].Z);
+
+	//every region writes its instances at its own offsets
+	ParallelFor(numRegions, [this](int32 region)
+		{
+			const FIntRect& tiles = InstanceRegions[region];
+			FIntVector offsets = RegionInstanceOffsets[region];
+			for (int row = tiles.Min.Y; row < tiles.Max.Y; row++)
+			{
+				for (int tileIndex = row * TileRows + tiles.Min.X; tileIndex < row * TileRows + tiles.Max.X; tileIndex++)
+				{
+					WriteTileInstances(tileIndex, offsets, FloorInstances, WallInstances, PillarInstances);
+				}
+			}
+		});
+
+	if (IsMergingFloors)
+		BuildFloorRects();
+	if (IsMergingWalls)
+		BuildWallRunInstances();
+}
+
+void FDungeonGrid::BuildFloorRects()
+{
+	DUNGEON_SCOPE_PHASE(BuildFloorRects);
+	//floors are merged within every cluster, so the clusters keep their own instances. Without clusters the whole grid is one region
+	const int numRegions = InstanceRegions.Num();
+	RegionFloorRects.SetNum(numRegions);
+	ParallelFor(Settings.UseClusteredMeshes ? numRegions : 1, [this](int32 region)
+		{
+			const FIntRect bounds = Settings.UseClusteredMeshes ? InstanceRegions[region] : FIntRect(0, 0, TileRows, TileRows);
+			TArray<FIntRect>& floorRects = RegionFloorRects[region];
+			floorRects.Reset();
+
+			//greedy: grow every rectangle along x first, then along y while the whole width has the same tile type
+			const int width = bounds.Width();
+			TBitArray<> isMerged(false, bounds.Area());
+			for (int row = bounds.Min.Y; row < bounds.Max.Y; row++)
+			{
+				for (int col = bounds.Min.X; col < bounds.Max.X; col++)
+				{
+					const uint8 tile = TileArray[col + TileRows * row];
+					if (tile == uint8(ETileType::EMPTY) || isMerged[(col - bounds.Min.X) + width * (row - bounds.Min.Y)])
+						continue;
+
+					int maxCol = col + 1;
+					while (maxCol < bounds.Max.X && TileArray[maxCol + TileRows * row] == tile && !isMerged[(maxCol - bounds.Min.X) + width * (row - bounds.Min.Y)])
+					{
+						maxCol++;
+					}
+
+					int maxRow = row + 1;
+					for (; maxRow < bounds.Max.Y; maxRow++)
+					{
+						bool isRowMatching = true;
+						for (int rectCol = col; rectCol < maxCol && isRowMatching; rectCol++)
+						{
+							isRowMatching = TileArray[rectCol + TileRows * maxRow] == tile && !isMerged[(rectCol - bounds.Min.X) + width * (maxRow - bounds.Min.Y)];
+						}
+						if (!isRowMatching)
+							break;
+					}
+
+					for (int rectRow = row; rectRow < maxRow; rectRow++)
+					{
+						isMerged.SetRange((col - bounds.Min.X) + width * (rectRow - bounds.Min.Y), maxCol - col, true);
+					}
+					floorRects.Emplace(col, row, maxCol, maxRow);
+				}
+			}
+		});
+	for (int region = Settings.UseClusteredMeshes ? numRegions : 1; region < numRegions; region++)
+	{
+		RegionFloorRects[region].Reset();
+	}
+
+	//the floor offsets of the regions are the prefix sum of their rectangles
+	for (int region = 0; region < numRegions; region++)
+	{
+		RegionInstanceOffsets[region + 1].X = RegionInstanceOffsets[region].X + RegionFloorRects[region].Num();
+	}
+
+	FloorInstances.NumCustomData = 3;
+	FloorInstances.SetNum(RegionInstanceOffsets[numRegions].X);
+	const FTransform& floorTemplate = ObjectTransforms[int(EDungeonObjectAlign::CENTER)];
+	ParallelFor(numRegions, [this, &floorTemplate](int32 region)
+		{
+			int offset = RegionInstanceOffsets[region].X;
+			for (const FIntRect& rect : RegionFloorRects[region])
+			{
+				//the floor mesh is scaled over the rectangle, the material tiles its UVs with the size in tiles (custom data 1 and 2)
+				const FVector size(rect.Width(), rect.Height(), 1.f);
+				FTransform& transform = FloorInstances.Transforms[offset];
+				transform = floorTemplate;
+				transform.SetScale3D(floorTemplate.GetScale3D() * floorTemplate.GetRotation().UnrotateVector(size).GetAbs());
+				transform.SetTranslation(FVector((rect.Min.X + size.X * 0.5f) * Settings.TileSize, (rect.Min.Y + size.Y * 0.5f) * Settings.TileSize, floorTemplate.GetTranslation().Z));
+
+				float* customData = FloorInstances.CustomData.GetData() + offset * FloorInstances.NumCustomData;
+				customData[0] = ObjectCustomData[int(EDungeonObjectAlign::CENTER)];
+				customData[1] = size.X;
+				customData[2] = size.Y;
+				offset++;
+			}
+		});
+}
+
+void FDungeonGrid::BuildWallRunInstances()
+{
+	DUNGEON_SCOPE_PHASE(BuildWallRunInstances);
+	//the runs are cut at the cluster borders, so every cluster keeps its own walls. Without clusters all pieces belong to the first region
+	const int numRegions = InstanceRegions.Num();
+	const int clusterTiles = FMath::Max(1, Settings.ChunkTiles);
+	const int clusterRows = FMath::DivideAndRoundUp(TileRows, clusterTiles);
+	RegionWallPieces.SetNum(numRegions);
+	for (TArray<FDungeonWallRun>& wallPieces : RegionWallPieces)
+	{
+		wallPieces.Reset();
+	}
+
+	for (const FDungeonWallRun& wallRun : WallRuns)
+	{
+		const bool isAlongX = wallRun.Side == EDungeonObjectAlign::TOP || wallRun.Side == EDungeonObjectAlign::BOTTOM;
+		const FIntPoint runStep = isAlongX ? FIntPoint(1, 0) : FIntPoint(0, 1);
+		int position = 0;
+		while (position < wallRun.Length)
+		{
+			FDungeonWallRun piece = wallRun;
+			piece.StartTile = wallRun.StartTile + runStep * position;
+			piece.Length = wallRun.Length - position;
+			if (Settings.UseClusteredMeshes)
+			{
+				const int alongRun = isAlongX ? piece.StartTile.X : piece.StartTile.Y;
+				piece.Length = FMath::Min(piece.Length, clusterTiles - alongRun % clusterTiles);
+			}
+			if (Settings.WallMergeMode == EWallMergeMode::MODULAR)
+			{
+				//the longest module that fits, halved until it does, so a few fixed lengths cover every run
+				int moduleLength = FMath::Max(1, Settings.WallModuleTiles);
+				while (moduleLength > piece.Length)
+				{
+					moduleLength = FMath::Max(1, moduleLength / 2);
+				}
+				piece.Length = moduleLength;
+			}
+
+			const int region = Settings.UseClusteredMeshes ? piece.StartTile.X / clusterTiles + clusterRows * (piece.StartTile.Y / clusterTiles) : 0;
+			RegionWallPieces[region].Add(piece);
+			position += piece.Length;
+		}
+	}
+
+	//the wall offsets of the regions are the prefix sum of their pieces
+	for (int region = 0; region < numRegions; region++)
+	{
+		RegionInstanceOffsets[region + 1].Y = RegionInstanceOffsets[region].Y + RegionWallPieces[region].Num();
+	}
+
+	WallInstances.NumCustomData = 2;
+	WallInstances.SetNum(RegionInstanceOffsets[numRegions].Y);
+	ParallelFor(numRegions, [this](int32 region)
+		{
+			int offset = RegionInstanceOffsets[region].Y;
+			for (const FDungeonWallRun& piece : RegionWallPieces[region])
+			{
+				//the wall mesh is stretched along the run, the material tiles its UVs with the length in tiles (custom data 1)
+				const int align = int(WallObjects[int(piece.Side)].objectAlignement);
+				const FTransform& wallTemplate = ObjectTransforms[align];
+				const FVector runDirection = piece.Side == EDungeonObjectAlign::TOP || piece.Side == EDungeonObjectAlign::BOTTOM ? FVector(1.f, 0.f, 0.f) : FVector(0.f, 1.f, 0.f);
+				FTransform& transform = WallInstances.Transforms[offset];
+				transform = wallTemplate;
+				transform.SetScale3D(wallTemplate.GetScale3D() * (FVector::OneVector + wallTemplate.GetRotation().UnrotateVector(runDirection).GetAbs() * (piece.Length - 1)));
+				transform.AddToTranslation(FVector(piece.StartTile.X * Settings.TileSize, piece.StartTile.Y * Settings.TileSize, 0.f) + runDirection * ((piece.Length - 1) * Settings.TileSize * 0.5f));
+
+				float* customData = WallInstances.CustomData.GetData() + offset * WallInstances.NumCustomData;
+				customData[0] = ObjectCustomData[align];
+				customData[1] = piece.Length;
+				offset++;
+			}
+		});
+}
+
+void FDungeonGrid::BuildConstructionQueue()
+{
+	//rooms and loose corridor tiles sorted on their distance to the player, rooms are stored as -(room index + 1)
+	ConstructionItems.Reset();
+	for (int i = 0; i < DungeonRooms.Num(); i++)
+	{
+		const FData& room = DungeonRooms[i];
+		const FVector2D closestPoint(FMath::Clamp<float>(Settings.ConstructionOrigin.X, room.left, room.left + room.width), FMath::Clamp<float>(Settings.ConstructionOrigin.Y, room.bottom, room.bottom + room.height));
+		ConstructionItems.Emplace(FVector2D::DistSquared(closestPoint, FVector2D(Settings.ConstructionOrigin)), -(i + 1));
+	}
+	for (int tileIndex = 0; tileIndex < TileArray.Num(); tileIndex++)
+	{
+		if (GetTileType(TileArray[tileIndex]) == ETileType::CORRIDOR)
+		{
+			const FVector2D tileCenter((tileIndex % TileRows + 0.5f) * Settings.TileSize, (tileIndex / TileRows + 0.5f) * Settings.TileSize);
+			ConstructionItems.Emplace(FVector2D::DistSquared(tileCenter, FVector2D(Settings.ConstructionOrigin)), tileIndex);
+		}
+	}
+	ConstructionItems.Sort([](const TPair<float, int>& a, const TPair<float, int>& b) { return a.Key < b.Key; });
+
+	ConstructionTileQueue.Reset();
+	NumConstructionInstances = 0;
+	auto enqueueTile = [this](int tileIndex)
+	{
+		const FIntVector count = CountTileInstances(tileIndex);
+		ConstructionTileQueue.Add(tileIndex);
+		NumConstructionInstances += count.X + count.Y + count.Z;
+	};
+
+	for (const TPair<float, int>& item : ConstructionItems)
+	{
+		if (item.Value >= 0)
+		{
+			enqueueTile(item.Value);
+			continue;
+		}
+
+		const FData& room = DungeonRooms[-item.Value - 1];
+		const int firstCol = FMath::Max(0, room.left / Settings.TileSize);
+		const int lastCol = FMath::Min(TileRows, (room.left + room.width) / Settings.TileSize);
+		const int firstRow = FMath::Max(0, room.bottom / Settings.TileSize);
+		const int lastRow = FMath::Min(TileRows, (room.bottom + room.height) / Settings.TileSize);
+		for (int row = firstRow; row < lastRow; row++)
+		{
+			for (int col = firstCol; col < lastCol; col++)
+			{
+				enqueueTile(col + TileRows * row);
+			}
+		}
+	}
+}
+
+void ADungeonSpace::ConstructNextSlice()
+{
+	DUNGEON_SCOPE_PHASE(ConstructNextSlice);
+	const double startTime = FPlatformTime::Seconds();
+
+	//the instances of this frame are limited by the measured cost of the previous frames, adding them dominates the time
+	const int maxInstances = FMath::Max(1, FMath::FloorToInt(ConstructionBudgetMs / FMath::Max(ConstructionMsPerInstance, KINDA_SMALL_NUMBER)));
+
+	SliceFloorInstances.SetNum(0);
+	SliceWallInstances.SetNum(0);
+	SlicePillarInstances.SetNum(0);
+	int sliceInstances = 0;
+	while (ConstructionTileCursor < Grid->ConstructionTileQueue.Num() && sliceInstances < maxInstances)
+	{
+		const int tileIndex = Grid->ConstructionTileQueue[ConstructionTileCursor++];
+		FIntVector offsets(SliceFloorInstances.Transforms.Num(), SliceWallInstances.Transforms.Num(), SlicePillarInstances.Transforms.Num());
+		const FIntVector count = Grid->CountTileInstances(tileIndex);
+		SliceFloorInstances.SetNum(offsets.X + count.X);
+		SliceWallInstances.SetNum(offsets.Y + count.Y);
+		SlicePillarInstances.SetNum(offsets.Z + count.Z);
+		Grid->WriteTileInstances(tileIndex, offsets, SliceFloorInstances, SliceWallInstances, SlicePillarInstances);
+		sliceInstances += count.X + count.Y + count.Z;
+	}
+
+	CommitInstances(FloorTileISMC, SliceFloorInstances);
+	CommitInstances(WallTileISMC, SliceWallInstances);
+	CommitInstances(PillarTileISMC, SlicePillarInstances);
+
+	ConstructionLastFrameMs = float((FPlatformTime::Seconds() - startTime) * 1000.0);
+	ConstructionInstancesRemaining -= sliceInstances;
+	if (sliceInstances > 0)
+		ConstructionMsPerInstance = FMath::Lerp(ConstructionMsPerInstance, ConstructionLastFrameMs / sliceInstances, 0.5f);
+
+	UpdateInstanceStats();
+	if (ConstructionTileCursor >= Grid->ConstructionTileQueue.Num())
+	{
+		IsConstructing = false;
+		OnDungeonGenerated.Broadcast();
+	}
+}
+
+void FDungeonGrid::BuildTileRects()
+{
+	//tile rectangles of the rooms and corridors clipped to the grid, max is exclusive
+	const FIntRect grid(0, 0, TileRows, TileRows);
+	RoomTileRects.Reset(DungeonRooms.Num());
+	for (const FData& room : DungeonRooms)
+	{
+		FIntRect& rect = RoomTileRects.Emplace_GetRef(room.left / Settings.TileSize, room.bottom / Settings.TileSize, (room.left + room.width) / Settings.TileSize, (room.bottom + room.height) / Settings.TileSize);
+		rect.Clip(grid);
+	}
+	CorridorTileRects.Reset(DungeonCorridors.Num());
+	for (const FCorridor& corridor : DungeonCorridors)
+	{
+		FIntRect& rect = corridor.seperation == ESeperation::VERTICAL //vertical seperation = horizontal corridor
+			? CorridorTileRects.Emplace_GetRef(corridor.start.X / Settings.TileSize, corridor.start.Y / Settings.TileSize, FMath::Max(corridor.start.X, corridor.end.X + Settings.TileSize) / Settings.TileSize, corridor.start.Y / Settings.TileSize + 1)
+			: CorridorTileRects.Emplace_GetRef(corridor.start.X / Settings.TileSize, corridor.end.Y / Settings.TileSize, corridor.start.X / Settings.TileSize + 1, FMath::Max(corridor.end.Y, corridor.start.Y + Settings.TileSize) / Settings.TileSize);
+		rect.Clip(grid);
+	}
+}
+
+void FDungeonGrid::ExtractWallRuns(TArray<FDungeonWallRun>& wallRuns) const
+{
+	//a tile has a wall on a side when the neighbour on that side is empty, walls on the same line of neighbouring tiles form a run.
+	//TOP and BOTTOM walls run along x, LEFT and RIGHT walls along y
+	wallRuns.Reset();
+	for (int side = 0; side < 4; side++)
+	{
+		const bool isAlongX = EDungeonObjectAlign(side) == EDungeonObjectAlign::TOP || EDungeonObjectAlign(side) == EDungeonObjectAlign::BOTTOM;
+		for (int line = 0; line < TileRows; line++)
+		{
+			int runStart = INDEX_NONE;
+			for (int step = 0; step <= TileRows; step++)
+			{
+				bool hasWall = false;
+				if (step < TileRows)
+				{
+					const int tileIndex = isAlongX ? step + TileRows * line : line + TileRows * step;
+					hasWall = TileArray[tileIndex] != uint8(ETileType::EMPTY) && !(TileNeighbourMasks[tileIndex] & (1 << side));
+				}
+
+				if (hasWall && runStart == INDEX_NONE)
+				{
+					runStart = step;
+				}
+				else if (!hasWall && runStart != INDEX_NONE)
+				{
+					FDungeonWallRun& wallRun = wallRuns.AddDefaulted_GetRef();
+					wallRun.StartTile = isAlongX ? FIntPoint(runStart, line) : FIntPoint(line, runStart);
+					wallRun.Length = step - runStart;
+					wallRun.Side = EDungeonObjectAlign(side);
+					runStart = INDEX_NONE;
+				}
+			}
+		}
+	}
+}
+
+void FDungeonGrid::BuildCollisionBoxes()
+{
+	DUNGEON_SCOPE_PHASE(BuildCollisionBoxes);
+	//floors are one box per room and corridor below the tiles, overlapping boxes are cheaper than splitting them
+	CollisionBoxes.Reset();
+	for (const TArray<FIntRect>* tileRects : { &RoomTileRects, &CorridorTileRects })
+	{
+		for (const FIntRect& rect : *tileRects)
+		{
+			if (rect.Area() > 0)
+				CollisionBoxes.Emplace(FVector(rect.Min.X * Settings.TileSize, rect.Min.Y * Settings.TileSize, -Settings.FloorCollisionThickness), FVector(rect.Max.X * Settings.TileSize, rect.Max.Y * Settings.TileSize, 0.f));
+		}
+	}
+
+	//walls are one box per straight run, centered on the tile edge
+	const float halfWidth = Settings.WallTileWidth * 0.5f;
+	for (const FDungeonWallRun& wallRun : WallRuns)
+	{
+		const FIntPoint endTile = wallRun.StartTile + (wallRun.Side == EDungeonObjectAlign::TOP || wallRun.Side == EDungeonObjectAlign::BOTTOM ? FIntPoint(wallRun.Length, 1) : FIntPoint(1, wallRun.Length));
+		FVector min(wallRun.StartTile.X * Settings.TileSize, wallRun.StartTile.Y * Settings.TileSize, 0.f);
+		FVector max(endTile.X * Settings.TileSize, endTile.Y * Settings.TileSize, Settings.WallCollisionHeight);
+		switch (wallRun.Side)
+		{
+		case EDungeonObjectAlign::LEFT:
+			min.X = max.X - halfWidth;
+			max.X += halfWidth;
+			break;
+		case EDungeonObjectAlign::RIGHT:
+			max.X = min.X + halfWidth;
+			min.X -= halfWidth;
+			break;
+		case EDungeonObjectAlign::TOP:
+			min.Y = max.Y - halfWidth;
+			max.Y += halfWidth;
+			break;
+		default:
+			max.Y = min.Y + halfWidth;
+			min.Y -= halfWidth;
+			break;
+		}
+		CollisionBoxes.Emplace(min, max);
+	}
+}
+
+void FDungeonGrid::BuildChunkIndex()
+{
+	DUNGEON_SCOPE_PHASE(BuildChunkIndex);
+	ChunkRows = FMath::DivideAndRoundUp(TileRows, FMath::Max(1, Settings.ChunkTiles));
+	ChunkRoomLists.Reset();
+	ChunkRoomLists.SetNum(ChunkRows * ChunkRows);
+	ChunkCorridorLists.Reset();
+	ChunkCorridorLists.SetNum(ChunkRows * ChunkRows);
+
+	BuildTileRects();
+
+	//every chunk lists the rooms and corridors that touch it or its apron of one tile
+	auto addToChunks = [this](const FIntRect& tileRect, int index, TArray<TArray<int>>& chunkLists)
+	{
+		const int minCol = FMath::Max(0, (tileRect.Min.X - 1) / Settings.ChunkTiles);
+		const int minRow = FMath::Max(0, (tileRect.Min.Y - 1) / Settings.ChunkTiles);
+		const int maxCol = FMath::Min(ChunkRows - 1, tileRect.Max.X / Settings.ChunkTiles);
+		const int maxRow = FMath::Min(ChunkRows - 1, tileRect.Max.Y / Settings.ChunkTiles);
+		for (int row = minRow; row <= maxRow; row++)
+		{
+			for (int col = minCol; col <= maxCol; col++)
+			{
+				chunkLists[col + ChunkRows * row].Add(index);
+			}
+		}
+	};
+	for (int i = 0; i < RoomTileRects.Num(); i++)
+	{
+		addToChunks(RoomTileRects[i], i, ChunkRoomLists);
+	}
+	for (int i = 0; i < CorridorTileRects.Num(); i++)
+	{
+		addToChunks(CorridorTileRects[i], i, ChunkCorridorLists);
+	}
+}
+
+void FDungeonGrid::RasterizeChunk(const FIntPoint& chunk, TArray<uint8>& tiles) const
+{
+	//the chunk is rasterized with an apron of one tile, so the walls on its border match the neighbouring chunks
+	const int apronRows = Settings.ChunkTiles + 2;
+	const FIntPoint origin = chunk * Settings.ChunkTiles - FIntPoint(1, 1);
+	FIntRect bounds(origin, origin + FIntPoint(apronRows, apronRows));
+	bounds.Clip(FIntRect(0, 0, TileRows, TileRows));
+	tiles.Init(uint8(ETileType::EMPTY), apronRows * apronRows);
+
+	auto fillRect = [&tiles, &bounds, &origin, apronRows](FIntRect rect, ETileType tileType)
+	{
+		rect.Clip(bounds);
+		for (int row = rect.Min.Y; row < rect.Max.Y; row++)
+		{
+			uint8* rowTiles = tiles.GetData() + (row - origin.Y) * apronRows - origin.X;
+			for (int col = rect.Min.X; col < rect.Max.X; col++)
+			{
+				//corridors only fill the tiles that are not part of a room
+				if (tileType == ETileType::ROOM || rowTiles[col] == uint8(ETileType::EMPTY))
+					rowTiles[col] = uint8(tileType);
+			}
+		}
+	};
+
+	const int chunkIndex = chunk.X + ChunkRows * chunk.Y;
+	for (int room : ChunkRoomLists[chunkIndex])
+	{
+		fillRect(RoomTileRects[room], ETileType::ROOM);
+	}
+	for (int corridor : ChunkCorridorLists[chunkIndex])
+	{
+		fillRect(CorridorTileRects[corridor], ETileType::CORRIDOR);
+	}
+}
+
+void ADungeonSpace::LoadChunk(const FIntPoint& chunk)
+{
+	DUNGEON_SCOPE_PHASE(LoadChunk);
+	Grid->RasterizeChunk(chunk, ChunkTileScratch);
+	const int apronRows = Grid->Settings.ChunkTiles + 2;
+	ChunkOccupancy.SetNumUninitialized(ChunkTileScratch.Num(), false);
+	for (int i = 0; i < ChunkTileScratch.Num(); i++)
+	{
+		ChunkOccupancy[i] = ChunkTileScratch[i] != uint8(ETileType::EMPTY);
+	}
+
+	SliceFloorInstances.SetNum(0);
+	SliceWallInstances.SetNum(0);
+	SlicePillarInstances.SetNum(0);
+	const int numCols = FMath::Min(Grid->Settings.ChunkTiles, Grid->TileRows - chunk.X * Grid->Settings.ChunkTiles);
+	const int numRows = FMath::Min(Grid->Settings.ChunkTiles, Grid->TileRows - chunk.Y * Grid->Settings.ChunkTiles);
+	for (int row = 0; row < numRows; row++)
+	{
+		const uint8* bot = ChunkOccupancy.GetData() + row * apronRows + 1;
+		const uint8* mid = bot + apronRows;
+		const uint8* top = mid + apronRows;
+		for (int col = 0; col < numCols; col++)
+		{
+			if (!mid[col])
+				continue;
+
+			const uint8 objects = DungeonCore::ObjectLUT.Objects[DungeonCore::GetNeighbourMask(bot, mid, top, col)];
+			const FVector tileCorner((chunk.X * Grid->Settings.ChunkTiles + col) * Grid->Settings.TileSize, (chunk.Y * Grid->Settings.ChunkTiles + row) * Grid->Settings.TileSize, 0);
+			FIntVector offsets(SliceFloorInstances.Transforms.Num(), SliceWallInstances.Transforms.Num(), SlicePillarInstances.Transforms.Num());
+			const FIntVector count = FDungeonGrid::CountObjects(objects);
+			SliceFloorInstances.SetNum(offsets.X + count.X);
+			SliceWallInstances.SetNum(offsets.Y + count.Y);
+			SlicePillarInstances.SetNum(offsets.Z + count.Z);
+			Grid->WriteTileObjects(objects, tileCorner, offsets, SliceFloorInstances, SliceWallInstances, SlicePillarInstances);
+		}
+	}
+
+	//chunks without tiles are still tracked, so they are not rasterized again every frame
+	FDungeonChunkMeshes meshes;
+	if (SliceFloorInstances.Transforms.Num() > 0)
+	{
+		meshes = AcquireChunkMeshes();
+		CommitInstances(meshes.Floor, SliceFloorInstances);
+		CommitInstances(meshes.Wall, SliceWallInstances);
+		CommitInstances(meshes.Pillar, SlicePillarInstances);
+	}
+	LoadedChunks.Add(chunk, meshes);
+	UpdateInstanceStats();
+}
+
+void ADungeonSpace::ReleaseChunk(FDungeonChunkMeshes& meshes)
+{
+	if (meshes.Floor == nullptr)
+		return;
+
+	meshes.Floor->ClearInstances();
+	meshes.Wall->ClearInstances();
+	meshes.Pillar->ClearInstances();
+	//a culled cluster goes back to the pool hidden
+	meshes.Floor->SetVisibility(true);
+	meshes.Wall->SetVisibility(true);
+	meshes.Pillar->SetVisibility(true);
+	ChunkMeshPool.Add(meshes);
+}
+
+void ADungeonSpace::ReleaseAllChunks()
+{
+	for (TPair<FIntPoint, FDungeonChunkMeshes>& loadedChunk : LoadedChunks)
+	{
+		ReleaseChunk(loadedChunk.Value);
+	}
+	LoadedChunks.Reset();
+}
+
+FDungeonChunkMeshes ADungeonSpace::AcquireChunkMeshes()
+{
+	//pooled components of the wrong class are left from before the clustered meshes were toggled
+	const UClass* meshClass = Grid->Settings.UseClusteredMeshes ? UHierarchicalInstancedStaticMeshComponent::StaticClass() : UInstancedStaticMeshComponent::StaticClass();
+	while (ChunkMeshPool.Num() > 0)
+	{
+		FDungeonChunkMeshes meshes = ChunkMeshPool.Pop(false);
+		if (meshes.Floor->GetClass() == meshClass)
+		{
+			meshes.Floor->SetCollisionEnabled(FloorTileISMC->GetCollisionEnabled());
+			meshes.Wall->SetCollisionEnabled(WallTileISMC->GetCollisionEnabled());
+			meshes.Pillar->SetCollisionEnabled(PillarTileISMC->GetCollisionEnabled());
+			meshes.Floor->SetCanEverAffectNavigation(FloorTileISMC->CanEverAffectNavigation());
+			meshes.Wall->SetCanEverAffectNavigation(WallTileISMC->CanEverAffectNavigation());
+			meshes.Pillar->SetCanEverAffectNavigation(PillarTileISMC->CanEverAffectNavigation());
+			return meshes;
+		}
+	}
+	return CreateChunkMeshes();
+}
+
+FDungeonChunkMeshes ADungeonSpace::CreateChunkMeshes()
+{
+	//clustered components sort their instances into a tree, so culling skips the parts of a chunk that are out of view
+	UClass* meshClass = Grid->Settings.UseClusteredMeshes ? UHierarchicalInstancedStaticMeshComponent::StaticClass() : UInstancedStaticMeshComponent::StaticClass();
+	auto createMesh = [this, meshClass](UInstancedStaticMeshComponent* meshTemplate)
+	{
+		//copies the mesh, materials, culling and collision of the component that is set up in the editor
+		UInstancedStaticMeshComponent* mesh = NewObject<UInstancedStaticMeshComponent>(this, meshClass, NAME_None, RF_Transient);
+		mesh->SetStaticMesh(meshTemplate->GetStaticMesh());
+		for (int i = 0; i < meshTemplate->GetNumMaterials(); i++)
+		{
+			mesh->SetMaterial(i, meshTemplate->GetMaterial(i));
+		}
+		mesh->NumCustomDataFloats = meshTemplate->NumCustomDataFloats;
+		mesh->InstanceStartCullDistance = meshTemplate->InstanceStartCullDistance;
+		mesh->InstanceEndCullDistance = meshTemplate->InstanceEndCullDistance;
+		mesh->SetMobility(meshTemplate->Mobility);
+		mesh->SetCollisionProfileName(meshTemplate->GetCollisionProfileName());
+		mesh->SetCollisionEnabled(meshTemplate->GetCollisionEnabled());
+		mesh->SetCanEverAffectNavigation(meshTemplate->CanEverAffectNavigation());
+		mesh->SetupAttachment(GetRootComponent());
+		mesh->RegisterComponent();
+		ChunkMeshComponents.Add(mesh);
+		return mesh;
+	};
+
+	FDungeonChunkMeshes meshes;
+	meshes.Floor = createMesh(FloorTileISMC);
+	meshes.Wall = createMesh(WallTileISMC);
+	meshes.Pillar = createMesh(PillarTileISMC);
+	return meshes;
+}
+
+void ADungeonSpace::UpdateChunkStreaming()
+{
+	APawn* playerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+	if (playerPawn == nullptr || Grid->ChunkRows == 0)
+		return;
+
+	const FVector localLocation = GetActorTransform().InverseTransformPosition(playerPawn->GetActorLocation());
+	const float chunkSize = float(Grid->Settings.TileSize) * Grid->Settings.ChunkTiles;
+	const FIntPoint playerChunk(FMath::FloorToInt(localLocation.X / chunkSize), FMath::FloorToInt(localLocation.Y / chunkSize));
+	auto chunkDistance = [&playerChunk](const FIntPoint& chunk)
+	{
+		return FMath::Max(FMath::Abs(chunk.X - playerChunk.X), FMath::Abs(chunk.Y - playerChunk.Y));
+	};
+
+	//evict the chunks that are too far behind, their components are reused for new chunks
+	const int evictRadius = FMath::Max(ChunkEvictRadius, ChunkLoadRadius);
+	const int numChunks = LoadedChunks.Num();
+	for (auto it = LoadedChunks.CreateIterator(); it; ++it)
+	{
+		if (chunkDistance(it.Key()) > evictRadius)
+		{
+			ReleaseChunk(it.Value());
+			it.RemoveCurrent();
+		}
+	}
+	if (LoadedChunks.Num() != numChunks)
+		UpdateInstanceStats();
+
+	//load the missing chunks ring by ring, nearest first, a few per frame
+	int numLoaded = 0;
+	for (int ring = 0; ring <= ChunkLoadRadius && numLoaded < ChunksLoadedPerFrame; ring++)
+	{
+		for (int y = -ring; y <= ring && numLoaded < ChunksLoadedPerFrame; y++)
+		{
+			for (int x = -ring; x <= ring && numLoaded < ChunksLoadedPerFrame; x++)
+			{
+				const FIntPoint chunk = playerChunk + FIntPoint(x, y);
+				if (chunkDistance(chunk) != ring || chunk.X < 0 || chunk.Y < 0 || chunk.X >= Grid->ChunkRows || chunk.Y >= Grid->ChunkRows || LoadedChunks.Contains(chunk))
+					continue;
+
+				LoadChunk(chunk);
+				numLoaded++;
+			}
+		}
+	}
+}
+
+float ADungeonSpace::GetConstructionProgress() const
+{
+	if (ConstructionInstancesTotal <= 0)
+		return IsDungeonGenerated ? 1.f : 0.f;
+
+	return 1.f - float(ConstructionInstancesRemaining) / ConstructionInstancesTotal;
+}
+
+void ADungeonSpace::CommitInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances)
+{
+	CommitInstances(meshISMC, instances, 0, instances.Transforms.Num());
+}
+
+void ADungeonSpace::CommitInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int firstInstance, int numInstances)
+{
+	if (meshISMC == nullptr || numInstances == 0)
+		return;
+
+	//an empty component can still grow its custom data, e.g. for the tiling of the merged floors
+	if (meshISMC->GetInstanceCount() == 0 && meshISMC->NumCustomDataFloats < instances.NumCustomData)
+		meshISMC->SetNumCustomDataFloats(instances.NumCustomData);
+
+	const int firstInstanceIndex = meshISMC->GetInstanceCount();
+	if (firstInstance == 0 && numInstances == instances.Transforms.Num())
+	{
+		meshISMC->AddInstances(instances.Transforms, false);
+	}
+	else
+	{
+		CommitTransforms.Reset(numInstances);
+		CommitTransforms.Append(instances.Transforms.GetData() + firstInstance, numInstances);
+		meshISMC->AddInstances(CommitTransforms, false);
+	}
+
+	//write the custom data of the whole batch directly and mark the render state dirty once
+	const int numCustomDataFloats = meshISMC->NumCustomDataFloats;
+	const int numValues = FMath::Min(numCustomDataFloats, instances.NumCustomData);
+	if (numCustomDataFloats > 0 && meshISMC->PerInstanceSMCustomData.Num() >= (firstInstanceIndex + numInstances) * numCustomDataFloats)
+	{
+		float* customData = meshISMC->PerInstanceSMCustomData.GetData() + firstInstanceIndex * numCustomDataFloats;
+		for (int i = 0; i < numInstances; i++)
+		{
+			for (int value = 0; value < numValues; value++)
+			{
+				customData[i * numCustomDataFloats + value] = instances.CustomData[(firstInstance + i) * instances.NumCustomData + value];
+			}
+		}
+
+		//the cluster tree copies the custom data when it is built, so it is rebuilt with the written values
+		if (UHierarchicalInstancedStaticMeshComponent* meshHISMC = Cast<UHierarchicalInstancedStaticMeshComponent>(meshISMC))
+			meshHISMC->BuildTreeIfOutdated(true, true);
+		else
+			meshISMC->MarkRenderStateDirty();
+	}
+}
+
+int ADungeonSpace::UpdateInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int firstInstance, int numInstances)
+{
+	if (meshISMC == nullptr)
+		return 0;
+
+	//the slots the component has are kept, runs of slots that differ are overwritten in one batch each
+	if (numInstances > 0 && meshISMC->NumCustomDataFloats < instances.NumCustomData)
+		meshISMC->SetNumCustomDataFloats(instances.NumCustomData);
+	const int numExisting = meshISMC->GetInstanceCount();
+	const int numShared = FMath::Min(numExisting, numInstances);
+	const int numCustomDataFloats = meshISMC->NumCustomDataFloats;
+	const int numValues = meshISMC->PerInstanceSMCustomData.Num() >= numShared * numCustomDataFloats ? FMath::Min(numCustomDataFloats, instances.NumCustomData) : 0;
+	int numChanged = 0;
+	int runStart = INDEX_NONE;
+	for (int i = 0; i <= numShared; i++)
+	{
+		bool isChanged = false;
+		if (i < numShared)
+		{
+			const int instanceIndex = firstInstance + i;
+			isChanged = !meshISMC->PerInstanceSMData[i].Transform.Equals(instances.Transforms[instanceIndex].ToMatrixWithScale());
+			for (int value = 0; value < numValues; value++)
+			{
+				float& customData = meshISMC->PerInstanceSMCustomData[i * numCustomDataFloats + value];
+				const float newValue = instances.CustomData[instanceIndex * instances.NumCustomData + value];
+				isChanged |= customData != newValue;
+				customData = newValue;
+			}
+		}
+
+		if (isChanged && runStart == INDEX_NONE)
+		{
+			runStart = i;
+		}
+		else if (!isChanged && runStart != INDEX_NONE)
+		{
+			CommitTransforms.Reset(i - runStart);
+			CommitTransforms.Append(instances.Transforms.GetData() + firstInstance + runStart, i - runStart);
+			meshISMC->BatchUpdateInstancesTransforms(runStart, CommitTransforms, false, false, true);
+			numChanged += i - runStart;
+			runStart = INDEX_NONE;
+		}
+	}
+
+	//the slots past the new count are removed from the end, so no other slot moves
+	if (numExisting > numInstances)
+	{
+		TArray<int32> removedInstances;
+		removedInstances.Reserve(numExisting - numInstances);
+		for (int instanceIndex = numExisting - 1; instanceIndex >= numInstances; instanceIndex--)
+		{
+			removedInstances.Add(instanceIndex);
+		}
+		meshISMC->RemoveInstances(removedInstances);
+		numChanged += numExisting - numInstances;
+	}
+
+	if (numInstances > numExisting)
+	{
+		CommitInstances(meshISMC, instances, firstInstance + numExisting, numInstances - numExisting);
+		numChanged += numInstances - numExisting;
+	}
+	else if (numChanged > 0)
+	{
+		if (UHierarchicalInstancedStaticMeshComponent* meshHISMC = Cast<UHierarchicalInstancedStaticMeshComponent>(meshISMC))
+			meshHISMC->BuildTreeIfOutdated(true, true);
+		else
+			meshISMC->MarkRenderStateDirty();
+	}
+	return numChanged;
+}
+
+void ADungeonSpace::InitRegionSlots(FDungeonRegionSlots& slots, int32 FIntVector::* component)
+{
+	//the component holds the buffer in order, so every region starts with the slots of its range
+	const TArray<FIntVector>& offsets = Grid->RegionInstanceOffsets;
+	const int numRegions = Grid->InstanceRegions.Num();
+	slots.RegionSlots.SetNum(numRegions);
+	slots.SlotRegions.SetNumUninitialized(offsets[numRegions].*component, false);
+	for (int region = 0; region < numRegions; region++)
+	{
+		TArray<int32>& regionSlots = slots.RegionSlots[region];
+		regionSlots.Reset();
+		for (int slot = offsets[region].*component; slot < offsets[region + 1].*component; slot++)
+		{
+			regionSlots.Add(slot);
+			slots.SlotRegions[slot] = region;
+		}
+	}
+}
+
+int ADungeonSpace::UpdateRegionSlots(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, FDungeonRegionSlots& slots, int32 FIntVector::* component, const FIntRect& changedTiles, bool isMerged)
+{
+	const TArray<FIntVector>& offsets = Grid->RegionInstanceOffsets;
+	const int numRegions = Grid->InstanceRegions.Num();
+	if (slots.RegionSlots.Num() != numRegions || slots.SlotRegions.Num() != meshISMC->GetInstanceCount())
+	{
+		//the component was not built from this grid in order, it is diffed once and the regions get its slots
+		const int numChanged = UpdateInstances(meshISMC, instances, 0, instances.Transforms.Num());
+		InitRegionSlots(slots, component);
+		return numChanged;
+	}
+
+	auto isTouched = [this, &changedTiles, isMerged](int region)
+	{
+		const FIntRect& tiles = Grid->InstanceRegions[region];
+		const bool isOverlapping = tiles.Max.X > changedTiles.Min.X && tiles.Max.Y > changedTiles.Min.Y && tiles.Min.X < changedTiles.Max.X && tiles.Min.Y < changedTiles.Max.Y;
+		return isOverlapping || (isMerged && region == 0);
+	};
+	if (meshISMC->NumCustomDataFloats < instances.NumCustomData)
+		meshISMC->SetNumCustomDataFloats(instances.NumCustomData);
+
+	//the surplus slots of the shrunk regions are reused by the grown ones first
+	FreeSlots.Reset();
+	for (int region = 0; region < numRegions; region++)
+	{
+		const int count = offsets[region + 1].*component - offsets[region].*component;
+		TArray<int32>& regionSlots = slots.RegionSlots[region];
+		if (!isTouched(region) || regionSlots.Num() <= count)
+			continue;
+
+		FreeSlots.Append(regionSlots.GetData() + count, regionSlots.Num() - count);
+		regionSlots.SetNum(count, false);
+	}
+
+	int numChanged = 0;
+	int numSlots = meshISMC->GetInstanceCount();
+	AppendedInstances.NumCustomData = instances.NumCustomData;
+	AppendedInstances.SetNum(0);
+	for (int region = 0; region < numRegions; region++)
+	{
+		if (!isTouched(region))
+			continue;
+
+		const int first = offsets[region].*component;
+		const int count = offsets[region + 1].*component - first;
+		TArray<int32>& regionSlots = slots.RegionSlots[region];
+		for (int i = 0; i < count; i++)
+		{
+			if (i < regionSlots.Num())
+			{
+				numChanged += WriteInstanceSlot(meshISMC, instances, first + i, regionSlots[i]) ? 1 : 0;
+				continue;
+			}
+
+			if (FreeSlots.Num() > 0)
+			{
+				const int slot = FreeSlots.Pop(false);
+				regionSlots.Add(slot);
+				slots.SlotRegions[slot] = region;
+				numChanged += WriteInstanceSlot(meshISMC, instances, first + i, slot) ? 1 : 0;
+				continue;
+			}
+
+			//no slot is left, the instance is added after the last one
+			const int appended = AppendedInstances.Transforms.Num();
+			AppendedInstances.SetNum(appended + 1);
+			AppendedInstances.Transforms[appended] = instances.Transforms[first + i];
+			FMemory::Memcpy(AppendedInstances.CustomData.GetData() + appended * instances.NumCustomData, instances.CustomData.GetData() + (first + i) * instances.NumCustomData, instances.NumCustomData * sizeof(float));
+			regionSlots.Add(numSlots);
+			slots.SlotRegions.Add(region);
+			numSlots++;
+		}
+	}
+
+	if (AppendedInstances.Transforms.Num() > 0)
+	{
+		CommitInstances(meshISMC, AppendedInstances);
+		numChanged += AppendedInstances.Transforms.Num();
+	}
+	//the slots nobody took are filled with the last instances, so the component is only shortened at its end
+	else if (FreeSlots.Num() > 0)
+	{
+		FreeSlots.Sort(TGreater<int32>());
+		const int numCustomDataFloats = meshISMC->NumCustomDataFloats;
+		TArray<int32> removedInstances;
+		removedInstances.Reserve(FreeSlots.Num());
+		for (int32 freeSlot : FreeSlots)
+		{
+			const int lastSlot = --numSlots;
+			if (freeSlot != lastSlot)
+			{
+				const int lastRegion = slots.SlotRegions[lastSlot];
+				TArray<int32>& lastRegionSlots = slots.RegionSlots[lastRegion];
+				lastRegionSlots[lastRegionSlots.Find(lastSlot)] = freeSlot;
+				slots.SlotRegions[freeSlot] = lastRegion;
+				meshISMC->UpdateInstanceTransform(freeSlot, FTransform(meshISMC->PerInstanceSMData[lastSlot].Transform), false, false, true);
+				if (meshISMC->PerInstanceSMCustomData.Num() >= (lastSlot + 1) * numCustomDataFloats)
+					FMemory::Memcpy(meshISMC->PerInstanceSMCustomData.GetData() + freeSlot * numCustomDataFloats, meshISMC->PerInstanceSMCustomData.GetData() + lastSlot * numCustomDataFloats, numCustomDataFloats * sizeof(float));
+				numChanged++;
+			}
+			removedInstances.Add(lastSlot);
+		}
+		meshISMC->RemoveInstances(removedInstances);
+		slots.SlotRegions.SetNum(numSlots, false);
+		numChanged += removedInstances.Num();
+	}
+
+	if (numChanged > 0)
+	{
+		if (UHierarchicalInstancedStaticMeshComponent* meshHISMC = Cast<UHierarchicalInstancedStaticMeshComponent>(meshISMC))
+			meshHISMC->BuildTreeIfOutdated(true, true);
+		else
+			meshISMC->MarkRenderStateDirty();
+	}
+	return numChanged;
+}
+
+bool ADungeonSpace::WriteInstanceSlot(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int instanceIndex, int slot)
+{
+	const FTransform& transform = instances.Transforms[instanceIndex];
+	const bool isTransformChanged = !meshISMC->PerInstanceSMData[slot].Transform.Equals(transform.ToMatrixWithScale());
+	bool isChanged = isTransformChanged;
+	const int numCustomDataFloats = meshISMC->NumCustomDataFloats;
+	if (meshISMC->PerInstanceSMCustomData.Num() >= (slot + 1) * numCustomDataFloats)
+	{
+		for (int value = 0; value < FMath::Min(numCustomDataFloats, instances.NumCustomData); value++)
+		{
+			float& customData = meshISMC->PerInstanceSMCustomData[slot * numCustomDataFloats + value];
+			const float newValue = instances.CustomData[instanceIndex * instances.NumCustomData + value];
+			isChanged |= customData != newValue;
+			customData = newValue;
+		}
+	}
+	if (isTransformChanged)
+		meshISMC->UpdateInstanceTransform(slot, transform, false, false, true);
+	return isChanged;
+}
+
+void ADungeonSpace::ShowDebugTile(int tileIndex, FString& tileInfo, FColor colorBox)
+{
+	if (Grid->TileArray.IsValidIndex(tileIndex))
+	{
+		FVector centerTile = GetTileLocation(tileIndex);
+		switch (GetTileType(Grid->TileArray[tileIndex]))
+		{
+		case ETileType::EMPTY:
+			tileInfo.Append(TEXT("EMPTY)"));
+			break;
+		case ETileType::CORRIDOR:
+			tileInfo.Append(TEXT("CORRIDOR)"));
+			break;
+		case ETileType::ROOM:
+			tileInfo.Append(TEXT("ROOM)"));
+			break;
+		}
+		tileInfo.Append(TEXT(", tileID(")).Append(FString::FromInt(tileIndex)).Append(TEXT(")"));
+		DrawDebugBox(GetWorld(), centerTile, FVector(Grid->Settings.TileSize / 2, Grid->Settings.TileSize / 2, 100.f), colorBox, true, 15.f, 0, 5.f);
+		if (GEngine)
+			GEngine->AddOnScreenDebugMessage(-1, 10.f, colorBox, tileInfo);
+	}
+
+}
+
+void FDungeonGrid::ResetLayout()
+{
+	//the grid is sized on regeneration, so edited dungeon and tile sizes are picked up
+	TileRows = Settings.DungeonSize / Settings.TileSize;
+	if (Settings.UseChunkStreaming)
+	{
+		TileArray.Empty();
+		TileNeighbourMasks.Empty();
+		TileRegionIds.Empty();
+		PaddedOccupancy.Empty();
+	}
+	else
+	{
+		TileArray.Init(uint8(ETileType::EMPTY), TileRows * TileRows);
+		TileNeighbourMasks.Init(0, TileRows * TileRows);
+	}
+	CoreLayout.Reset();
+	NumRegions = 0;
+	PathGraph.Reset();
+	RegionVisibility.Reset();
+	ClusterRegionLists.Reset();
+	DungeonRooms.Reset();
+	DungeonCorridors.Reset();
+}
+
+void ADungeonSpace::ResetMinimapTexture()
+{
+	const int numTiles = Grid->TileRows * Grid->TileRows;
+	if (MinimapTexture == nullptr || MinimapTexture->GetSizeX() != Grid->TileRows)
+	{
+		MinimapTexture = UTexture2D::CreateTransient(Grid->TileRows, Grid->TileRows, PF_B8G8R8A8);
+		MinimapTexture->Filter = TF_Nearest;
+		MinimapTexture->AddressX = TA_Clamp;
+		MinimapTexture->AddressY = TA_Clamp;
+		MinimapTexture->SRGB = true;
+		MinimapTexture->UpdateResource();
+	}
+
+	//everything is covered by fog again
+	ExploredTiles.Init(false, numTiles);
+	MinimapPixels.Init(MinimapFogColor, numTiles);
+	MinimapPlayerTile = INDEX_NONE;
+	UploadMinimapTexels(FIntRect(0, 0, Grid->TileRows, Grid->TileRows));
+}
+
+void ADungeonSpace::ShowMinimapPlane(const FTransform& playerTransform)
+{
+	if (!IsShowingMinimap || MinimapTexture == nullptr || MinimapPlane->GetStaticMesh() == nullptr)
+	{
+		MinimapPlane->SetVisibility(false);
+		return;
+	}
+
+	//the material of the blueprint gets the texture of this dungeon, the instance is kept over the regenerations
+	if (MinimapMaterial == nullptr)
+		MinimapMaterial = MinimapPlane->CreateDynamicMaterialInstance(0);
+	if (MinimapMaterial != nullptr)
+		MinimapMaterial->SetTextureParameterValue(MinimapTextureParameter, MinimapTexture);
+
+	//placed like the cube minimap, a texel covers MinimapTileSize and the first one is centered under the player
+	const float minDistanceFromPlayer = 10.f;
+	const FVector minimapPos = playerTransform.GetLocation() + playerTransform.GetRotation().Vector() * minDistanceFromPlayer;
+	const float planeSize = float(Grid->TileRows) * MinimapTileSize;
+	const FVector planeCenter = minimapPos + FVector(planeSize * 0.5f - MinimapTileSize * 0.5f, planeSize * 0.5f - MinimapTileSize * 0.5f, -50.f);
+	MinimapPlane->SetWorldLocationAndRotation(planeCenter, FQuat::Identity);
+	MinimapPlane->SetWorldScale3D(FVector(planeSize / MinimapPlaneMeshSize, planeSize / MinimapPlaneMeshSize, 1.f));
+	MinimapPlane->SetVisibility(true);
+}
+
+FColor ADungeonSpace::GetMinimapTileColor(int tileIndex) const
+{
+	if (!ExploredTiles[tileIndex])
+		return MinimapFogColor;
+
+	switch (GetTileType(Grid->TileArray[tileIndex]))
+	{
+	case ETileType::ROOM:
+		return MinimapRoomColor;
+	case ETileType::CORRIDOR:
+		return MinimapCorridorColor;
+	default:
+		return FColor::Transparent;
+	}
+}
+
+void ADungeonSpace::UploadMinimapTexels(const FIntRect& region)
+{
+	//copy the region, the render thread reads it after this function returns
+	const int width = region.Width();
+	const int height = region.Height();
+	FColor* texels = new FColor[width * height];
+	for (int row = 0; row < height; row++)
+	{
+		FMemory::Memcpy(texels + row * width, MinimapPixels.GetData() + (region.Min.Y + row) * Grid->TileRows + region.Min.X, width * sizeof(FColor));
+	}
+
+	FUpdateTextureRegion2D* updateRegion = new FUpdateTextureRegion2D(region.Min.X, region.Min.Y, 0, 0, width, height);
+	MinimapTexture->UpdateTextureRegions(0, 1, updateRegion, width * sizeof(FColor), sizeof(FColor), reinterpret_cast<uint8*>(texels),
+		[](uint8* srcData, const FUpdateTextureRegion2D* regions)
+		{
+			delete[] reinterpret_cast<FColor*>(srcData);
+			delete regions;
+		});
+}
+
+// Called every frame
+void ADungeonSpace::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (IsConstructing)
+		ConstructNextSlice();
+
+	if (Grid->Settings.UseChunkStreaming && IsDungeonGenerated)
+		UpdateChunkStreaming();
+
+	if (Grid->Settings.UseFlowField && HasTileGrid())
+		UpdateFlowField();
+
+	if (Grid->Settings.UseVisibilityCulling && HasTileGrid())
+		UpdateVisibilityCulling();
+
+	//after the culling, so the lights follow the rooms the player sees this frame
+	if (Grid->Settings.UseTorches && HasTileGrid())
+		UpdateTorchLights();
+
 }
 
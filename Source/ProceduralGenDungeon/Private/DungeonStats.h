@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+
+/*stat Dungeon shows the phases of the generation and the size of the last dungeon,
+Unreal Insights shows the same phases on the Dungeon channel (-trace=cpu,dungeon).*/
+DECLARE_STATS_GROUP(TEXT("Dungeon"), STATGROUP_Dungeon, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT(TEXT("GenerateDungeon"), STAT_DungeonGenerateDungeon, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("ComputeDungeonLayout"), STAT_DungeonComputeDungeonLayout, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("SplitSpace"), STAT_DungeonSplitSpace, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("SelectDungeonRooms"), STAT_DungeonSelectDungeonRooms, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("ShrinkRooms"), STAT_DungeonShrinkRooms, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("FillTileGrid"), STAT_DungeonFillTileGrid, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("ComputeNeighbourMasks"), STAT_DungeonComputeNeighbourMasks, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildRegionIds"), STAT_DungeonBuildRegionIds, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildPathGraph"), STAT_DungeonBuildPathGraph, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("FindPath"), STAT_DungeonFindPath, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("UpdateFlowField"), STAT_DungeonUpdateFlowField, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildRegionVisibility"), STAT_DungeonBuildRegionVisibility, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("UpdateVisibilityCulling"), STAT_DungeonUpdateVisibilityCulling, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildTorches"), STAT_DungeonBuildTorches, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("UpdateTorchLights"), STAT_DungeonUpdateTorchLights, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("RegenerateSubtree"), STAT_DungeonRegenerateSubtree, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildInstances"), STAT_DungeonBuildInstances, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildInstanceBuffers"), STAT_DungeonBuildInstanceBuffers, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildFloorRects"), STAT_DungeonBuildFloorRects, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildWallRunInstances"), STAT_DungeonBuildWallRunInstances, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildCollisionBoxes"), STAT_DungeonBuildCollisionBoxes, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("BuildChunkIndex"), STAT_DungeonBuildChunkIndex, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("ConstructDungeonGrid"), STAT_DungeonConstructDungeonGrid, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("ConstructNextSlice"), STAT_DungeonConstructNextSlice, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("LoadChunk"), STAT_DungeonLoadChunk, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("GenerateMinimap"), STAT_DungeonGenerateMinimap, STATGROUP_Dungeon);
+DECLARE_CYCLE_STAT(TEXT("UpdateMinimapPlayer"), STAT_DungeonUpdateMinimapPlayer, STATGROUP_Dungeon);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("BSP nodes"), STAT_DungeonBSPNodes, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Rooms"), STAT_DungeonRooms, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Corridors"), STAT_DungeonCorridors, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Room tiles"), STAT_DungeonRoomTiles, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Corridor tiles"), STAT_DungeonCorridorTiles, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Floor instances"), STAT_DungeonFloorInstances, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Wall instances"), STAT_DungeonWallInstances, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pillar instances"), STAT_DungeonPillarInstances, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Instances changed by the last construction"), STAT_DungeonChangedInstances, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Torches"), STAT_DungeonTorches, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Loaded chunks"), STAT_DungeonLoadedChunks, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Flow field tiles visited"), STAT_DungeonFlowFieldTiles, STATGROUP_Dungeon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Visible clusters"), STAT_DungeonVisibleClusters, STATGROUP_Dungeon);
+
+UE_TRACE_CHANNEL_EXTERN(DungeonChannel);
+
+/*Cycle stat and Insights scope of one phase, the phase name matches its STAT_Dungeon stat.*/
+#define DUNGEON_SCOPE_PHASE(Phase) \
+	SCOPE_CYCLE_COUNTER(STAT_Dungeon##Phase); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Dungeon##Phase, DungeonChannel)
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DungeonWorldSubsystem.h"
+#include "Misc/ScopeLock.h"
+
+void UDungeonWorldSubsystem::RegisterDungeon(ADungeonSpace* dungeon)
+{
+	Dungeons.AddUnique(dungeon);
+}
+
+void UDungeonWorldSubsystem::UnregisterDungeon(ADungeonSpace* dungeon)
+{
+	Dungeons.Remove(dungeon);
+	SetNavSnapshot(dungeon, nullptr);
+}
+
+ADungeonSpace* UDungeonWorldSubsystem::GetDungeon() const
+{
+	for (const TWeakObjectPtr<ADungeonSpace>& dungeon : Dungeons)
+	{
+		if (ADungeonSpace* dungeonSpace = dungeon.Get())
+			return dungeonSpace;
+	}
+	return nullptr;
+}
+
+ADungeonSpace* UDungeonWorldSubsystem::FindTileAtLocation(const FVector& worldLocation, int& tileIndex) const
+{
+	//a world has one or a few dungeons, each answers with a transform and a division
+	for (const TWeakObjectPtr<ADungeonSpace>& dungeon : Dungeons)
+	{
+		ADungeonSpace* dungeonSpace = dungeon.Get();
+		if (dungeonSpace == nullptr || !dungeonSpace->HasTileGrid())
+			continue;
+
+		tileIndex = dungeonSpace->GetTileIndexAtLocation(worldLocation);
+		if (tileIndex != INDEX_NONE)
+			return dungeonSpace;
+	}
+	tileIndex = INDEX_NONE;
+	return nullptr;
+}
+
+ETileType UDungeonWorldSubsystem::GetTileTypeAtLocation(const FVector& worldLocation) const
+{
+	int tileIndex;
+	const ADungeonSpace* dungeonSpace = FindTileAtLocation(worldLocation, tileIndex);
+	return dungeonSpace != nullptr ? dungeonSpace->GetTileTypeAt(tileIndex) : ETileType::EMPTY;
+}
+
+int UDungeonWorldSubsystem::GetRegionAtLocation(const FVector& worldLocation) const
+{
+	int tileIndex;
+	const ADungeonSpace* dungeonSpace = FindTileAtLocation(worldLocation, tileIndex);
+	return dungeonSpace != nullptr ? dungeonSpace->GetTileRegion(tileIndex) : INDEX_NONE;
+}
+
+int UDungeonWorldSubsystem::GetWalkableNeighboursAtLocation(const FVector& worldLocation, TArray<FVector>& neighbourLocations) const
+{
+	neighbourLocations.Reset();
+	int tileIndex;
+	const ADungeonSpace* dungeonSpace = FindTileAtLocation(worldLocation, tileIndex);
+	if (dungeonSpace == nullptr)
+		return 0;
+
+	int neighbours[4];
+	const int numNeighbours = dungeonSpace->GetWalkableNeighbours(tileIndex, neighbours);
+	for (int i = 0; i < numNeighbours; i++)
+	{
+		neighbourLocations.Add(dungeonSpace->GetTileLocation(neighbours[i]));
+	}
+	return numNeighbours;
+}
+
+bool UDungeonWorldSubsystem::FindPath(const FVector& startLocation, const FVector& goalLocation, TArray<FVector>& pathLocations) const
+{
+	int startTile;
+	ADungeonSpace* dungeonSpace = FindTileAtLocation(startLocation, startTile);
+	if (dungeonSpace == nullptr)
+	{
+		pathLocations.Reset();
+		return false;
+	}
+	return dungeonSpace->FindPath(startLocation, goalLocation, pathLocations);
+}
+
+void UDungeonWorldSubsystem::SetNavSnapshot(const ADungeonSpace* dungeon, const FDungeonNavSnapshotPtr& snapshot)
+{
+	//a query that copied the old snapshot keeps it alive until it is done
+	FScopeLock snapshotsLock(&NavSnapshotsLock);
+	if (snapshot.IsValid())
+		NavSnapshots.Add(dungeon, snapshot);
+	else
+		NavSnapshots.Remove(dungeon);
+}
+
+FDungeonNavSnapshotPtr UDungeonWorldSubsystem::FindNavSnapshotAtLocation(const FVector& worldLocation, int& tileIndex) const
+{
+	FScopeLock snapshotsLock(&NavSnapshotsLock);
+	for (const TPair<const ADungeonSpace*, FDungeonNavSnapshotPtr>& navSnapshot : NavSnapshots)
+	{
+		tileIndex = navSnapshot.Value->GetTileIndexAtLocation(worldLocation);
+		if (tileIndex != INDEX_NONE)
+			return navSnapshot.Value;
+	}
+	tileIndex = INDEX_NONE;
+	return nullptr;
+}
+
+void UDungeonWorldSubsystem::GetNavSnapshots(TArray<FDungeonNavSnapshotPtr>& snapshots) const
+{
+	FScopeLock snapshotsLock(&NavSnapshotsLock);
+	NavSnapshots.GenerateValueArray(snapshots);
+}
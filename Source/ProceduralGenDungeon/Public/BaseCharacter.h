@@ -7,6 +7,7 @@
 #include "BaseCharacter.generated.h"
 
 class UCameraComponent;
+class ADungeonSpace;
 UCLASS()
 class PROCEDURALGENDUNGEON_API ABaseCharacter : public ACharacter
 {
@@ -66,4 +67,6 @@ public:
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 private:
 	float BaseWalkSpeed;
+	/*Dungeon of the player, looked up in the dungeon subsystem so dungeons that begin play later are found as well.*/
+	ADungeonSpace* GetDungeonSpace() const;
 };
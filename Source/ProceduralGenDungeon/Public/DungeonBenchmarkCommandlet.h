@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonBenchmarkCommandlet.generated.h"
+
+/*Generates dungeons over a matrix of settings and writes the phase timings, instance counts and memory to CSV and JSON.
+Run with: UE4Editor-Cmd <project> -run=DungeonBenchmark -nullrhi [-DungeonSizes=36000,72000] [-TileSizes=600] [-SplitIterations=5,8]
+[-MinTilesPerRoom=2] [-Runs=20] [-Seed=1] [-Output=<path without extension>]*/
+UCLASS()
+class PROCEDURALGENDUNGEON_API UDungeonBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "DungeonCollisionComponent.generated.h"
+
+class UBodySetup;
+
+/*One physics body made of simple boxes, used instead of a body per floor and wall instance.*/
+UCLASS()
+class PROCEDURALGENDUNGEON_API UDungeonCollisionComponent : public UPrimitiveComponent
+{
+	GENERATED_BODY()
+
+public:
+	UDungeonCollisionComponent();
+
+	/*Replace the boxes of the body, in component space.*/
+	void SetBoxes(const TArray<FBox>& boxes);
+	int GetNumBoxes() const;
+
+	virtual UBodySetup* GetBodySetup() override;
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+
+private:
+	UPROPERTY(Transient)
+		UBodySetup* BoxBodySetup;
+	FBox LocalBounds;
+};
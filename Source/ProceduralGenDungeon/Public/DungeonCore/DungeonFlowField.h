@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DungeonCore
+{
+	//Distance in tiles from every walkable tile to a target tile (4-connected), agents step to the neighbour with the lower distance.
+	//When the target moves to a neighbouring tile the field is repaired instead of searched again: the grid is bipartite, so every distance changes by exactly one.
+	//The tiles behind the new target (their shortest path passed through it) get one closer, all others one further, which is a single bias for the whole field.
+	//Only the tiles that get closer are visited.
+	class FFlowField
+	{
+	public:
+		//tiles holds rows * rows ETileType values, every tile that is not EMPTY is walkable. Clears the target.
+		void Init(const uint8_t* tiles, int rows);
+		void Reset();
+
+		//Moves the target to a tile, -1 clears it. Returns true when the field was repaired and not searched again.
+		bool SetTarget(int tileIndex);
+		int GetTarget() const { return Target == -1 ? -1 : ToTile(Target); }
+		//Distance in tiles to the target, -1 when the tile can't reach it.
+		int GetDistance(int tileIndex) const;
+		//Neighbour of a tile that is one step closer to the target, -1 at the target or when the tile can't reach it.
+		int GetNextTile(int tileIndex) const;
+		//Tiles visited by the last SetTarget.
+		int GetNumVisitedTiles() const { return NumVisitedTiles; }
+		int GetRows() const { return Rows; }
+
+		//Repairs along up to this many steps when the target moved further than a neighbouring tile, more steps are searched again.
+		static constexpr int MaxRepairSteps = 4;
+
+	private:
+		static constexpr int32_t Unreachable = INT32_MAX;
+
+		int ToPadded(int tileIndex) const { return (tileIndex / Rows + 1) * PaddedRows + tileIndex % Rows + 1; }
+		int ToTile(int paddedIndex) const { return (paddedIndex / PaddedRows - 1) * Rows + paddedIndex % PaddedRows - 1; }
+		void Search(int target);
+		void StepTarget(int target);
+
+		int Rows = 0;
+		int PaddedRows = 0;
+		//walkable flags and distances (minus Bias) of the grid with a border of tiles that can't be walked on, so neighbours need no bounds checks
+		std::vector<uint8_t> Walkable;
+		std::vector<int32_t> Distances;
+		int32_t Bias = 0;
+		int Target = -1;
+		int NumVisitedTiles = 0;
+		std::vector<int32_t> Queue;
+		std::vector<int32_t> StepPath;
+	};
+}
@@ -0,0 +1,190 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+//Engine independent part of the generator: the BSP split, room selection, corridors and the tile grid.
+//Only uses the standard library, so it also builds with plain CMake for the tests and benchmarks (see the CMakeLists.txt in the project root).
+//Keep it C++14, the engine compiles it as part of the module.
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace DungeonCore
+{
+	enum class ESeperation : uint8_t
+	{
+		VERTICAL = 0,
+		HORIZONTAL = 1,
+	};
+
+	enum class ETileType : uint8_t
+	{
+		EMPTY = 0,
+		ROOM = 1,
+		CORRIDOR = 2,
+	};
+
+	//Bits of the 8-neighbour occupancy mask. The side neighbours match the wall with the same EDungeonObjectAlign (a LEFT wall sits on the +x side).
+	enum ENeighbourBit : uint8_t
+	{
+		NEIGHBOUR_LEFT = 1 << 0, //+x
+		NEIGHBOUR_RIGHT = 1 << 1, //-x
+		NEIGHBOUR_TOP = 1 << 2, //+y
+		NEIGHBOUR_BOTTOM = 1 << 3, //-y
+		NEIGHBOUR_TOP_LEFT = 1 << 4, //+x+y
+		NEIGHBOUR_TOP_RIGHT = 1 << 5, //-x+y
+		NEIGHBOUR_BOTTOM_LEFT = 1 << 6, //+x-y
+		NEIGHBOUR_BOTTOM_RIGHT = 1 << 7, //-x-y
+	};
+
+	struct FSettings
+	{
+		int dungeonSize = 36000;
+		int splitIterations = 5;
+		int tileSize = 600;
+		int minTilesPerRoom = 2;
+		float minRoomRatio = 0.4f;
+	};
+
+	struct FSpaceData
+	{
+		int key = 0;
+		int width = 0;
+		int height = 0;
+		int left = 0;
+		int bottom = 0;
+		ESeperation seperation = ESeperation::VERTICAL;
+		int tilesSeperated = 0;
+	};
+
+	struct FCorridorData
+	{
+		int startX = 0;
+		int startY = 0;
+		int endX = 0;
+		int endY = 0;
+		ESeperation seperation = ESeperation::VERTICAL;
+		int key = 0; //key of the left space of the split, the right space has key + 1
+	};
+
+	//Rectangle of tiles, the max column and row are exclusive.
+	struct FTileRect
+	{
+		int minCol = 0;
+		int minRow = 0;
+		int maxCol = 0;
+		int maxRow = 0;
+	};
+
+	struct FNode
+	{
+		FSpaceData data;
+		int left = -1;
+		int right = -1;
+		int depth = 0;
+	};
+
+	//BSP tree stored as a flat arena, the root is at index 0 and the nodes are stored level by level.
+	//The vectors are cleared but never freed on regeneration, so they keep their capacity.
+	struct FLayout
+	{
+		std::vector<FNode> nodes;
+		std::vector<FSpaceData> rooms;
+		std::vector<FCorridorData> corridors;
+		std::vector<FSpaceData> levelChildren; //children of the level that is being split, two per node of the level
+		std::vector<std::pair<int, int32_t>> subtreeSeeds; //key and seed of every regenerated subtree, its nodes draw from that seed
+
+		void Reset();
+	};
+
+	//Same sequence as the engine's FRandomStream, so layouts match between the engine and the standalone builds.
+	class FRandomStream
+	{
+	public:
+		explicit FRandomStream(int32_t seed) : Seed(uint32_t(seed)) {}
+
+		float GetFraction();
+		int32_t RandRange(int32_t min, int32_t max);
+
+	private:
+		uint32_t Seed;
+	};
+
+	//Random streams a node draws from, one per use so the split and the room shrink are independent.
+	enum class ENodeStream : uint8_t
+	{
+		SPLIT,
+		ROOM
+	};
+
+	//Same mix as the engine's HashCombine.
+	uint32_t HashCombine(uint32_t a, uint32_t c);
+	//Every node draws from its own stream, so the layout only depends on the seed and not on the order the nodes are visited in.
+	FRandomStream GetNodeStream(int32_t seed, int key, ENodeStream purpose);
+	//Seed of the nearest regenerated subtree a key is in, the layout seed when there is none. The children of key are 2 * key + 1 and 2 * key + 2.
+	int32_t GetNodeSeed(const FLayout& layout, int32_t seed, int key);
+	bool IsInSubtree(int key, int subtreeKey);
+
+	//Runs body for every index in [0, count), the engine passes its ParallelFor. Runs on the calling thread when empty.
+	using FParallelFor = std::function<void(int32_t count, const std::function<void(int32_t)>& body)>;
+
+	int GetMaxElements(int splitIterations);
+	//Splits the dungeon level by level, every node of a level only reads its own data and stream so a level is split in parallel.
+	//Stops after the level it is on when isCancelled returns true.
+	void SplitSpaces(const FSettings& settings, int32_t seed, FLayout& layout, const FParallelFor& parallelFor = FParallelFor(), const std::function<bool()>& isCancelled = std::function<bool()>());
+	bool ChooseSplit(const FSettings& settings, int32_t seed, FSpaceData& spaceData);
+	bool GetChildSpace(const FSettings& settings, const FSpaceData& parentData, int childKey, int maxElements, FSpaceData& childData);
+
+	//Leaves and the spaces at the deepest level become rooms, collected level by level.
+	void SelectRooms(const FSettings& settings, FLayout& layout);
+	void ShrinkRoom(const FSettings& settings, int32_t seed, FSpaceData& roomData);
+	void ShrinkRooms(const FSettings& settings, int32_t seed, FLayout& layout);
+
+	//Index of the node with a key, -1 when it was not split off.
+	int FindNode(const FLayout& layout, int key);
+	//Key of the deepest node at most depth levels down that contains x, y (in dungeon units), -1 outside of the dungeon.
+	int FindNodeAt(const FLayout& layout, int x, int y, int depth);
+	//Splits the subtree of key again with subtreeSeed and selects and shrinks the rooms again. Every node outside of the subtree and its corridors stay the same,
+	//only the tiles of the subtree space change (changedTiles). False when the key is not a node of the layout.
+	bool RegenerateSubtree(const FSettings& settings, int32_t seed, int key, int32_t subtreeSeed, FLayout& layout, FTileRect& changedTiles);
+
+	//Tiles of the grid of a dungeon size and tile size, rows * rows. -1 when the sizes describe no grid or one with more tiles than an int32 counts,
+	//so a loaded layout can reject its tile count before it allocates the tiles.
+	int32_t GetNumGridTiles(int dungeonSize, int tileSize);
+	//True for the values of ETileType.
+	inline bool IsValidTileType(uint8_t tile) { return tile <= uint8_t(ETileType::CORRIDOR); }
+
+	//Writes the rooms and corridors into tiles, one ETileType per tile, row major. tiles holds rows * rows EMPTY tiles.
+	void FillTileGrid(const FSettings& settings, const FLayout& layout, uint8_t* tiles);
+	//Clears the tiles of rect and writes the rooms and corridors into them again, the other tiles are not touched.
+	void FillTileRect(const FSettings& settings, const FLayout& layout, const FTileRect& rect, uint8_t* tiles);
+
+	//8-neighbour mask of the tile at col, the rows are occupancy (0 or 1) rows with valid entries at col - 1 and col + 1
+	inline uint8_t GetNeighbourMask(const uint8_t* bot, const uint8_t* mid, const uint8_t* top, int col)
+	{
+		return uint8_t(mid[col + 1]
+			| (mid[col - 1] << 1)
+			| (top[col] << 2)
+			| (bot[col] << 3)
+			| (top[col + 1] << 4)
+			| (top[col - 1] << 5)
+			| (bot[col + 1] << 6)
+			| (bot[col - 1] << 7));
+	}
+
+	//Masks of all tiles, paddedOccupancy is scratch memory of (rows + 2) * (rows + 2) bytes.
+	void ComputeNeighbourMasks(const uint8_t* tiles, int rows, uint8_t* paddedOccupancy, uint8_t* masks);
+	//Masks after the tiles of rect changed, the masks of rect and the tiles around it. paddedOccupancy holds the occupancy of the last ComputeNeighbourMasks.
+	void UpdateNeighbourMasks(const uint8_t* tiles, int rows, const FTileRect& rect, uint8_t* paddedOccupancy, uint8_t* masks);
+
+	//Walls (low nibble, bit n = EDungeonObjectAlign n) and pillars (high nibble, bit n = EDungeonObjectAlign TOP_LEFT + n) keyed by the neighbour mask
+	struct FObjectLUT
+	{
+		uint8_t Objects[256];
+
+		FObjectLUT();
+	};
+	extern const FObjectLUT ObjectLUT;
+}
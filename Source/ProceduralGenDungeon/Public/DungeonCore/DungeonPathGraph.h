@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DungeonCore
+{
+	//Two touching tiles of different regions, one per straight stretch of border between two regions (the middle of it).
+	//tileB is tileA + 1 or tileA + rows, the stretch runs across that step from firstTileA for length tiles on the A side.
+	struct FEntrance
+	{
+		int tileA = -1;
+		int tileB = -1;
+		int regionA = -1;
+		int regionB = -1;
+		int firstTileA = -1;
+		int length = 0;
+	};
+
+	//Search buffers of the path queries, every thread that queries paths owns one. Only grows, so repeated queries don't allocate.
+	struct FPathScratch
+	{
+		std::vector<uint32_t> tileVisited; //stamp of the search that visited a tile
+		std::vector<int32_t> tileParent;
+		std::vector<int32_t> tileDistance;
+		std::vector<int32_t> queue;
+		uint32_t tileStamp = 0;
+
+		std::vector<uint32_t> nodeVisited;
+		std::vector<int32_t> nodeCost;
+		std::vector<int32_t> nodeParent;
+		std::vector<int32_t> startCosts; //cost from the start tile to the nodes of the start region, -1 when unreachable
+		std::vector<int32_t> goalCosts; //cost from the nodes of the goal region to the goal tile
+		std::vector<std::pair<int32_t, int32_t>> open; //f cost and node, as a heap
+		std::vector<int32_t> nodePath;
+		uint32_t nodeStamp = 0;
+	};
+
+	//Room graph of a tile grid with hierarchical A* on top of it.
+	//The abstract graph has a node on both sides of every entrance, the nodes of a region are connected by their precomputed tile distance inside the region.
+	//A query searches the abstract graph and refines the result with searches that stay inside one region.
+	class FPathGraph
+	{
+	public:
+		//regionIds as written by FillRegionIds, rows * rows tiles, -1 for tiles that can't be walked on.
+		void Build(const int32_t* regionIds, int rows, int numRegions);
+		void Reset();
+
+		//Walkable tiles from startTile to goalTile (both included), 4-connected. False when there is no path.
+		bool FindPath(int startTile, int goalTile, FPathScratch& scratch, std::vector<int32_t>& path) const;
+		//True when a segment in tile units (a tile spans col to col + 1) enters a tile that can't be walked on, hitFraction (0-1) is where it does.
+		//Passing exactly through a tile corner also needs both tiles beside the corner.
+		bool Raycast(float startX, float startY, float endX, float endY, float& hitFraction) const;
+		//True when the line between the centers of two tiles and its two parallel lines clearance tiles (below 0.5) to each side stay on walkable tiles.
+		bool IsLineWalkable(int fromTile, int toTile, float clearance) const;
+		//Removes the tiles of a path that the straight lines between the tiles that are left can skip, keeps the first and the last tile.
+		void SmoothPath(std::vector<int32_t>& path, float clearance) const;
+
+		const std::vector<FEntrance>& GetEntrances() const { return Entrances; }
+		//Regions connected to a region by at least one entrance.
+		const int32_t* GetLinkedRegions(int region, int& numLinkedRegions) const;
+		int GetNumNodes() const { return int(NodeTiles.size()); }
+		int GetNumRegions() const { return int(RegionNodeOffsets.size()) - 1; }
+		int GetRegion(int tileIndex) const { return RegionIds[tileIndex]; }
+		int GetRows() const { return Rows; }
+
+	private:
+		//Breadth first search from startTile that stays in the region of startTile, stops when stopTile is reached (-1 searches the whole region).
+		void SearchRegion(int startTile, int stopTile, FPathScratch& scratch) const;
+		void AppendRegionPath(int fromTile, int toTile, FPathScratch& scratch, std::vector<int32_t>& path) const;
+		bool IsVisited(int tileIndex, const FPathScratch& scratch) const { return scratch.tileVisited[tileIndex] == scratch.tileStamp; }
+		bool IsWalkable(int col, int row) const { return col >= 0 && row >= 0 && col < Rows && row < Rows && RegionIds[col + Rows * row] >= 0; }
+
+		int Rows = 0;
+		std::vector<int32_t> RegionIds;
+		std::vector<FEntrance> Entrances;
+		std::vector<int32_t> NodeTiles;
+		std::vector<int32_t> NodeRegions;
+		//nodes of every region, RegionNodes[RegionNodeOffsets[r]] to RegionNodes[RegionNodeOffsets[r + 1]]
+		std::vector<int32_t> RegionNodeOffsets;
+		std::vector<int32_t> RegionNodes;
+		//linked regions of every region, in the same layout
+		std::vector<int32_t> RegionLinkOffsets;
+		std::vector<int32_t> RegionLinks;
+		//edges of every node, the same layout again, the cost is in tiles
+		std::vector<int32_t> EdgeOffsets;
+		std::vector<int32_t> EdgeTargets;
+		std::vector<int32_t> EdgeCosts;
+	};
+}
@@ -0,0 +1,12 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "DungeonCore/DungeonGenerator.h"
+
+namespace DungeonCore
+{
+	//Region of every tile, row major: the index of its room for room tiles, rooms.size() + the index of its connected corridor for corridor tiles and -1 for empty tiles.
+	//Corridor tiles that touch (4-neighbours) belong to the same corridor region. Returns the number of regions.
+	int FillRegionIds(const FSettings& settings, const FLayout& layout, const uint8_t* tiles, int32_t* regionIds);
+}
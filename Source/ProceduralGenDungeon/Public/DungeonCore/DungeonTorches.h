@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DungeonCore
+{
+	//Torch on one wall of a room tile, side is the EDungeonObjectAlign of the wall (LEFT, RIGHT, TOP or BOTTOM).
+	struct FTorch
+	{
+		int32_t tile = -1;
+		uint8_t side = 0;
+	};
+
+	//Torches on the walls of the room tiles, found with the neighbour masks. Every straight wall gets one torch per spacing tiles (at least one), spread evenly over it.
+	void PlaceTorches(const uint8_t* tiles, const uint8_t* masks, int rows, int spacing, std::vector<FTorch>& torches);
+
+	//Indices of the numSelected lowest costs, in no particular order. Runs in linear time, so it can run every frame over all torches.
+	void SelectLowestCosts(const std::vector<float>& costs, int numSelected, std::vector<int32_t>& selected);
+}
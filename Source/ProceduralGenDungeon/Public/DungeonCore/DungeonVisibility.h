@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DungeonCore
+{
+	class FPathGraph;
+
+	//Potentially visible regions of every region, the entrances between the regions are the portals.
+	//Every sight line between two regions crosses a portal, so lines are cast through points on every portal in numRayAngles directions.
+	//All regions a line passes before it hits an empty tile on both ends see each other. The lines are sampled, a sliver seen at a steeper angle than the sampling can be missed.
+	class FRegionVisibility
+	{
+	public:
+		void Build(const FPathGraph& graph, int numRayAngles = 32);
+		void Reset();
+
+		bool IsVisible(int fromRegion, int toRegion) const
+		{
+			return (Bits[size_t(fromRegion) * WordsPerRegion + toRegion / 64] >> (toRegion % 64)) & 1;
+		}
+		int GetNumVisible(int region) const;
+		int GetNumRegions() const { return NumRegions; }
+
+	private:
+		void SetVisible(int regionA, int regionB);
+
+		int NumRegions = 0;
+		int WordsPerRegion = 0;
+		//bit set of the visible regions of every region, WordsPerRegion words per region
+		std::vector<uint64_t> Bits;
+	};
+}
@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonSpace.h"
+
+/*Everything needed to construct a dungeon without generating it again.*/
+struct FDungeonLayout
+{
+	int32 DungeonSize = 0;
+	int32 TileSize = 0;
+	int32 SplitIterations = 0;
+	int32 MinTilesPerRoom = 0;
+	float MinRoomRatio = 0.f;
+	int32 Seed = 0;
+	TArray<FData> Rooms;
+	TArray<FCorridor> Corridors;
+	/*One ETileType per tile, row by row.*/
+	TArray<uint8> Tiles;
+};
+
+/*Reads and writes dungeon layouts in a versioned binary format, the tile grid is stored run-length encoded.*/
+class PROCEDURALGENDUNGEON_API FDungeonLayoutSerializer
+{
+public:
+	static constexpr uint32 Magic = 0x4C4E4744; //"DGNL"
+	static constexpr uint32 Version = 1;
+
+	static bool SaveLayout(const FString& filePath, const FDungeonLayout& layout);
+	/*Maps the file into memory when the platform supports it, otherwise the file is read into a buffer.*/
+	static bool LoadLayout(const FString& filePath, FDungeonLayout& layout);
+
+	static void Serialize(FArchive& ar, FDungeonLayout& layout);
+
+private:
+	static bool LoadFromMemory(const uint8* data, int64 size, FDungeonLayout& layout);
+	/*numGridTiles is the tile count of the sizes that were read, a loaded count or tile value that doesn't fit sets the archive error.*/
+	static void SerializeTiles(FArchive& ar, TArray<uint8>& tiles, int32 numGridTiles);
+};
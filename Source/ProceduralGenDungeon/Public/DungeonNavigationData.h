@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationData.h"
+#include "DungeonSpace.h"
+#include "DungeonNavigationData.generated.h"
+
+class UDungeonWorldSubsystem;
+
+/*Navigation data that answers the queries from the tile grids of the dungeons instead of a navmesh, so agents can move the frame a layout is done and nothing is rebuilt.
+Paths are searched over the room graph of the dungeon at the start location and straightened on the tile grid, see ADungeonSpace::UseTileNavigation.
+The queries read the FDungeonNavSnapshot a dungeon publishes when its layout changes, never the grid the game thread rewrites.
+Set it as the Nav Data Class of the agents in the project settings. The node of a location is the index of its tile.*/
+UCLASS()
+class PROCEDURALGENDUNGEON_API ADungeonNavigationData : public ANavigationData
+{
+	GENERATED_BODY()
+
+public:
+	ADungeonNavigationData(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
+
+	/*Paths found on the old layout search again, called by the dungeons when their layout changes.*/
+	void InvalidateActivePaths();
+
+	virtual FBox GetBounds() const override;
+	virtual FNavLocation GetRandomPoint(FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual bool GetRandomReachablePointInRadius(const FVector& Origin, float Radius, FNavLocation& OutResult, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual bool GetRandomPointInNavigableRadius(const FVector& Origin, float Radius, FNavLocation& OutResult, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual bool ProjectPoint(const FVector& Point, FNavLocation& OutLocation, const FVector& Extent, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual void BatchProjectPoints(TArray<FNavigationProjectionWork>& Workload, const FVector& Extent, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual void BatchProjectPoints(TArray<FNavigationProjectionWork>& Workload, FSharedConstNavQueryFilter Filter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual void BatchRaycast(TArray<FNavigationRaycastWork>& Workload, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier = nullptr) const override;
+	virtual ENavigationQueryResult::Type CalcPathCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual ENavigationQueryResult::Type CalcPathLength(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual ENavigationQueryResult::Type CalcPathLengthAndCost(const FVector& PathStart, const FVector& PathEnd, float& OutPathLength, float& OutPathCost, FSharedConstNavQueryFilter QueryFilter = nullptr, const UObject* Querier = nullptr) const override;
+	virtual bool DoesNodeContainLocation(NavNodeRef NodeRef, const FVector& WorldSpaceLocation) const override;
+
+private:
+	//the engine calls the queries through function pointers, so they may run on the async pathfinding thread
+	static FPathFindingResult FindPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query);
+	static bool TestPath(const FNavAgentProperties& AgentProperties, const FPathFindingQuery& Query, int32* NumVisitedNodes);
+	static bool Raycast(const ANavigationData* NavDataInstance, const FVector& RayStart, const FVector& RayEnd, FVector& HitLocation, FSharedConstNavQueryFilter QueryFilter, const UObject* Querier);
+
+	const UDungeonWorldSubsystem* GetDungeonSubsystem() const;
+	/*Snapshot of the dungeon with the tile at a location, see UDungeonWorldSubsystem::FindNavSnapshotAtLocation. A query copies it once and only reads that copy.*/
+	FDungeonNavSnapshotPtr FindTileAtLocation(const FVector& worldLocation, int& tileIndex) const;
+	/*Tile path between two locations of the same dungeon, written to the search buffers of the calling thread. An end over an empty tile is snapped to a walkable tile next to it,
+	isStartSnapped and isGoalSnapped tell which were. Returns the snapshot that was searched, null when there is no path.*/
+	FDungeonNavSnapshotPtr FindTilePath(const FVector& startLocation, const FVector& goalLocation, bool& isStartSnapped, bool& isGoalSnapped) const;
+	/*Straightened path between two locations of the same dungeon as world locations, the ends are the locations on the floor. agentRadius keeps the lines away from the walls.*/
+	bool FindLocationPath(const FVector& startLocation, const FVector& goalLocation, float agentRadius, TArray<FVector>& pathLocations) const;
+};
@@ -4,8 +4,21 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Async/Future.h"
+#include "Templates/Atomic.h"
+#include "DungeonCore/DungeonGenerator.h"
+#include "DungeonCore/DungeonPathGraph.h"
+#include "DungeonCore/DungeonFlowField.h"
+#include "DungeonCore/DungeonVisibility.h"
+#include "DungeonCore/DungeonTorches.h"
 #include "DungeonSpace.generated.h"
 
+class UTexture2D;
+class UMaterialInstanceDynamic;
+class UInstancedStaticMeshComponent;
+class UDungeonCollisionComponent;
+class UPointLightComponent;
+
 UENUM(BlueprintType)
 enum class ESeperation : uint8 {
 	VERTICAL = 0 UMETA(DisplayName = "Vertical"),
@@ -35,6 +48,10 @@ enum class EDungeonObjectAlign : uint8 {
 	TOP = 2  UMETA(DisplayName = "Top"),
 	BOTTOM = 3  UMETA(DisplayName = "Bottom"),
 	CENTER = 4  UMETA(DisplayName = "Center"),
+	TOP_LEFT = 5  UMETA(DisplayName = "Top left"),
+	TOP_RIGHT = 6  UMETA(DisplayName = "Top right"),
+	BOTTOM_LEFT = 7  UMETA(DisplayName = "Bottom left"),
+	BOTTOM_RIGHT = 8  UMETA(DisplayName = "Bottom right"),
 };
 
 USTRUCT()
@@ -62,37 +79,6 @@ struct FDungeonObject
 	}
 };
 
-USTRUCT()
-struct FTile
-{
-	GENERATED_BODY()
-		int left;
-	int bottom;
-	TArray<FDungeonObject> objectsToSpawn;
-	ETileType tileType;
-	int corridorID;
-	int miniMapTileInstanceID;
-
-	FTile()
-		:left(0),
-		bottom(0),
-		tileType(ETileType::EMPTY),
-		corridorID(-1),
-		miniMapTileInstanceID(0)
-	{
-
-	}
-
-	FTile(int tileLeft, int tileBottom, ETileType tileTypex, int corridorIDx = -1)
-		:left(tileLeft),
-		bottom(tileBottom),
-		tileType(tileTypex),
-		corridorID(corridorIDx)
-	{
-
-	}
-};
-
 USTRUCT()
 struct FCorridor
 {
@@ -100,6 +86,7 @@ struct FCorridor
 		FIntVector start;
 	FIntVector end;
 	ESeperation seperation;
+	int key; //key of the left space of the split, the right space has key + 1
 };
 
 USTRUCT()
@@ -116,23 +103,229 @@ struct FData
 
 };
 
-USTRUCT()
-struct FSpace
+UENUM(BlueprintType)
+enum class EMinimapMode : uint8 {
+	CUBES = 0 UMETA(DisplayName = "Cubes"),
+	TEXTURE = 1  UMETA(DisplayName = "Texture"),
+};
+
+UENUM(BlueprintType)
+enum class EWallMergeMode : uint8 {
+	NONE = 0 UMETA(DisplayName = "None"),
+	STRETCHED = 1 UMETA(DisplayName = "Stretched"),
+	MODULAR = 2 UMETA(DisplayName = "Modular"),
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnDungeonGenerated);
+
+/*Instances of one mesh type, filled in parallel and added to its ISMC in one batch.*/
+struct FDungeonInstanceBuffer
 {
-	GENERATED_BODY()
-	FData data;
-	FSpace* left;
-	FSpace* right;
-
-	FSpace()
-		:data()
-		, left(nullptr)
-		, right(nullptr)
-	{
+	TArray<FTransform> Transforms;
+	TArray<float> CustomData; //first NumCustomData custom data values of every instance
+	int NumCustomData = 1;
 
+	void SetNum(int num)
+	{
+		Transforms.SetNumUninitialized(num, false);
+		CustomData.SetNumUninitialized(num * NumCustomData, false);
 	}
 };
 
+/*Straight line of walls on the same side of neighbouring tiles.*/
+struct FDungeonWallRun
+{
+	FIntPoint StartTile;
+	int Length;
+	EDungeonObjectAlign Side;
+};
+
+/*Instanced meshes of one loaded chunk or cluster, all null for a chunk without tiles.*/
+struct FDungeonChunkMeshes
+{
+	UInstancedStaticMeshComponent* Floor = nullptr;
+	UInstancedStaticMeshComponent* Wall = nullptr;
+	UInstancedStaticMeshComponent* Pillar = nullptr;
+};
+
+/*Component slots of the instances of every region in the components without clusters. A region that is built again only rewrites its own slots,
+the slots of the other regions stay where they are.*/
+struct FDungeonRegionSlots
+{
+	/*Slot of every instance of a region, in the order of the instance buffer.*/
+	TArray<TArray<int32>> RegionSlots;
+	/*Region of every slot.*/
+	TArray<int32> SlotRegions;
+};
+
+/*Wall time of the phases of the last generation, in milliseconds.*/
+struct FDungeonGenerationTimings
+{
+	double SplitSpaceMs = 0.0;
+	double SelectDungeonRoomsMs = 0.0;
+	double FillTileGridMs = 0.0;
+	double BuildInstancesMs = 0.0;
+	double ConstructDungeonGridMs = 0.0;
+};
+
+/*Number of EDungeonObjectAlign values.*/
+static constexpr int NumDungeonObjectAligns = 9;
+
+/*Settings of ADungeonSpace a grid is built with, copied on the game thread when the generation starts so the editable properties are never read by the layout computation.*/
+struct FDungeonGridSettings
+{
+	int DungeonSize = 36000;
+	int TileSize = 600;
+	int SplitIterations = 5;
+	int MinTilesPerRoom = 2;
+	float MinRoomRatio = 0.4f;
+	int32 Seed = 0;
+	int WallTileWidth = 10;
+	bool UseTimeSlicedConstruction = false;
+	bool UseMergedFloors = false;
+	EWallMergeMode WallMergeMode = EWallMergeMode::NONE;
+	int WallModuleTiles = 4;
+	bool UseMergedCollision = false;
+	float WallCollisionHeight = 600.f;
+	float FloorCollisionThickness = 20.f;
+	bool UseChunkStreaming = false;
+	bool UseClusteredMeshes = false;
+	int ChunkTiles = 32;
+	bool UseVisibilityCulling = false;
+	int VisibilityRayAngles = 32;
+	bool UseFlowField = false;
+	bool UseTorches = false;
+	int TorchSpacing = 4;
+	float TorchHeight = 250.f;
+	float TorchWallOffset = 20.f;
+	/*Scale of the actor, the instance transforms are built with it.*/
+	FVector InstanceScale = FVector::OneVector;
+	/*Player location relative to the actor, the time-sliced construction starts with the rooms nearest to it.*/
+	FVector ConstructionOrigin = FVector::ZeroVector;
+};
+
+/*Layout, tile grid, graphs and instance buffers of one generation. ADungeonSpace builds a new grid next to the one it shows, on any thread,
+and swaps it in on the game thread when it is done, so the game thread never sees a grid that is being written.*/
+struct FDungeonGrid
+{
+	FDungeonGridSettings Settings;
+	/*BSP tree, rooms and corridors computed by the generator core, the rooms and corridors are copied into the arrays below.*/
+	DungeonCore::FLayout CoreLayout;
+	//The arrays are reset but never freed on regeneration, so they keep their capacity.
+	TArray<FData> DungeonRooms;
+	TArray<FCorridor> DungeonCorridors;
+	int TileRows = 0;
+	/*One ETileType byte per tile, row major. The position of a tile is derived from its index.*/
+	TArray<uint8> TileArray;
+	/*8-neighbour occupancy mask per tile, the walls and pillars of a tile are looked up with it.*/
+	TArray<uint8> TileNeighbourMasks;
+	/*Room or corridor region per tile, see ADungeonSpace::GetTileRegion.*/
+	TArray<int32> TileRegionIds;
+	int NumRegions = 0;
+	/*Room graph with the precomputed distances inside the regions.*/
+	DungeonCore::FPathGraph PathGraph;
+	/*Potentially visible regions and the regions touching every cluster.*/
+	DungeonCore::FRegionVisibility RegionVisibility;
+	TArray<TArray<int32>> ClusterRegionLists;
+	/*Torches on the room walls and their instances.*/
+	std::vector<DungeonCore::FTorch> Torches;
+	FDungeonInstanceBuffer TorchInstances;
+	/*Occupancy of the grid with a border of empty tiles, scratch buffer of ComputeNeighbourMasks.*/
+	TArray<uint8> PaddedOccupancy;
+	/*Tile rectangles the instances are built in, tile rows or clusters, and the prefix sum of their floor (X), wall (Y) and pillar (Z) instances.*/
+	TArray<FIntRect> InstanceRegions;
+	TArray<FIntVector> RegionInstanceOffsets;
+	/*Merged floor rectangles of every region, in tiles.*/
+	TArray<TArray<FIntRect>> RegionFloorRects;
+	/*Merged wall pieces of every region.*/
+	TArray<TArray<FDungeonWallRun>> RegionWallPieces;
+	bool IsMergingFloors = false;
+	FDungeonGenerationTimings LastTimings;
+	bool IsMergingWalls = false;
+	FDungeonInstanceBuffer FloorInstances;
+	FDungeonInstanceBuffer WallInstances;
+	FDungeonInstanceBuffer PillarInstances;
+	/*Transform and custom data of every object relative to the bottom left of its tile, indexed by EDungeonObjectAlign.*/
+	FTransform ObjectTransforms[NumDungeonObjectAligns];
+	float ObjectCustomData[NumDungeonObjectAligns];
+	/*Time-sliced construction: the tiles in the order they are added and the number of instances they have.*/
+	TArray<TPair<float, int>> ConstructionItems;
+	TArray<int> ConstructionTileQueue;
+	int NumConstructionInstances = 0;
+	/*Merged collision boxes of the floors and walls and the wall runs they are built from, in actor space.*/
+	TArray<FBox> CollisionBoxes;
+	TArray<FDungeonWallRun> WallRuns;
+	/*Chunk streaming: the tile rectangles (max exclusive) of the rooms and corridors and the ones touching every chunk.*/
+	int ChunkRows = 0;
+	TArray<FIntRect> RoomTileRects;
+	TArray<FIntRect> CorridorTileRects;
+	TArray<TArray<int>> ChunkRoomLists;
+	TArray<TArray<int>> ChunkCorridorLists;
+
+	/*Computes the layout and the instance buffers from Settings, touches no components so it can run on a background thread. False when cancelled.*/
+	bool ComputeLayout(const TAtomic<bool>& isCancelled);
+	void ResetLayout();
+	DungeonCore::FSettings GetCoreSettings() const;
+	void SplitSpaces(const TAtomic<bool>& isCancelled);
+	void SelectDungeonRooms();
+	void ShrinkRooms();
+	void FillTileGrid();
+	void ComputeNeighbourMasks();
+	void BuildRegionIds();
+	void BuildPathGraph();
+	void BuildRegionVisibility();
+	void BuildClusterRegionLists();
+	void BuildTorches();
+	/*Location of a torch relative to the actor.*/
+	FVector GetTorchLocation(int torch) const;
+	void CopyRoomsToCore();
+	void CopyRoomsFromCore();
+	void BuildInstances();
+	void BuildObjectTemplates();
+	FIntVector CountTileInstances(int tileIndex) const;
+	static FIntVector CountObjects(uint8 objects);
+	void WriteTileInstances(int tileIndex, FIntVector& offsets, FDungeonInstanceBuffer& floors, FDungeonInstanceBuffer& walls, FDungeonInstanceBuffer& pillars) const;
+	void WriteTileObjects(uint8 objects, const FVector& tileCorner, FIntVector& offsets, FDungeonInstanceBuffer& floors, FDungeonInstanceBuffer& walls, FDungeonInstanceBuffer& pillars, bool withFloor = true) const;
+	void BuildFloorRects();
+	void BuildWallRunInstances();
+	uint8 GetTileObjects(int tileIndex) const;
+	void BuildTileRects();
+	void ExtractWallRuns(TArray<FDungeonWallRun>& wallRuns) const;
+	void BuildCollisionBoxes();
+	void BuildChunkIndex();
+	void RasterizeChunk(const FIntPoint& chunk, TArray<uint8>& tiles) const;
+	void BuildInstanceBuffers();
+	void BuildConstructionQueue();
+
+	static FORCEINLINE ETileType GetTileType(uint8 tile) { return ETileType(tile); }
+};
+
+/*Copy of the tile grid and the path graph of a dungeon that the navigation queries read. The queries may run on the async pathfinding thread,
+so ADungeonSpace builds a new snapshot on the game thread when its layout changes and never writes one that is published.*/
+struct FDungeonNavSnapshot
+{
+	/*Transform of the dungeon when the snapshot was built.*/
+	FTransform Transform;
+	int TileRows = 0;
+	int TileSize = 1;
+	TArray<uint8> TileArray;
+	DungeonCore::FPathGraph PathGraph;
+
+	/*Index of the tile at a world location, INDEX_NONE when the location is outside of the grid.*/
+	int GetTileIndexAtLocation(const FVector& worldLocation) const;
+	/*World location of the center of a tile, on the floor.*/
+	FVector GetTileLocation(int tileIndex) const;
+	FORCEINLINE ETileType GetTileTypeAt(int tileIndex) const { return ETileType(TileArray[tileIndex]); }
+	/*Walkable tile nearest to a tile, at most maxTiles columns and rows away. INDEX_NONE when there is none.*/
+	int FindNearestWalkableTile(int tileIndex, int maxTiles) const;
+	/*True when the straight line between two world locations leaves the walkable tiles, hitLocation is where it does. Only the horizontal part of the line is traced.*/
+	bool RaycastTiles(const FVector& startLocation, const FVector& endLocation, FVector& hitLocation) const;
+	/*World bounds of the tile grid, on the floor.*/
+	FBox GetTileGridBounds() const;
+};
+
+typedef TSharedPtr<const FDungeonNavSnapshot, ESPMode::ThreadSafe> FDungeonNavSnapshotPtr;
+
 UCLASS()
 class PROCEDURALGENDUNGEON_API ADungeonSpace : public AActor
 {
@@ -142,8 +335,69 @@ public:
 	// Sets default values for this actor's properties
 	ADungeonSpace();
 	void GenerateMinimap(FTransform& playerTransform);
+	/*Moves the player marker of the texture minimap, only the texels that change are uploaded.*/
+	void UpdateMinimapPlayer(const FVector& playerLocation);
 	void DebugTiles(FVector& tilePos);
+	/*Generates a new dungeon. With async generation a running generation is cancelled and restarted.*/
 	void GenerateDungeon();
+	/*Write the rooms, corridors, tile grid and generation settings of the current dungeon to a binary file.*/
+	UFUNCTION(BlueprintCallable, Category = "Dungeon")
+		bool ExportLayout(const FString& filePath);
+	/*Construct a dungeon from a file written by ExportLayout without generating it again.*/
+	UFUNCTION(BlueprintCallable, Category = "Dungeon")
+		bool ImportLayout(const FString& filePath);
+	/*Splits the BSP subtree of a node again with subtreeSeed, the rest of the dungeon stays the same. Only the tiles of the subtree space are written again
+	and only the instances that differ are updated, added or removed. Not available with chunk streaming, time-sliced construction, a running generation or an imported layout.*/
+	UFUNCTION(BlueprintCallable, Category = "Dungeon")
+		bool RegenerateSubtree(int key, int32 subtreeSeed);
+	/*Key of the BSP node at most depth levels below the root that contains a location, INDEX_NONE outside of the dungeon. The root has key 0, the children of a key are 2 * key + 1 and 2 * key + 2.*/
+	UFUNCTION(BlueprintPure, Category = "Dungeon")
+		int GetSubtreeKeyAtLocation(const FVector& worldLocation, int depth) const;
+	/*True while an async generation is computing the layout.*/
+	bool IsGenerating() const { return IsGenerationRunning; }
+	/*Fraction (0-1) of the instances that are added to the meshes.*/
+	UFUNCTION(BlueprintPure, Category = "Construction")
+		float GetConstructionProgress() const;
+	/*Index of the tile at a world location, INDEX_NONE when the location is outside of the grid.*/
+	int GetTileIndexAtLocation(const FVector& worldLocation) const;
+	/*True when the tile grid can be queried, from the first finished generation on. It is not built with chunk streaming, a running generation builds the next grid next to it.*/
+	bool HasTileGrid() const { return IsDungeonGenerated && Grid->TileArray.Num() > 0 && Grid->TileRegionIds.Num() == Grid->TileArray.Num(); }
+	/*World location of the center of a tile, on the floor.*/
+	FVector GetTileLocation(int tileIndex) const;
+	FORCEINLINE ETileType GetTileTypeAt(int tileIndex) const { return GetTileType(Grid->TileArray[tileIndex]); }
+	/*Room of a tile (0 to GetNumRooms() - 1) or its connected corridor (GetNumRooms() and up), INDEX_NONE for empty tiles.*/
+	FORCEINLINE int GetTileRegion(int tileIndex) const { return Grid->TileRegionIds[tileIndex]; }
+	int GetNumRooms() const { return Grid->DungeonRooms.Num(); }
+	int GetNumRegions() const { return Grid->NumRegions; }
+	/*Writes the walkable side neighbours of a tile to neighbours and returns how many there are.*/
+	int GetWalkableNeighbours(int tileIndex, int (&neighbours)[4]) const;
+	/*Path over the room graph between two world locations, as the world locations of the tile centers. False when there is no path.*/
+	UFUNCTION(BlueprintCallable, Category = "Navigation")
+		bool FindPath(const FVector& startLocation, const FVector& goalLocation, TArray<FVector>& pathLocations);
+	/*Tile path with search buffers owned by the caller. Game thread only, the navigation queries search the snapshot of UDungeonWorldSubsystem::FindNavSnapshotAtLocation.*/
+	bool FindTilePath(int startTile, int goalTile, DungeonCore::FPathScratch& scratch, std::vector<int32_t>& path) const;
+	/*Rooms and corridors (regions) and the entrances between them.*/
+	const DungeonCore::FPathGraph& GetPathGraph() const { return Grid->PathGraph; }
+	/*World direction from the tile at a location to its neighbour that is one step closer to the player, zero at the player or when the player can't be reached.*/
+	UFUNCTION(BlueprintPure, Category = "Navigation")
+		FVector GetFlowDirection(const FVector& worldLocation) const;
+	/*Tiles between the tile at a location and the player, -1 when the player can't be reached.*/
+	UFUNCTION(BlueprintPure, Category = "Navigation")
+		int GetFlowDistance(const FVector& worldLocation) const;
+	/*Distances to the tile of the player, follows the player on the game thread.*/
+	const DungeonCore::FFlowField& GetPlayerFlowField() const { return PlayerFlowField; }
+	/*True when a region may be seen from the region of the player, or when the player is outside of the dungeon or culling is off.*/
+	bool IsRegionPotentiallyVisible(int region) const;
+	UFUNCTION(BlueprintPure, Category = "Streaming")
+		bool IsLocationPotentiallyVisible(const FVector& worldLocation) const;
+	/*Regions every region may see through the entrances, built with UseVisibilityCulling.*/
+	const DungeonCore::FRegionVisibility& GetRegionVisibility() const { return Grid->RegionVisibility; }
+	int GetNumTorches() const { return int(Grid->Torches.size()); }
+	/*Location of a torch relative to the actor.*/
+	FVector GetTorchLocation(int torch) const { return Grid->GetTorchLocation(torch); }
+	const FDungeonGenerationTimings& GetLastTimings() const { return Grid->LastTimings; }
+	/*Floor (X), wall (Y) and pillar (Z) instances in all components.*/
+	FIntVector GetInstanceCounts() const;
 
 	/*The size of the dungeon should be divisible by the tilesize.*/
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon")
@@ -162,6 +416,105 @@ public:
 		float MinRoomRatio = 0.4f;
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon")
 		int WallTileWidth = 10;
+	/*Compute the layout and the instance transforms on a background task, only the instances are added on the game thread.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon")
+		bool UseAsyncGeneration = false;
+	/*Seed of the layout, the same seed and settings always build the same dungeon.*/
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Dungeon")
+		int32 Seed = 0;
+	/*Pick a new Seed on every generation.*/
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Dungeon")
+		bool RandomizeSeed = true;
+	/*Add the instances over several frames within ConstructionBudgetMs, starting with the rooms nearest to the player.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Construction")
+		bool UseTimeSlicedConstruction = false;
+	/*Milliseconds per frame the time-sliced construction may spend adding instances.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Construction", meta = (ClampMin = "0.1"))
+		float ConstructionBudgetMs = 2.f;
+	/*Instances the time-sliced construction still has to add.*/
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "Construction")
+		int ConstructionInstancesRemaining = 0;
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "Construction")
+		int ConstructionInstancesTotal = 0;
+	/*Milliseconds the time-sliced construction used in its last frame.*/
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "Construction")
+		float ConstructionLastFrameMs = 0.f;
+	/*Merge neighbouring floor tiles of the same type into scaled rectangles. Custom data 1 and 2 of a floor are its size in tiles, for tiling the UVs.
+	Not used by the time-sliced construction and the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon")
+		bool UseMergedFloors = false;
+	/*Stretched emits one wall per straight run, modular emits pieces of WallModuleTiles (halved for the rest of a run). Custom data 1 of a wall is its length in tiles.
+	Not used by the time-sliced construction and the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon")
+		EWallMergeMode WallMergeMode = EWallMergeMode::NONE;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dungeon", meta = (ClampMin = "1"))
+		int WallModuleTiles = 4;
+	/*Disable the bodies of the floor, wall and pillar instances and collide with merged boxes per room, corridor and straight wall instead.
+	Not used by the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Collision")
+		bool UseMergedCollision = false;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Collision")
+		float WallCollisionHeight = 600.f;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Collision")
+		float FloorCollisionThickness = 20.f;
+	/*Only build the chunks around the player, the full tile grid is never allocated. The texture minimap is not available.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming")
+		bool UseChunkStreaming = false;
+	/*Put the instances of every ChunkTiles x ChunkTiles cluster in their own hierarchical instanced components, so they are culled per cluster.
+	The streamed chunks use hierarchical components as well. Not used by the time-sliced construction.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming")
+		bool UseClusteredMeshes = false;
+	/*Width and height of a chunk or cluster in tiles.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming", meta = (ClampMin = "1"))
+		int ChunkTiles = 32;
+	/*Chunks around the chunk of the player that are loaded.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		int ChunkLoadRadius = 2;
+	/*Chunks further than this from the chunk of the player are evicted, at least ChunkLoadRadius.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		int ChunkEvictRadius = 3;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming", meta = (ClampMin = "1"))
+		int ChunksLoadedPerFrame = 2;
+	/*Find the rooms and corridors every room and corridor may see through the entrances, and hide the clusters that can't be seen from the region of the player.
+	The clusters are only hidden with UseClusteredMeshes. Not used by the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming")
+		bool UseVisibilityCulling = false;
+	/*Directions of the sight lines cast through every entrance, more finds thinner gaps.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Streaming", meta = (ClampMin = "4"))
+		int VisibilityRayAngles = 32;
+	/*Keep a flow field toward the tile of the player, repaired when the player steps to another tile. Applies from the next generation on, not used by the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Navigation")
+		bool UseFlowField = false;
+	/*The meshes and the merged collision don't affect the navigation, so a new layout starts no navmesh rebuild. ADungeonNavigationData answers the queries from the tile grid instead,
+	set it as the Nav Data Class of the agents in the project settings. The paths of the agents are invalidated when the layout changes. Not used by the streamed chunks.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Navigation")
+		bool UseTileNavigation = false;
+	/*Place torches on the room walls. TorchISMC shows all of them, only the MaxTorchLights most relevant ones get a point light. Not used by the streamed chunks.
+	Custom data 0 of a torch is 1 while it has a light, so its material can glow brighter.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		bool UseTorches = false;
+	/*Tiles between the torches along a wall, every wall gets at least one.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting", meta = (ClampMin = "1"))
+		int TorchSpacing = 4;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		float TorchHeight = 250.f;
+	/*Distance between a torch and its wall.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		float TorchWallOffset = 20.f;
+	/*Torches with a dynamic light, the nearest ones in rooms the player may see (see UseVisibilityCulling).*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting", meta = (ClampMin = "0"))
+		int MaxTorchLights = 8;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		float TorchLightIntensity = 5000.f;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		float TorchLightRadius = 1500.f;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		FLinearColor TorchLightColor = FLinearColor(1.f, 0.55f, 0.2f);
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Lighting")
+		bool TorchLightsCastShadows = false;
+	/*Called on the game thread when a new dungeon is constructed.*/
+	UPROPERTY(BlueprintAssignable, Category = "Dungeon")
+		FOnDungeonGenerated OnDungeonGenerated;
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
 		int CubeMeshSize = 100;
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
@@ -170,40 +523,164 @@ public:
 		int MinimapTileSize;
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
 		FVector MinimapPos;
+	/*Cubes rebuilds a cube per tile when the minimap is spawned, texture writes one texel per tile and follows the player every frame.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		EMinimapMode MinimapMode = EMinimapMode::CUBES;
+	/*Tiles around the player that are explored, in tiles.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		int MinimapRevealRadius = 2;
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		FColor MinimapRoomColor = FColor(38, 38, 38);
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		FColor MinimapCorridorColor = FColor(13, 13, 13);
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		FColor MinimapPlayerColor = FColor(255, 64, 0);
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		FColor MinimapFogColor = FColor(0, 0, 0, 0);
+	/*Texture parameter of the material of MinimapPlane that shows MinimapTexture.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		FName MinimapTextureParameter = TEXT("MinimapTexture");
+	/*Width of the mesh of MinimapPlane at scale 1, the engine plane is 100 wide.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Minimap")
+		int MinimapPlaneMeshSize = 100;
+	/*One texel per tile, used by the texture minimap. MinimapPlane shows it, a HUD can sample it as well.*/
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "Minimap")
+		UTexture2D* MinimapTexture;
+	UFUNCTION(BlueprintPure, Category = "Minimap")
+		UTexture2D* GetMinimapTexture() const { return MinimapTexture; }
 
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	UPROPERTY(VisibleAnywhere, Category = "Meshes")
 		UInstancedStaticMeshComponent* CubeISMC;
 	UPROPERTY(VisibleAnywhere, Category = "Meshes")
 		UInstancedStaticMeshComponent* FloorTileISMC;
 	UPROPERTY(VisibleAnywhere, Category = "Meshes")
 		UInstancedStaticMeshComponent* WallTileISMC;
+	UPROPERTY(VisibleAnywhere, Category = "Meshes")
+		UInstancedStaticMeshComponent* PillarTileISMC;
+	UPROPERTY(VisibleAnywhere, Category = "Meshes")
+		UInstancedStaticMeshComponent* TorchISMC;
+	/*Shows the texture minimap, its material samples MinimapTexture through MinimapTextureParameter. Hidden until the minimap is spawned.*/
+	UPROPERTY(VisibleAnywhere, Category = "Meshes")
+		UStaticMeshComponent* MinimapPlane;
+	UPROPERTY(VisibleAnywhere, Category = "Collision")
+		UDungeonCollisionComponent* CollisionComponent;
+	/*Components of the streamed chunks, created from the meshes above and reused when a chunk is evicted.*/
+	UPROPERTY(Transient)
+		TArray<UInstancedStaticMeshComponent*> ChunkMeshComponents;
+	/*Point lights that are moved between the torches, created up to MaxTorchLights.*/
+	UPROPERTY(Transient)
+		TArray<UPointLightComponent*> TorchLights;
 
 
 private:
-	FSpace* RootSpace;
-	TArray<FSpace*> DungeonRooms;
-	TMap<int, FCorridor*> DungeonCorridors; //first space id, second corridor
-	TArray<FTile> TileArray;
-	int TileRows;
+	/*Grid that is shown and queried, only touched on the game thread. The generation builds PendingGrid and swaps it in, the old grid keeps its buffers for the next one.*/
+	TUniquePtr<FDungeonGrid> Grid;
+	TUniquePtr<FDungeonGrid> PendingGrid;
+	/*Search buffers of FindPath.*/
+	DungeonCore::FPathScratch PathScratch;
+	std::vector<int32_t> PathTiles;
+	DungeonCore::FFlowField PlayerFlowField;
+	/*Region of the player the clusters are culled for.*/
+	int VisibleFromRegion;
+	/*The light of every torch and the torch of every light (INDEX_NONE when there is none).*/
+	TArray<int32> TorchLightIndices;
+	TArray<int32> LightTorches;
+	/*Scratch buffers of UpdateTorchLights and the player tile and region the lights were assigned for.*/
+	std::vector<float> TorchCosts;
+	std::vector<int32_t> SelectedTorches;
+	TBitArray<> SelectedTorchMask;
+	TArray<int32> FreeTorchLights;
+	int TorchLightsTile;
+	int TorchLightsRegion;
+	/*Transforms of a part of an instance buffer that is added to a component.*/
+	TArray<FTransform> CommitTransforms;
+	/*Slots of the tile rows in the floor, wall and pillar components, and the scratch buffers of UpdateRegionSlots.*/
+	FDungeonRegionSlots FloorSlots;
+	FDungeonRegionSlots WallSlots;
+	FDungeonRegionSlots PillarSlots;
+	TArray<int32> FreeSlots;
+	FDungeonInstanceBuffer AppendedInstances;
+	/*Time-sliced construction: the next tile of the queue and the instances of the current frame.*/
+	int ConstructionTileCursor;
+	float ConstructionMsPerInstance;
+	bool IsConstructing;
+	FDungeonInstanceBuffer SliceFloorInstances;
+	FDungeonInstanceBuffer SliceWallInstances;
+	FDungeonInstanceBuffer SlicePillarInstances;
 	bool IsDungeonGenerated;
+	TFuture<void> GenerationTask;
+	/*Set on the game thread to stop the running layout computation.*/
+	TAtomic<bool> CancelGeneration;
+	bool IsGenerationRunning;
+	bool IsGenerationPending;
+	/*CPU copy of the minimap texture and the explored tiles (fog of war).*/
+	TArray<FColor> MinimapPixels;
+	TBitArray<> ExploredTiles;
+	int MinimapPlayerTile;
+	UPROPERTY(Transient)
+		UMaterialInstanceDynamic* MinimapMaterial;
+	/*Chunk streaming: the components of the loaded chunks and the pooled ones.*/
+	TMap<FIntPoint, FDungeonChunkMeshes> LoadedChunks;
+	TArray<FDungeonChunkMeshes> ChunkMeshPool;
+	/*Tiles and occupancy of the chunk that is loaded, with an apron of one tile.*/
+	TArray<uint8> ChunkTileScratch;
+	TArray<uint8> ChunkOccupancy;
 
 	
-	FSpace* SplitSpace(FSpace* currentSpace, int index, int maxElements, FData parentData);
-	void PrintTree(FString& string, FSpace* root);
-	void SelectDungeonRooms(FSpace* currentSpace, int currentDepth);
-	void FillTileGrid();
+	/*Copies the settings the next grid is built with, on the game thread.*/
+	FDungeonGridSettings CaptureGridSettings() const;
+	void PrintTree(FString& string);
+	void StartGeneration();
+	void StartAsyncGeneration();
+	void OnAsyncGenerationFinished(bool isCompleted);
+	/*Swaps PendingGrid in and constructs it.*/
+	void FinishDungeonGeneration();
 	void ConstructDungeonGrid();
-	void ShrinkSpaceToRoom(FSpace* currentSpace);
-	bool CheckIfWallShouldBePlaced(int tileIndex, int adjacentTileIndex);
-	bool IsCorridorConnected(int tileIndex);
-	void PlaceCorridorsWalls(int tileIndex);
+	void UpdateFlowField();
+	/*Gives UDungeonWorldSubsystem a snapshot of the grid for the navigation queries, or none when the tile navigation is off or there is no tile grid.*/
+	void PublishNavSnapshot();
+	void InvalidateNavigationPaths();
+	void UpdateVisibilityCulling();
+	void SetClusterVisibility(bool isCullingClusters);
+	void ConstructTorches();
+	void ResetTorchLights();
+	void UpdateTorchLights();
+	UPointLightComponent* CreateTorchLight();
+	void UpdateChangedInstances(const FIntRect& changedTiles);
+	void UpdateMinimapTexels(const FIntRect& changedTiles);
 	void ShowDebugTile(int tileIndex, FString& tileInfo, FColor colorBox);
-	void PlaceWalls(int tileIndex);
-	void ResetDungeon();
+	void UpdateDungeonStats() const;
+	void UpdateInstanceStats() const;
+	void LoadChunk(const FIntPoint& chunk);
+	void ReleaseChunk(FDungeonChunkMeshes& meshes);
+	void ReleaseAllChunks();
+	FDungeonChunkMeshes AcquireChunkMeshes();
+	FDungeonChunkMeshes CreateChunkMeshes();
+	void UpdateChunkStreaming();
+	void ConstructNextSlice();
+	void CommitInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances);
+	void CommitInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int firstInstance, int numInstances);
+	/*Overwrites the instances of a component that differ from a part of an instance buffer and adds or removes the rest, returns the instances that changed.*/
+	int UpdateInstances(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int firstInstance, int numInstances);
+	/*Every region owns the slots of its range of a component that holds a whole instance buffer in order. component picks the count of RegionInstanceOffsets.*/
+	void InitRegionSlots(FDungeonRegionSlots& slots, int32 FIntVector::* component);
+	/*Writes the instances of the regions that overlap changedTiles (and of the first region when merged pieces are all in it) to their own slots.
+	Shrunk regions give their surplus slots to grown ones, only the rest is appended or removed. Returns the instances that changed.*/
+	int UpdateRegionSlots(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, FDungeonRegionSlots& slots, int32 FIntVector::* component, const FIntRect& changedTiles, bool isMerged);
+	/*Overwrites a slot of a component with an instance of a buffer when they differ, true when it did.*/
+	bool WriteInstanceSlot(UInstancedStaticMeshComponent* meshISMC, const FDungeonInstanceBuffer& instances, int instanceIndex, int slot);
+	void ResetMinimapTexture();
+	/*Puts MinimapPlane under the player and binds MinimapTexture to its material.*/
+	void ShowMinimapPlane(const FTransform& playerTransform);
+	FColor GetMinimapTileColor(int tileIndex) const;
+	void UploadMinimapTexels(const FIntRect& region);
+
+	static FORCEINLINE ETileType GetTileType(uint8 tile) { return ETileType(tile); }
 
 public:
 	// Called every frame
@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DungeonSpace.h"
+#include "DungeonWorldSubsystem.generated.h"
+
+/*Keeps track of the dungeons in a world, so gameplay code finds them without searching the actors.
+The tile queries are answered by the grid of the dungeon in constant time and respect its transform. The grid is not built with chunk streaming, the queries then find no tiles.*/
+UCLASS()
+class PROCEDURALGENDUNGEON_API UDungeonWorldSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/*Called by the dungeons when they begin and end play.*/
+	void RegisterDungeon(ADungeonSpace* dungeon);
+	void UnregisterDungeon(ADungeonSpace* dungeon);
+
+	/*First registered dungeon, nullptr when there is none.*/
+	UFUNCTION(BlueprintPure, Category = "Dungeon")
+		ADungeonSpace* GetDungeon() const;
+	/*Registered dungeons, the pointers of destroyed ones are stale until they unregister.*/
+	const TArray<TWeakObjectPtr<ADungeonSpace>>& GetDungeons() const { return Dungeons; }
+	/*Dungeon with the tile at a world location and the index of that tile, nullptr when the location is outside of every dungeon.*/
+	ADungeonSpace* FindTileAtLocation(const FVector& worldLocation, int& tileIndex) const;
+	UFUNCTION(BlueprintPure, Category = "Dungeon")
+		ETileType GetTileTypeAtLocation(const FVector& worldLocation) const;
+	/*Room or corridor at a world location, see ADungeonSpace::GetTileRegion. INDEX_NONE outside of the rooms and corridors.*/
+	UFUNCTION(BlueprintPure, Category = "Dungeon")
+		int GetRegionAtLocation(const FVector& worldLocation) const;
+	/*World centers of the walkable side neighbours of the tile at a world location.*/
+	UFUNCTION(BlueprintCallable, Category = "Dungeon")
+		int GetWalkableNeighboursAtLocation(const FVector& worldLocation, TArray<FVector>& neighbourLocations) const;
+	/*Path inside the dungeon at the start location, see ADungeonSpace::FindPath.*/
+	UFUNCTION(BlueprintCallable, Category = "Dungeon")
+		bool FindPath(const FVector& startLocation, const FVector& goalLocation, TArray<FVector>& pathLocations) const;
+
+	/*Replaces the navigation snapshot of a dungeon, a null snapshot removes it. Called by the dungeons on the game thread.*/
+	void SetNavSnapshot(const ADungeonSpace* dungeon, const FDungeonNavSnapshotPtr& snapshot);
+	/*Snapshot with the tile at a world location and the index of that tile, null when the location is outside of every snapshot. Safe on any thread,
+	the snapshot stays valid while the caller holds it.*/
+	FDungeonNavSnapshotPtr FindNavSnapshotAtLocation(const FVector& worldLocation, int& tileIndex) const;
+	/*Copies the navigation snapshots of all dungeons. Safe on any thread.*/
+	void GetNavSnapshots(TArray<FDungeonNavSnapshotPtr>& snapshots) const;
+
+private:
+	TArray<TWeakObjectPtr<ADungeonSpace>> Dungeons;
+	/*Snapshots by dungeon, the pointers are only copied under the lock.*/
+	TMap<const ADungeonSpace*, FDungeonNavSnapshotPtr> NavSnapshots;
+	mutable FCriticalSection NavSnapshotsLock;
+};
@@ -0,0 +1,771 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+//Unit tests of the generator core, built by the CMakeLists.txt in the project root and run with ctest.
+
+#include "DungeonCore/DungeonGenerator.h"
+#include "DungeonCore/DungeonRegions.h"
+#include "DungeonCore/DungeonPathGraph.h"
+#include "DungeonCore/DungeonFlowField.h"
+#include "DungeonCore/DungeonVisibility.h"
+#include "DungeonCore/DungeonTorches.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace DungeonCore;
+
+static int NumFailures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			NumFailures++; \
+		} \
+	} while (0)
+
+//splits the indices over a few threads, like the engine's ParallelFor
+static void ThreadedParallelFor(int32_t count, const std::function<void(int32_t)>& body)
+{
+	const int numThreads = 4;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([t, count, &body]()
+			{
+				for (int32_t i = t; i < count; i += numThreads)
+					body(i);
+			});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+static FLayout GenerateLayout(const FSettings& settings, int32_t seed, const FParallelFor& parallelFor = FParallelFor())
+{
+	FLayout layout;
+	SplitSpaces(settings, seed, layout, parallelFor);
+	SelectRooms(settings, layout);
+	ShrinkRooms(settings, seed, layout);
+	return layout;
+}
+
+static std::vector<uint8_t> GenerateTiles(const FSettings& settings, const FLayout& layout)
+{
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<uint8_t> tiles(rows * rows, uint8_t(ETileType::EMPTY));
+	FillTileGrid(settings, layout, tiles.data());
+	return tiles;
+}
+
+static bool IsSameSpace(const FSpaceData& a, const FSpaceData& b)
+{
+	return a.key == b.key && a.width == b.width && a.height == b.height && a.left == b.left && a.bottom == b.bottom
+		&& a.seperation == b.seperation && a.tilesSeperated == b.tilesSeperated;
+}
+
+static bool IsSameLayout(const FLayout& a, const FLayout& b)
+{
+	if (a.nodes.size() != b.nodes.size() || a.rooms.size() != b.rooms.size() || a.corridors.size() != b.corridors.size())
+		return false;
+	for (size_t i = 0; i < a.nodes.size(); i++)
+	{
+		if (!IsSameSpace(a.nodes[i].data, b.nodes[i].data) || a.nodes[i].left != b.nodes[i].left || a.nodes[i].right != b.nodes[i].right || a.nodes[i].depth != b.nodes[i].depth)
+			return false;
+	}
+	for (size_t i = 0; i < a.rooms.size(); i++)
+	{
+		if (!IsSameSpace(a.rooms[i], b.rooms[i]))
+			return false;
+	}
+	for (size_t i = 0; i < a.corridors.size(); i++)
+	{
+		const FCorridorData& ca = a.corridors[i];
+		const FCorridorData& cb = b.corridors[i];
+		if (ca.startX != cb.startX || ca.startY != cb.startY || ca.endX != cb.endX || ca.endY != cb.endY || ca.seperation != cb.seperation || ca.key != cb.key)
+			return false;
+	}
+	return true;
+}
+
+static void TestRandomStream()
+{
+	//first value of the engine's FRandomStream with seed 0
+	FRandomStream stream(0);
+	CHECK(stream.GetFraction() == 1772721.0f / 8388608.0f);
+
+	FRandomStream range(12345);
+	for (int i = 0; i < 1000; i++)
+	{
+		const int32_t value = range.RandRange(-3, 7);
+		CHECK(value >= -3 && value <= 7);
+	}
+	FRandomStream single(7);
+	CHECK(single.RandRange(5, 5) == 5);
+}
+
+static void TestDeterminism()
+{
+	FSettings settings;
+	for (int32_t seed : { 0, 1, 42, -7, 123456789 })
+	{
+		const FLayout a = GenerateLayout(settings, seed);
+		const FLayout b = GenerateLayout(settings, seed);
+		CHECK(IsSameLayout(a, b));
+		CHECK(GenerateTiles(settings, a) == GenerateTiles(settings, b));
+	}
+	CHECK(!IsSameLayout(GenerateLayout(settings, 1), GenerateLayout(settings, 2)));
+}
+
+static void TestParallelSplit()
+{
+	FSettings settings;
+	settings.splitIterations = 8;
+	for (int32_t seed : { 3, 99, 2024 })
+	{
+		CHECK(IsSameLayout(GenerateLayout(settings, seed), GenerateLayout(settings, seed, ThreadedParallelFor)));
+	}
+}
+
+static void TestTree()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 5);
+	CHECK(!layout.nodes.empty());
+	CHECK(int(layout.nodes.size()) <= GetMaxElements(settings.splitIterations));
+
+	for (size_t i = 0; i < layout.nodes.size(); i++)
+	{
+		const FNode& node = layout.nodes[i];
+		CHECK(node.depth <= settings.splitIterations);
+		if (node.left == -1 || node.right == -1)
+			continue;
+
+		//the children partition the parent along its split
+		const FSpaceData& parent = node.data;
+		const FSpaceData& left = layout.nodes[node.left].data;
+		const FSpaceData& right = layout.nodes[node.right].data;
+		CHECK(left.key == 2 * parent.key + 1);
+		CHECK(right.key == 2 * parent.key + 2);
+		CHECK(layout.nodes[node.left].depth == node.depth + 1);
+		if (parent.seperation == ESeperation::VERTICAL)
+		{
+			CHECK(left.width + right.width == parent.width);
+			CHECK(left.height == parent.height && right.height == parent.height);
+			CHECK(left.left == parent.left && right.left == parent.left + left.width);
+		}
+		else
+		{
+			CHECK(left.height + right.height == parent.height);
+			CHECK(left.width == parent.width && right.width == parent.width);
+			CHECK(right.bottom == parent.bottom && left.bottom == parent.bottom + right.height);
+		}
+	}
+	//a corridor for every split with two children
+	CHECK(int(layout.corridors.size()) == std::count_if(layout.nodes.begin(), layout.nodes.end(), [](const FNode& node) { return node.left != -1 && node.right != -1; }));
+}
+
+static bool IsAncestor(int key, int descendantKey)
+{
+	while (descendantKey > key)
+		descendantKey = (descendantKey - 1) / 2;
+	return descendantKey == key;
+}
+
+static void TestRooms()
+{
+	FSettings settings;
+	for (int32_t seed : { 11, 12, 13 })
+	{
+		const FLayout layout = GenerateLayout(settings, seed);
+		CHECK(!layout.rooms.empty());
+		for (size_t i = 0; i < layout.rooms.size(); i++)
+		{
+			const FSpaceData& room = layout.rooms[i];
+			CHECK(room.width > 0 && room.height > 0);
+			CHECK(room.left >= 0 && room.bottom >= 0);
+			CHECK(room.left + room.width <= settings.dungeonSize && room.bottom + room.height <= settings.dungeonSize);
+			CHECK(room.left % settings.tileSize == 0 && room.bottom % settings.tileSize == 0);
+
+			for (size_t j = i + 1; j < layout.rooms.size(); j++)
+			{
+				//a node with only one child is a room and so is its child, only unrelated rooms are disjoint
+				const FSpaceData& other = layout.rooms[j];
+				if (IsAncestor(room.key, other.key) || IsAncestor(other.key, room.key))
+					continue;
+
+				const bool isOverlapping = room.left < other.left + other.width && other.left < room.left + room.width
+					&& room.bottom < other.bottom + other.height && other.bottom < room.bottom + room.height;
+				CHECK(!isOverlapping);
+			}
+		}
+	}
+}
+
+static void TestTileGrid()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 77);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+
+	//every tile of a room is a room tile
+	for (const FSpaceData& room : layout.rooms)
+	{
+		for (int row = room.bottom / settings.tileSize; row < (room.bottom + room.height) / settings.tileSize; row++)
+		{
+			for (int col = room.left / settings.tileSize; col < (room.left + room.width) / settings.tileSize; col++)
+			{
+				CHECK(tiles[col + rows * row] == uint8_t(ETileType::ROOM));
+			}
+		}
+	}
+	CHECK(std::count(tiles.begin(), tiles.end(), uint8_t(ETileType::CORRIDOR)) > 0);
+}
+
+static void TestLayoutValidation()
+{
+	//the tile count of a loaded layout must match the grid of its sizes
+	FSettings settings;
+	const int rows = settings.dungeonSize / settings.tileSize;
+	CHECK(GetNumGridTiles(settings.dungeonSize, settings.tileSize) == rows * rows);
+
+	//malformed files: sizes that describe no grid, and a grid too large to count
+	CHECK(GetNumGridTiles(settings.dungeonSize, 0) == -1);
+	CHECK(GetNumGridTiles(settings.dungeonSize, -600) == -1);
+	CHECK(GetNumGridTiles(0, settings.tileSize) == -1);
+	CHECK(GetNumGridTiles(-36000, settings.tileSize) == -1);
+	CHECK(GetNumGridTiles(INT32_MAX, 1) == -1);
+	CHECK(GetNumGridTiles(46340, 1) == 46340 * 46340);
+
+	//every generated tile is a valid type, values past CORRIDOR are rejected
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, GenerateLayout(settings, 77));
+	CHECK(std::all_of(tiles.begin(), tiles.end(), IsValidTileType));
+	CHECK(!IsValidTileType(uint8_t(ETileType::CORRIDOR) + 1));
+	CHECK(!IsValidTileType(0xff));
+}
+
+static void TestNeighbourMasks()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 8);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<uint8_t> padded((rows + 2) * (rows + 2));
+	std::vector<uint8_t> masks(rows * rows);
+	ComputeNeighbourMasks(tiles.data(), rows, padded.data(), masks.data());
+
+	//compare with the neighbours looked up one by one
+	auto isFilled = [&tiles, rows](int col, int row)
+	{
+		return col >= 0 && row >= 0 && col < rows && row < rows && tiles[col + rows * row] != uint8_t(ETileType::EMPTY);
+	};
+	for (int row = 0; row < rows; row++)
+	{
+		for (int col = 0; col < rows; col++)
+		{
+			uint8_t mask = 0;
+			mask |= isFilled(col + 1, row) ? NEIGHBOUR_LEFT : 0;
+			mask |= isFilled(col - 1, row) ? NEIGHBOUR_RIGHT : 0;
+			mask |= isFilled(col, row + 1) ? NEIGHBOUR_TOP : 0;
+			mask |= isFilled(col, row - 1) ? NEIGHBOUR_BOTTOM : 0;
+			mask |= isFilled(col + 1, row + 1) ? NEIGHBOUR_TOP_LEFT : 0;
+			mask |= isFilled(col - 1, row + 1) ? NEIGHBOUR_TOP_RIGHT : 0;
+			mask |= isFilled(col + 1, row - 1) ? NEIGHBOUR_BOTTOM_LEFT : 0;
+			mask |= isFilled(col - 1, row - 1) ? NEIGHBOUR_BOTTOM_RIGHT : 0;
+			CHECK(masks[col + rows * row] == mask);
+		}
+	}
+}
+
+static void TestObjectLUT()
+{
+	//a lone tile has all four walls and pillars, a surrounded tile has none
+	CHECK(ObjectLUT.Objects[0] == 0xFF);
+	CHECK(ObjectLUT.Objects[0xFF] == 0);
+	//a tile in a straight corridor along x has the walls on both y sides and no pillars
+	CHECK(ObjectLUT.Objects[NEIGHBOUR_LEFT | NEIGHBOUR_RIGHT] == (NEIGHBOUR_TOP | NEIGHBOUR_BOTTOM));
+	for (int mask = 0; mask < 256; mask++)
+	{
+		//the walls only depend on the side neighbours
+		CHECK((ObjectLUT.Objects[mask] & 0x0F) == (~mask & 0x0F));
+	}
+}
+
+static void TestRegenerateSubtree()
+{
+	FSettings settings;
+	settings.splitIterations = 6;
+	const int32_t seed = 31;
+	const FLayout original = GenerateLayout(settings, seed);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<uint8_t> tiles = GenerateTiles(settings, original);
+	std::vector<uint8_t> padded((rows + 2) * (rows + 2));
+	std::vector<uint8_t> masks(rows * rows);
+	ComputeNeighbourMasks(tiles.data(), rows, padded.data(), masks.data());
+
+	//nodes are found by the path of their key
+	for (size_t i = 0; i < original.nodes.size(); i++)
+	{
+		CHECK(FindNode(original, original.nodes[i].data.key) == int(i));
+	}
+	CHECK(FindNode(original, GetMaxElements(settings.splitIterations)) == -1);
+	const int key = 2;
+	const FSpaceData& space = original.nodes[FindNode(original, key)].data;
+	CHECK(FindNodeAt(original, space.left, space.bottom + space.height - 1, 1) == key);
+	CHECK(FindNodeAt(original, space.left, space.bottom, 0) == 0);
+	CHECK(FindNodeAt(original, -1, 0, 1) == -1);
+
+	FLayout layout = original;
+	FTileRect changed;
+	CHECK(!RegenerateSubtree(settings, seed, GetMaxElements(settings.splitIterations), 5, layout, changed));
+	CHECK(RegenerateSubtree(settings, seed, key, 5, layout, changed));
+	CHECK(!IsSameLayout(layout, original));
+	CHECK(changed.minCol == space.left / settings.tileSize && changed.maxRow == (space.bottom + space.height) / settings.tileSize);
+
+	//the nodes and rooms outside of the subtree stay the same
+	for (const FNode& node : original.nodes)
+	{
+		if (IsInSubtree(node.data.key, key))
+			continue;
+		const int index = FindNode(layout, node.data.key);
+		CHECK(index != -1 && IsSameSpace(layout.nodes[index].data, node.data));
+	}
+	for (const FSpaceData& room : original.rooms)
+	{
+		if (IsInSubtree(room.key, key))
+			continue;
+		CHECK(std::any_of(layout.rooms.begin(), layout.rooms.end(), [&room](const FSpaceData& other) { return IsSameSpace(room, other); }));
+	}
+
+	//only the tiles of the subtree change, refilling them matches a full fill
+	const std::vector<uint8_t> expected = GenerateTiles(settings, layout);
+	for (int row = 0; row < rows; row++)
+	{
+		for (int col = 0; col < rows; col++)
+		{
+			const bool isChanged = col >= changed.minCol && row >= changed.minRow && col < changed.maxCol && row < changed.maxRow;
+			if (!isChanged)
+				CHECK(expected[col + rows * row] == tiles[col + rows * row]);
+		}
+	}
+	FillTileRect(settings, layout, changed, tiles.data());
+	CHECK(tiles == expected);
+
+	std::vector<uint8_t> expectedMasks(rows * rows);
+	std::vector<uint8_t> expectedPadded((rows + 2) * (rows + 2));
+	UpdateNeighbourMasks(tiles.data(), rows, changed, padded.data(), masks.data());
+	ComputeNeighbourMasks(expected.data(), rows, expectedPadded.data(), expectedMasks.data());
+	CHECK(masks == expectedMasks && padded == expectedPadded);
+
+	//the same subtree seed builds the same layout, regenerating an ancestor replaces the subtree seeds below it
+	FLayout again = original;
+	CHECK(RegenerateSubtree(settings, seed, key, 5, again, changed));
+	CHECK(IsSameLayout(again, layout));
+	CHECK(RegenerateSubtree(settings, seed, 0, seed, layout, changed));
+	CHECK(layout.subtreeSeeds.size() == 1 && IsSameLayout(layout, original));
+	CHECK(changed.minCol == 0 && changed.maxCol == rows);
+}
+
+static void TestRegionIds()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 31);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<int32_t> regionIds(rows * rows);
+	const int numRegions = FillRegionIds(settings, layout, tiles.data(), regionIds.data());
+	const int numRooms = int(layout.rooms.size());
+	CHECK(numRegions > numRooms);
+
+	for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+	{
+		const int32_t region = regionIds[tileIndex];
+		if (tiles[tileIndex] == uint8_t(ETileType::EMPTY))
+			CHECK(region == -1);
+		else if (tiles[tileIndex] == uint8_t(ETileType::ROOM))
+			CHECK(region >= 0 && region < numRooms);
+		else
+			CHECK(region >= numRooms && region < numRegions);
+
+		//touching corridor tiles are in the same region
+		const int col = tileIndex % rows;
+		if (tiles[tileIndex] == uint8_t(ETileType::CORRIDOR) && col + 1 < rows && tiles[tileIndex + 1] == uint8_t(ETileType::CORRIDOR))
+			CHECK(regionIds[tileIndex + 1] == region);
+		if (tiles[tileIndex] == uint8_t(ETileType::CORRIDOR) && tileIndex + rows < rows * rows && tiles[tileIndex + rows] == uint8_t(ETileType::CORRIDOR))
+			CHECK(regionIds[tileIndex + rows] == region);
+	}
+}
+
+//distance of every tile from startTile over all walkable tiles, -1 when unreachable
+static std::vector<int> GetGridDistances(const std::vector<uint8_t>& tiles, int rows, int startTile)
+{
+	std::vector<int> distances(tiles.size(), -1);
+	std::vector<int> queue(1, startTile);
+	distances[startTile] = 0;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		const int tile = queue[head];
+		const int col = tile % rows;
+		const int neighbours[4] = { col + 1 < rows ? tile + 1 : -1, col > 0 ? tile - 1 : -1, tile + rows < rows * rows ? tile + rows : -1, tile - rows };
+		for (int neighbour : neighbours)
+		{
+			if (neighbour >= 0 && tiles[neighbour] != uint8_t(ETileType::EMPTY) && distances[neighbour] == -1)
+			{
+				distances[neighbour] = distances[tile] + 1;
+				queue.push_back(neighbour);
+			}
+		}
+	}
+	return distances;
+}
+
+static void TestPathGraph()
+{
+	FSettings settings;
+	settings.splitIterations = 6;
+	const FLayout layout = GenerateLayout(settings, 17);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<int32_t> regionIds(rows * rows);
+	const int numRegions = FillRegionIds(settings, layout, tiles.data(), regionIds.data());
+
+	FPathGraph graph;
+	graph.Build(regionIds.data(), rows, numRegions);
+	CHECK(!graph.GetEntrances().empty());
+	for (const FEntrance& entrance : graph.GetEntrances())
+	{
+		CHECK(entrance.regionA != entrance.regionB);
+		CHECK(regionIds[entrance.tileA] == entrance.regionA && regionIds[entrance.tileB] == entrance.regionB);
+		CHECK(entrance.tileB - entrance.tileA == 1 || entrance.tileB - entrance.tileA == rows);
+	}
+
+	std::vector<int> walkableTiles;
+	for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+	{
+		if (tiles[tileIndex] != uint8_t(ETileType::EMPTY))
+			walkableTiles.push_back(tileIndex);
+	}
+
+	FPathScratch scratch;
+	std::vector<int32_t> path;
+	FRandomStream stream(5);
+	for (int query = 0; query < 200; query++)
+	{
+		const int startTile = walkableTiles[stream.RandRange(0, int(walkableTiles.size()) - 1)];
+		const int goalTile = walkableTiles[stream.RandRange(0, int(walkableTiles.size()) - 1)];
+		const std::vector<int> distances = GetGridDistances(tiles, rows, startTile);
+		const bool isFound = graph.FindPath(startTile, goalTile, scratch, path);
+		CHECK(isFound == (distances[goalTile] != -1));
+		if (!isFound)
+			continue;
+
+		//a walkable 4-connected path, at least as long as the shortest one
+		CHECK(path.front() == startTile && path.back() == goalTile);
+		CHECK(int(path.size()) - 1 >= distances[goalTile]);
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			CHECK(tiles[path[i]] != uint8_t(ETileType::EMPTY));
+			if (i > 0)
+			{
+				const int step = std::abs(path[i] - path[i - 1]);
+				CHECK((step == 1 && path[i] / rows == path[i - 1] / rows) || step == rows);
+			}
+		}
+	}
+
+	//tiles outside of the grid and empty tiles have no path
+	CHECK(!graph.FindPath(walkableTiles.front(), -1, scratch, path));
+	const int emptyTile = int(std::find(tiles.begin(), tiles.end(), uint8_t(ETileType::EMPTY)) - tiles.begin());
+	CHECK(!graph.FindPath(walkableTiles.front(), emptyTile, scratch, path));
+}
+
+static void TestSmoothPath()
+{
+	FSettings settings;
+	settings.splitIterations = 6;
+	const FLayout layout = GenerateLayout(settings, 29);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<int32_t> regionIds(rows * rows);
+	const int numRegions = FillRegionIds(settings, layout, tiles.data(), regionIds.data());
+	FPathGraph graph;
+	graph.Build(regionIds.data(), rows, numRegions);
+
+	//inside a room every line is walkable, a line that leaves the grid is not
+	const FSpaceData& room = layout.rooms[0];
+	const int roomCol = room.left / settings.tileSize;
+	const int roomRow = room.bottom / settings.tileSize;
+	float hitFraction;
+	CHECK(!graph.Raycast(roomCol + 0.5f, roomRow + 0.5f, roomCol + room.width / settings.tileSize - 0.5f, roomRow + room.height / settings.tileSize - 0.5f, hitFraction));
+	CHECK(hitFraction == 1.f);
+	CHECK(graph.Raycast(roomCol + 0.5f, roomRow + 0.5f, -0.5f, roomRow + 0.5f, hitFraction));
+	CHECK(hitFraction > 0.f && hitFraction < 1.f);
+
+	std::vector<int> walkableTiles;
+	for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+	{
+		if (tiles[tileIndex] != uint8_t(ETileType::EMPTY))
+			walkableTiles.push_back(tileIndex);
+	}
+
+	FPathScratch scratch;
+	std::vector<int32_t> path;
+	FRandomStream stream(9);
+	for (int query = 0; query < 200; query++)
+	{
+		const int startTile = walkableTiles[stream.RandRange(0, int(walkableTiles.size()) - 1)];
+		const int goalTile = walkableTiles[stream.RandRange(0, int(walkableTiles.size()) - 1)];
+		if (!graph.FindPath(startTile, goalTile, scratch, path))
+			continue;
+
+		//a subsequence of the tile path with the same ends and walkable lines in between
+		const std::vector<int32_t> tilePath = path;
+		graph.SmoothPath(path, 0.2f);
+		CHECK(path.front() == startTile && path.back() == goalTile);
+		CHECK(path.size() <= tilePath.size());
+		size_t tile = 0;
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			while (tile < tilePath.size() && tilePath[tile] != path[i])
+				tile++;
+			CHECK(tile < tilePath.size());
+			if (i > 0)
+				CHECK(graph.IsLineWalkable(path[i - 1], path[i], 0.2f));
+		}
+	}
+}
+
+static bool IsSameField(const FFlowField& field, const std::vector<uint8_t>& tiles, int rows)
+{
+	const std::vector<int> distances = GetGridDistances(tiles, rows, field.GetTarget());
+	for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+	{
+		if (field.GetDistance(tileIndex) != distances[tileIndex])
+			return false;
+	}
+	return true;
+}
+
+static void TestFlowField()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 23);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+
+	FFlowField field;
+	field.Init(tiles.data(), rows);
+	CHECK(field.GetDistance(0) == -1);
+	const int startTile = int(std::find(tiles.begin(), tiles.end(), uint8_t(ETileType::ROOM)) - tiles.begin());
+	CHECK(!field.SetTarget(startTile));
+	CHECK(IsSameField(field, tiles, rows));
+
+	//a random walk of the target, every step is repaired and matches a full search
+	FRandomStream stream(9);
+	int target = startTile;
+	for (int step = 0; step < 300; step++)
+	{
+		const int col = target % rows;
+		const int candidates[4] = { col + 1 < rows ? target + 1 : -1, col > 0 ? target - 1 : -1, target + rows < rows * rows ? target + rows : -1, target - rows };
+		const int next = candidates[stream.RandRange(0, 3)];
+		if (next < 0 || tiles[next] == uint8_t(ETileType::EMPTY))
+			continue;
+
+		target = next;
+		CHECK(field.SetTarget(target));
+		CHECK(field.GetNumVisitedTiles() < rows * rows);
+	}
+	CHECK(IsSameField(field, tiles, rows));
+
+	//a short jump is repaired step by step, a long one searched again
+	const std::vector<int> distances = GetGridDistances(tiles, rows, target);
+	const int nearTile = int(std::find(distances.begin(), distances.end(), FFlowField::MaxRepairSteps) - distances.begin());
+	const int farTile = int(std::max_element(distances.begin(), distances.end()) - distances.begin());
+	CHECK(field.SetTarget(nearTile));
+	CHECK(IsSameField(field, tiles, rows));
+	CHECK(!field.SetTarget(farTile));
+	CHECK(IsSameField(field, tiles, rows));
+
+	//following the next tiles reaches the target
+	int tile = startTile;
+	int numSteps = 0;
+	while (field.GetNextTile(tile) != -1)
+	{
+		tile = field.GetNextTile(tile);
+		numSteps++;
+	}
+	CHECK(tile == farTile && numSteps == field.GetDistance(startTile));
+
+	CHECK(!field.SetTarget(-1));
+	CHECK(field.GetDistance(startTile) == -1);
+}
+
+static void TestVisibility()
+{
+	//rooms 0 and 2 joined by the straight corridor 1, room 3 below room 2 behind the corridor 4
+	const int rows = 8;
+	const int32_t regionIds[rows * rows] = {
+		0, 0, 1, 1, 1, 1, 2, 2,
+		0, 0,-1,-1,-1,-1, 2, 2,
+		-1,-1,-1,-1,-1,-1,-1, 4,
+		-1,-1,-1,-1,-1,-1,-1, 4,
+		-1,-1,-1,-1,-1,-1, 3, 3,
+		-1,-1,-1,-1,-1,-1, 3, 3,
+		-1,-1,-1,-1,-1,-1, 3, 3,
+		-1,-1,-1,-1,-1,-1, 3, 3,
+	};
+	FPathGraph graph;
+	graph.Build(regionIds, rows, 5);
+	FRegionVisibility visibility;
+	visibility.Build(graph);
+	CHECK(visibility.GetNumRegions() == 5);
+	CHECK(visibility.IsVisible(0, 2) && visibility.IsVisible(2, 0));
+	CHECK(visibility.IsVisible(2, 3) && visibility.IsVisible(4, 3));
+	CHECK(!visibility.IsVisible(0, 3) && !visibility.IsVisible(1, 3));
+	CHECK(visibility.GetNumVisible(0) == 3);
+
+	//a generated dungeon: symmetric, every region sees itself and its linked regions
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 29);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int dungeonRows = settings.dungeonSize / settings.tileSize;
+	std::vector<int32_t> dungeonRegionIds(dungeonRows * dungeonRows);
+	const int numRegions = FillRegionIds(settings, layout, tiles.data(), dungeonRegionIds.data());
+	graph.Build(dungeonRegionIds.data(), dungeonRows, numRegions);
+	visibility.Build(graph);
+	int numHidden = 0;
+	for (int region = 0; region < numRegions; region++)
+	{
+		CHECK(visibility.IsVisible(region, region));
+		int numLinks = 0;
+		const int32_t* links = graph.GetLinkedRegions(region, numLinks);
+		for (int i = 0; i < numLinks; i++)
+		{
+			CHECK(visibility.IsVisible(region, links[i]));
+		}
+		for (int other = 0; other < numRegions; other++)
+		{
+			CHECK(visibility.IsVisible(region, other) == visibility.IsVisible(other, region));
+			numHidden += visibility.IsVisible(region, other) ? 0 : 1;
+		}
+	}
+	CHECK(numHidden > 0);
+
+	visibility.Reset();
+	CHECK(visibility.GetNumRegions() == 0);
+}
+
+static int CountBits(int bits)
+{
+	int numBits = 0;
+	for (; bits != 0; bits &= bits - 1)
+	{
+		numBits++;
+	}
+	return numBits;
+}
+
+static void TestTorches()
+{
+	FSettings settings;
+	const FLayout layout = GenerateLayout(settings, 41);
+	const std::vector<uint8_t> tiles = GenerateTiles(settings, layout);
+	const int rows = settings.dungeonSize / settings.tileSize;
+	std::vector<uint8_t> padded((rows + 2) * (rows + 2));
+	std::vector<uint8_t> masks(rows * rows);
+	ComputeNeighbourMasks(tiles.data(), rows, padded.data(), masks.data());
+
+	//a torch on every wall of a room tile with a spacing of 1
+	std::vector<FTorch> torches;
+	PlaceTorches(tiles.data(), masks.data(), rows, 1, torches);
+	int numRoomWalls = 0;
+	for (int tileIndex = 0; tileIndex < rows * rows; tileIndex++)
+	{
+		if (tiles[tileIndex] == uint8_t(ETileType::ROOM))
+			numRoomWalls += CountBits(ObjectLUT.Objects[masks[tileIndex]] & 0x0F);
+	}
+	CHECK(int(torches.size()) == numRoomWalls);
+
+	//the torches hang on walls of room tiles, toward an empty side
+	const int sideCols[4] = { 1, -1, 0, 0 };
+	const int sideRows[4] = { 0, 0, 1, -1 };
+	PlaceTorches(tiles.data(), masks.data(), rows, 4, torches);
+	CHECK(torches.size() > 0 && int(torches.size()) < numRoomWalls);
+	std::vector<bool> isLitTile(rows * rows, false);
+	for (const FTorch& torch : torches)
+	{
+		CHECK(tiles[torch.tile] == uint8_t(ETileType::ROOM) && torch.side < 4);
+		const int col = torch.tile % rows + sideCols[torch.side];
+		const int row = torch.tile / rows + sideRows[torch.side];
+		CHECK(col < 0 || row < 0 || col >= rows || row >= rows || tiles[col + rows * row] == uint8_t(ETileType::EMPTY));
+		isLitTile[torch.tile] = true;
+	}
+	//every room has a torch
+	for (const FSpaceData& room : layout.rooms)
+	{
+		bool hasTorch = false;
+		for (int row = room.bottom / settings.tileSize; row < (room.bottom + room.height) / settings.tileSize; row++)
+		{
+			for (int col = room.left / settings.tileSize; col < (room.left + room.width) / settings.tileSize; col++)
+			{
+				hasTorch |= isLitTile[col + rows * row];
+			}
+		}
+		CHECK(hasTorch);
+	}
+	std::vector<FTorch> sparseTorches;
+	PlaceTorches(tiles.data(), masks.data(), rows, 1000, sparseTorches);
+	CHECK(sparseTorches.size() <= torches.size());
+
+	//the lowest costs are selected
+	FRandomStream stream(3);
+	std::vector<float> costs(500);
+	for (float& cost : costs)
+	{
+		cost = stream.GetFraction();
+	}
+	std::vector<int32_t> selected;
+	SelectLowestCosts(costs, 8, selected);
+	CHECK(selected.size() == 8);
+	std::vector<float> sortedCosts = costs;
+	std::sort(sortedCosts.begin(), sortedCosts.end());
+	for (int32_t index : selected)
+	{
+		CHECK(costs[index] <= sortedCosts[7]);
+	}
+	SelectLowestCosts(costs, 1000, selected);
+	CHECK(selected.size() == costs.size());
+}
+
+int main()
+{
+	TestRandomStream();
+	TestDeterminism();
+	TestParallelSplit();
+	TestTree();
+	TestRooms();
+	TestTileGrid();
+	TestLayoutValidation();
+	TestNeighbourMasks();
+	TestObjectLUT();
+	TestRegenerateSubtree();
+	TestRegionIds();
+	TestPathGraph();
+	TestSmoothPath();
+	TestFlowField();
+	TestVisibility();
+	TestTorches();
+
+	if (NumFailures > 0)
+	{
+		std::printf("%d checks failed\n", NumFailures);
+		return 1;
+	}
+	std::printf("All checks passed\n");
+	return 0;
+}